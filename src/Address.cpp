@@ -1,6 +1,7 @@
 #include "Address.h"
 
 #include <cmath>
+#include <cstdint>
 #include <algorithm>
 #include <istream>
 
@@ -14,6 +15,17 @@ using namespace std;
 const int Address::MAX_ROW;
 const int Address::MAX_COL;
 
+size_t hash<Address>::operator()(const Address &addr) const
+{
+    /* mix both coordinates into 64 bits instead of hashing the textual form */
+    uint64_t key = ((uint64_t) (uint32_t) addr.col() << 32) | (uint32_t) addr.row();
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+
+    return key;
+}
+
 Address::Address(int col, int row)
     : m_Col(col),
       m_Row(row)
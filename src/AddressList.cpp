@@ -0,0 +1,159 @@
+#include "AddressList.h"
+
+#include <algorithm>
+
+using namespace std;
+
+const uint32_t AddressList::INLINE_CAPACITY;
+
+AddressList::AddressList()
+{
+}
+
+AddressList::AddressList(initializer_list<Address> addrs)
+{
+    for (const Address &addr : addrs) {
+        push_back(addr);
+    }
+}
+
+AddressList::AddressList(const AddressList &other)
+{
+    *this = other;
+}
+
+AddressList::AddressList(AddressList &&other)
+{
+    *this = move(other);
+}
+
+AddressList &AddressList::operator=(const AddressList &other)
+{
+    if (this == &other) {
+        return *this;
+    }
+
+    clear();
+
+    if (other.m_Size > m_Capacity) {
+        release();
+        m_Heap = new Coords[other.m_Size];
+        m_Capacity = other.m_Size;
+    }
+
+    copy(other.data(), other.data() + other.m_Size, data());
+    m_Size = other.m_Size;
+
+    return *this;
+}
+
+AddressList &AddressList::operator=(AddressList &&other)
+{
+    if (this == &other) {
+        return *this;
+    }
+
+    if (other.m_Capacity == INLINE_CAPACITY) {
+        return *this = other;
+    }
+
+    release();
+
+    m_Heap = other.m_Heap;
+    m_Size = other.m_Size;
+    m_Capacity = other.m_Capacity;
+
+    other.m_Size = 0;
+    other.m_Capacity = INLINE_CAPACITY;
+
+    return *this;
+}
+
+AddressList::~AddressList()
+{
+    release();
+}
+
+AddressList::Coords *AddressList::data()
+{
+    return m_Capacity == INLINE_CAPACITY ? m_Inline : m_Heap;
+}
+
+const AddressList::Coords *AddressList::data() const
+{
+    return m_Capacity == INLINE_CAPACITY ? m_Inline : m_Heap;
+}
+
+void AddressList::release()
+{
+    if (m_Capacity != INLINE_CAPACITY) {
+        delete[] m_Heap;
+        m_Capacity = INLINE_CAPACITY;
+    }
+}
+
+void AddressList::push_back(const Address &addr)
+{
+    if (m_Size == m_Capacity) {
+        Coords *grown = new Coords[m_Capacity * 2];
+        copy(data(), data() + m_Size, grown);
+
+        release();
+        m_Heap = grown;
+        m_Capacity = m_Size * 2;
+    }
+
+    data()[m_Size++] = {addr.col(), addr.row()};
+}
+
+void AddressList::clear()
+{
+    m_Size = 0;
+}
+
+size_t AddressList::size() const
+{
+    return m_Size;
+}
+
+bool AddressList::empty() const
+{
+    return m_Size == 0;
+}
+
+Address AddressList::operator[](size_t i) const
+{
+    const Coords &coords = data()[i];
+
+    return Address(coords.col, coords.row);
+}
+
+AddressList::const_iterator AddressList::begin() const
+{
+    return const_iterator(data());
+}
+
+AddressList::const_iterator AddressList::end() const
+{
+    return const_iterator(data() + m_Size);
+}
+
+bool AddressList::operator==(const AddressList &rhs) const
+{
+    if (m_Size != rhs.m_Size) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < m_Size; ++i) {
+        if (data()[i].col != rhs.data()[i].col || data()[i].row != rhs.data()[i].row) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool AddressList::operator!=(const AddressList &rhs) const
+{
+    return !(*this == rhs);
+}
@@ -0,0 +1,191 @@
+#include "Sheet.h"
+
+using namespace std;
+
+Cell::Cell(const Sheet &sheet, const Address &addr, TypeTag type, const string &content)
+    : CellBase(sheet, addr, type)
+{
+    if (content.length() > 0 && content[0] == '=') {
+        m_IsFormula = true;
+        m_Formula = Formula::Parser::parseSource(content.substr(1), type, m_Dependencies,
+                                                 *sheet.getPool());
+
+        /* the canonical source, generated once */
+        string source = "=";
+        m_Formula->appendSource(source);
+        m_Source = sheet.getSources()->intern(move(source));
+    } else {
+        m_IsFormula = false;
+        m_Value = Value::fromString(content, type);
+        initLiteralSource();
+    }
+}
+
+Cell::Cell(const Sheet &sheet, const Address &addr, TypeTag type)
+    : CellBase(sheet, addr, type)
+{
+    m_IsFormula = false;
+    m_Value = Value::fromString("", type);
+    initLiteralSource();
+}
+
+Cell::Cell(const Sheet &sheet, const Address &addr, const Value &number)
+    : CellBase(sheet, addr, number.getKind() == Value::Kind::INT ? TypeTag::INT : TypeTag::DOUBLE),
+      m_IsFormula(false),
+      m_Value(number)
+{
+    initLiteralSource();
+}
+
+void Cell::initLiteralSource()
+{
+    /* strings are their own sources */
+    if (m_Tag == TypeTag::STRING) {
+        return;
+    }
+
+    /* number objects are short-lived (see CellStore), so not worth interning */
+    m_Source = allocate_shared<const string>(PoolAllocator<string>(m_Sheet.getPool()),
+                                             m_Value.toString(false));
+}
+
+string Cell::getType() const
+{
+    return typeName(m_Tag);
+}
+
+bool Cell::isFormula() const
+{
+    return m_IsFormula;
+}
+
+void Cell::evaluate() const
+{
+    struct Frame
+    {
+        /* holds cells of unloaded tiles */
+        shared_ptr<const CellBase> holder;
+        const Cell *cell;
+        bool expanded;
+    };
+
+    vector<Frame> stack;
+    stack.push_back({nullptr, this, false});
+
+    try {
+        while (!stack.empty()) {
+            Frame &frame = stack.back();
+            const Cell *cell = frame.cell;
+
+            /* scheduled more than once */
+            if (cell->m_State == State::VALID) {
+                stack.pop_back();
+                continue;
+            }
+
+            if (frame.expanded) {
+                /* all precedents are evaluated now, or are in a loop with the cell */
+                cell->m_Value = cell->m_Formula->evaluate(m_Sheet).convert(cell->m_Tag);
+                cell->m_State = State::VALID;
+                SheetCounters::increment(m_Sheet.getCounters().evaluations);
+                stack.pop_back();
+                continue;
+            }
+
+            frame.expanded = true;
+            cell->m_State = State::EVALUATING;
+
+            /* the frame reference is invalidated by pushing */
+            for (const Address &addr : cell->m_Dependencies) {
+                shared_ptr<const CellBase> precedent = m_Sheet.getFormulaCell(addr);
+                if (!precedent) {
+                    continue;
+                }
+
+                const Cell *precedentCell = static_cast<const Cell *>(precedent.get());
+
+                if (precedentCell->m_State == State::INVALID) {
+                    stack.push_back({precedent, precedentCell, false});
+                }
+            }
+        }
+    } catch (...) {
+        for (const Frame &frame : stack) {
+            if (frame.cell->m_State == State::EVALUATING) {
+                frame.cell->m_State = State::INVALID;
+            }
+        }
+
+        throw;
+    }
+}
+
+Value Cell::getValue() const
+{
+    if (!m_IsFormula) {
+        return m_Value;
+    }
+
+    if (m_State == State::EVALUATING) {
+        return Value::error(Value::Error::LOOP);
+    }
+
+    if (m_State == State::INVALID) {
+        SheetCounters::increment(m_Sheet.getCounters().valueMisses);
+        evaluate();
+    } else {
+        SheetCounters::increment(m_Sheet.getCounters().valueHits);
+    }
+
+    return m_Value;
+}
+
+bool Cell::isEvaluated() const
+{
+    return !m_IsFormula || m_State == State::VALID;
+}
+
+void Cell::invalidate() const
+{
+    if (m_State == State::VALID) {
+        m_State = State::INVALID;
+        m_Value = Value();
+    }
+}
+
+string Cell::getContentText() const
+{
+    Value value = getValue();
+    value.throwIfError();
+
+    return value.toString();
+}
+
+const string &Cell::getContentSource() const
+{
+    if (m_Source) {
+        return *m_Source;
+    }
+
+    /* string literal - its value is the pure string (i.e. not surrounded by double quotes),
+     * always a single leaf */
+    return *m_Value.getRope()->leaf();
+}
+
+void Cell::serialize(ostream &os) const
+{
+    os << "{";
+    os << "\"type\":\"" << Utils::escapeString(getType()) << "\",";
+    os << "\"addr\":";
+    m_Addr.serialize(os);
+    os << ",";
+    os << "\"content\":\"";
+    Utils::writeEscaped(os, getContentSource());
+    os << "\"";
+    os << "}";
+}
+
+shared_ptr<CellBase> Cell::create(const string &content)
+{
+    return Cell::make(m_Sheet, m_Addr, m_Tag, content);
+}
@@ -8,17 +8,23 @@
 
 using namespace std;
 
-CellBase::CellBase(const Sheet &sheet, const Address &addr)
+CellBase::CellBase(const Sheet &sheet, const Address &addr, TypeTag tag)
     : m_Sheet(sheet),
-      m_Addr(addr)
+      m_Addr(addr),
+      m_Tag(tag)
 {}
 
+TypeTag CellBase::getTag() const
+{
+    return m_Tag;
+}
+
 Address CellBase::getAddr() const
 {
     return m_Addr;
 }
 
-const vector<Address> &CellBase::getDependencies() const
+const AddressList &CellBase::getDependencies() const
 {
     return m_Dependencies;
 }
@@ -68,13 +74,22 @@ shared_ptr<CellBase> CellBase::deserialize(istream &is, const Sheet &sheet)
         throw InvalidInputException();
     }
 
-    if (type == "int") {
-        return make_shared<Cell<int>>(sheet, addr, content);
-    } else if (type == "double") {
-        return make_shared<Cell<double>>(sheet, addr, content);
-    } else if (type == "string") {
-        return make_shared<Cell<string>>(sheet, addr, content);
+    return fromType(sheet, type, addr, content);
+}
+
+shared_ptr<CellBase> CellBase::fromType(
+    const Sheet &sheet,
+    const string &type,
+    const Address &addr,
+    const string &content)
+{
+    TypeTag tag;
+
+    try {
+        tag = typeTag(type);
+    } catch (const InvalidTypeException &ex) {
+        throw InvalidInputException();
     }
 
-    throw InvalidInputException();
+    return Cell::make(sheet, addr, tag, content);
 }
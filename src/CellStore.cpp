@@ -0,0 +1,782 @@
+#include "CellStore.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "Sheet.h"
+
+#include "exception/InvalidInputException.h"
+
+using namespace std;
+
+const int CellStore::TILE_COLS;
+const int CellStore::TILE_ROWS;
+const size_t CellStore::CELL_OVERHEAD;
+const size_t CellStore::LITERAL_SIZE;
+const size_t CellStore::DEFAULT_MEMORY_BUDGET;
+
+CellStore::CellStore(const Sheet &sheet)
+    : m_Sheet(sheet)
+{
+}
+
+uint64_t CellStore::tileKey(const Address &addr)
+{
+    return ((uint64_t) ((addr.col() - 1) / TILE_COLS) << 32) |
+        (uint32_t) ((addr.row() - 1) / TILE_ROWS);
+}
+
+uint64_t CellStore::swapKey(uint64_t key)
+{
+    return key << 32 | key >> 32;
+}
+
+CellStore::Tile &CellStore::createTile(uint64_t key)
+{
+    m_TilesByCol.insert(key);
+    m_TilesByRow.insert(swapKey(key));
+
+    return m_Tiles.emplace(piecewise_construct, forward_as_tuple(key),
+                           forward_as_tuple(m_Sheet.getPool())).first->second;
+}
+
+void CellStore::eraseTile(uint64_t key)
+{
+    m_TilesByCol.erase(key);
+    m_TilesByRow.erase(swapKey(key));
+
+    m_Tiles.erase(key);
+}
+
+uint16_t CellStore::cellOffset(const Address &addr)
+{
+    return (uint16_t) (((addr.row() - 1) % TILE_ROWS) * TILE_COLS + (addr.col() - 1) % TILE_COLS);
+}
+
+Address CellStore::cellAddress(uint64_t key, uint16_t offset)
+{
+    return Address((int) (key >> 32) * TILE_COLS + offset % TILE_COLS + 1,
+                   (int) (uint32_t) key * TILE_ROWS + offset / TILE_COLS + 1);
+}
+
+bool CellStore::isNumberLiteral(const CellBase &cell)
+{
+    return cell.getTag() != TypeTag::STRING && !static_cast<const Cell &>(cell).isFormula();
+}
+
+size_t CellStore::estimateSize(const CellBase &cell)
+{
+    if (isNumberLiteral(cell)) {
+        return LITERAL_SIZE;
+    }
+
+    return CELL_OVERHEAD + cell.getContentSource().length();
+}
+
+size_t CellStore::findLiteral(const Tile &tile, uint16_t offset)
+{
+    /* both keys of the offset (int and double) are at least offset << 1 */
+    vector<uint16_t>::const_iterator it = lower_bound(
+        tile.literalKeys.begin(), tile.literalKeys.end(), (uint16_t) (offset << 1));
+
+    if (it == tile.literalKeys.end() || (*it >> 1) != offset) {
+        return tile.literalKeys.size();
+    }
+
+    return it - tile.literalKeys.begin();
+}
+
+Value CellStore::literalValue(const Tile &tile, size_t i)
+{
+    uint64_t bits = tile.literalValues[i];
+
+    if (tile.literalKeys[i] & 1) {
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+
+        return Value(value);
+    }
+
+    return Value((int) (int64_t) bits);
+}
+
+shared_ptr<CellBase> CellStore::makeLiteralCell(uint64_t key, const Tile &tile, size_t i) const
+{
+    return Cell::make(m_Sheet, cellAddress(key, tile.literalKeys[i] >> 1),
+                      literalValue(tile, i));
+}
+
+void CellStore::insert(Tile &tile, shared_ptr<CellBase> cell)
+{
+    setOccupied(tile, cellOffset(cell->getAddr()), true);
+
+    if (!isNumberLiteral(*cell)) {
+        Address addr = cell->getAddr();
+        tile.cells.emplace(addr, move(cell));
+        return;
+    }
+
+    Value value = cell->getValue();
+    uint16_t key = cellOffset(cell->getAddr()) << 1;
+    uint64_t bits;
+
+    if (value.getKind() == Value::Kind::DOUBLE) {
+        double number = value.getDouble();
+        memcpy(&bits, &number, sizeof(bits));
+        key |= 1;
+    } else {
+        bits = (uint64_t) (int64_t) value.getInt();
+    }
+
+    /* cells are mostly added row by row, so this is usually the end */
+    size_t i = lower_bound(tile.literalKeys.begin(), tile.literalKeys.end(), key) -
+        tile.literalKeys.begin();
+
+    tile.literalKeys.insert(tile.literalKeys.begin() + i, key);
+    tile.literalValues.insert(tile.literalValues.begin() + i, bits);
+}
+
+bool CellStore::remove(Tile &tile, const Address &addr, size_t *bytes)
+{
+    CellMap::iterator it = tile.cells.find(addr);
+
+    if (it != tile.cells.end()) {
+        if (bytes != nullptr) {
+            *bytes = estimateSize(*it->second);
+        }
+
+        tile.cells.erase(it);
+        setOccupied(tile, cellOffset(addr), false);
+        return true;
+    }
+
+    size_t i = findLiteral(tile, cellOffset(addr));
+    if (i == tile.literalKeys.size()) {
+        return false;
+    }
+
+    setOccupied(tile, cellOffset(addr), false);
+
+    if (bytes != nullptr) {
+        *bytes = LITERAL_SIZE;
+    }
+
+    tile.literalKeys.erase(tile.literalKeys.begin() + i);
+    tile.literalValues.erase(tile.literalValues.begin() + i);
+
+    return true;
+}
+
+void CellStore::unload(Tile &tile)
+{
+    tile.cells.clear();
+
+    /* releases the memory, unlike clear() */
+    vector<uint16_t>().swap(tile.literalKeys);
+    vector<uint64_t>().swap(tile.literalValues);
+}
+
+void CellStore::setOccupied(Tile &tile, uint16_t offset, bool occupied)
+{
+    uint64_t &word = tile.occupied[offset % TILE_COLS][offset / TILE_COLS / 64];
+    uint64_t bit = (uint64_t) 1 << (offset / TILE_COLS % 64);
+
+    if (occupied) {
+        word |= bit;
+    } else {
+        word &= ~bit;
+    }
+}
+
+bool CellStore::isOccupied(const Tile &tile, int col, int row)
+{
+    return tile.occupied[col][row / 64] >> (row % 64) & 1;
+}
+
+const CellStore::Tile *CellStore::findIndexed(uint64_t key) const
+{
+    unordered_map<uint64_t, Tile>::const_iterator it = m_Tiles.find(key);
+    if (it == m_Tiles.end()) {
+        return nullptr;
+    }
+
+    if (!it->second.indexed) {
+        return access(key);
+    }
+
+    return &it->second;
+}
+
+void CellStore::open(const string &filename, size_t memoryBudget)
+{
+    m_File = make_unique<TileFile>(filename);
+    m_MemoryBudget = memoryBudget;
+
+    for (const pair<const uint64_t, TileFile::Extent> &entry : m_File->getIndex()) {
+        Tile &tile = createTile(entry.first);
+        tile.count = entry.second.cells;
+        tile.loaded = false;
+        tile.indexed = false;
+        ++m_Unindexed;
+
+        m_Size += tile.count;
+    }
+}
+
+bool CellStore::isOutOfCore() const
+{
+    return m_File != nullptr;
+}
+
+CellStore::Tile *CellStore::access(uint64_t key) const
+{
+    unordered_map<uint64_t, Tile>::iterator it = m_Tiles.find(key);
+    if (it == m_Tiles.end()) {
+        return nullptr;
+    }
+
+    Tile &tile = it->second;
+
+    if (!m_File) {
+        return &tile;
+    }
+
+    if (!tile.loaded) {
+        load(key, tile);
+        m_Lru.push_front(key);
+        tile.lru = m_Lru.begin();
+        enforceBudget(key);
+    } else if (tile.lru != m_Lru.begin()) {
+        m_Lru.splice(m_Lru.begin(), m_Lru, tile.lru);
+    }
+
+    return &tile;
+}
+
+void CellStore::load(uint64_t key, Tile &tile) const
+{
+    istringstream is(m_File->read(key));
+    char c;
+
+    unload(tile);
+    tile.bytes = 0;
+
+    is >> skipws;
+    Utils::assertInput(is, '[');
+
+    is >> c;
+    if (c != ']') {
+        is.seekg(-1, is.cur);
+
+        do {
+            shared_ptr<CellBase> cell = CellBase::deserialize(is, m_Sheet);
+            tile.bytes += estimateSize(*cell);
+
+            if (!tile.indexed) {
+                ++m_ColumnCells[cell->getAddr().col()];
+            }
+
+            insert(tile, cell);
+
+            is >> skipws;
+            is >> c;
+        } while (c == ',');
+
+        if (c != ']') {
+            throw InvalidInputException();
+        }
+    }
+
+    if (!tile.indexed) {
+        tile.indexed = true;
+        --m_Unindexed;
+    }
+
+    tile.loaded = true;
+    m_LoadedBytes += tile.bytes;
+}
+
+void CellStore::writeBack(uint64_t key, Tile &tile) const
+{
+    if (!tile.dirty) {
+        return;
+    }
+
+    ostringstream os;
+    os << '[';
+
+    bool first = true;
+    for (const pair<const Address, shared_ptr<CellBase>> &entry : tile.cells) {
+        if (!first) {
+            os << ',';
+        }
+
+        entry.second->serialize(os);
+        first = false;
+    }
+
+    for (size_t i = 0; i < tile.literalKeys.size(); ++i) {
+        if (!first) {
+            os << ',';
+        }
+
+        makeLiteralCell(key, tile, i)->serialize(os);
+        first = false;
+    }
+
+    os << ']';
+
+    m_File->write(key, os.str(), tile.count);
+    tile.dirty = false;
+}
+
+void CellStore::enforceBudget(uint64_t keep) const
+{
+    list<uint64_t>::iterator it = m_Lru.end();
+
+    while (m_LoadedBytes > m_MemoryBudget && it != m_Lru.begin()) {
+        --it;
+
+        if (*it == keep) {
+            continue;
+        }
+
+        Tile &tile = m_Tiles.at(*it);
+
+        /* cells in use, e.g. being evaluated */
+        bool pinned = false;
+        for (const pair<const Address, shared_ptr<CellBase>> &entry : tile.cells) {
+            if (entry.second.use_count() > 1) {
+                pinned = true;
+                break;
+            }
+        }
+
+        if (pinned) {
+            continue;
+        }
+
+        writeBack(*it, tile);
+
+        unload(tile);
+        tile.loaded = false;
+        m_LoadedBytes -= tile.bytes;
+        tile.bytes = 0;
+
+        it = m_Lru.erase(it);
+    }
+}
+
+shared_ptr<CellBase> CellStore::find(const Address &addr) const
+{
+    Value literal;
+    shared_ptr<CellBase> cell = findObject(addr, literal);
+
+    if (cell || literal.getKind() == Value::Kind::EMPTY) {
+        return cell;
+    }
+
+    return Cell::make(m_Sheet, addr, literal);
+}
+
+shared_ptr<CellBase> CellStore::findObject(const Address &addr, Value &literal) const
+{
+    literal = Value();
+
+    Tile *tile = access(tileKey(addr));
+    if (tile == nullptr) {
+        return nullptr;
+    }
+
+    CellMap::const_iterator it = tile->cells.find(addr);
+    if (it != tile->cells.end()) {
+        return it->second;
+    }
+
+    size_t i = findLiteral(*tile, cellOffset(addr));
+    if (i < tile->literalKeys.size()) {
+        literal = literalValue(*tile, i);
+    }
+
+    return nullptr;
+}
+
+shared_ptr<CellBase> CellStore::findLoaded(const Address &addr) const
+{
+    unordered_map<uint64_t, Tile>::const_iterator tile = m_Tiles.find(tileKey(addr));
+    if (tile == m_Tiles.end() || !tile->second.loaded) {
+        return nullptr;
+    }
+
+    CellMap::const_iterator it = tile->second.cells.find(addr);
+    if (it == tile->second.cells.end()) {
+        return nullptr;
+    }
+
+    return it->second;
+}
+
+void CellStore::put(shared_ptr<CellBase> cell)
+{
+    uint64_t key = tileKey(cell->getAddr());
+
+    Tile *tile = access(key);
+
+    if (tile == nullptr) {
+        tile = &createTile(key);
+
+        if (m_File) {
+            m_Lru.push_front(key);
+            tile->lru = m_Lru.begin();
+        }
+    }
+
+    size_t replacedBytes = 0;
+    bool replaced = remove(*tile, cell->getAddr(), m_File ? &replacedBytes : nullptr);
+
+    if (m_File) {
+        size_t bytes = estimateSize(*cell) - replacedBytes;
+
+        tile->bytes += bytes;
+        m_LoadedBytes += bytes;
+    }
+
+    if (!replaced) {
+        ++tile->count;
+        ++m_Size;
+        ++m_ColumnCells[cell->getAddr().col()];
+    }
+
+    insert(*tile, move(cell));
+    tile->dirty = true;
+
+    if (m_File) {
+        enforceBudget(key);
+    }
+}
+
+void CellStore::erase(const Address &addr)
+{
+    uint64_t key = tileKey(addr);
+
+    Tile *tile = access(key);
+    if (tile == nullptr) {
+        return;
+    }
+
+    size_t bytes = 0;
+    if (!remove(*tile, addr, m_File ? &bytes : nullptr)) {
+        return;
+    }
+
+    if (m_File) {
+        tile->bytes -= bytes;
+        m_LoadedBytes -= bytes;
+    }
+
+    --tile->count;
+    --m_Size;
+    tile->dirty = true;
+
+    map<int, size_t>::iterator column = m_ColumnCells.find(addr.col());
+    if (--column->second == 0) {
+        m_ColumnCells.erase(column);
+    }
+
+    if (tile->count == 0) {
+        if (m_File) {
+            m_File->remove(key);
+            m_Lru.erase(tile->lru);
+        }
+
+        eraseTile(key);
+    }
+}
+
+size_t CellStore::size() const
+{
+    return m_Size;
+}
+
+bool CellStore::contains(const Address &addr) const
+{
+    const Tile *tile = findIndexed(tileKey(addr));
+
+    return tile != nullptr &&
+        isOccupied(*tile, (addr.col() - 1) % TILE_COLS, (addr.row() - 1) % TILE_ROWS);
+}
+
+bool CellStore::findCell(
+    const Address &from,
+    int colStep,
+    int rowStep,
+    bool nonEmpty,
+    Address &found) const
+{
+    /* walks a line of cells: a column if vertical, a row otherwise; positions along and across
+     * the line are 0-based */
+    bool vertical = rowStep != 0;
+    int step = vertical ? rowStep : colStep;
+    int length = vertical ? TILE_ROWS : TILE_COLS;
+    int64_t limit = vertical ? Address::MAX_ROW : Address::MAX_COL;
+    int across = (vertical ? from.col() : from.row()) - 1;
+    int acrossOffset = across % (vertical ? TILE_COLS : TILE_ROWS);
+
+    /* keys of the tiles of the line in m_TilesByCol or m_TilesByRow share the upper half */
+    const set<uint64_t> &lineTiles = vertical ? m_TilesByCol : m_TilesByRow;
+    uint64_t band = (uint64_t) (across / (vertical ? TILE_COLS : TILE_ROWS)) << 32;
+
+    auto foundAt = [&](int64_t pos) {
+        found = vertical ? Address(across + 1, (int) pos + 1) : Address((int) pos + 1, across + 1);
+        return true;
+    };
+
+    int64_t pos = (vertical ? from.row() : from.col()) - 1 + step;
+
+    while (pos >= 0 && pos < limit) {
+        uint64_t lineKey = band | (uint64_t) (pos / length);
+        const Tile *tile = findIndexed(vertical ? lineKey : swapKey(lineKey));
+
+        if (tile == nullptr) {
+            if (!nonEmpty) {
+                return foundAt(pos);
+            }
+
+            /* skips the gap up to the nearest tile of the line */
+            set<uint64_t>::const_iterator it;
+
+            if (step > 0) {
+                it = lineTiles.upper_bound(lineKey);
+                if (it == lineTiles.end() || (*it & ~(uint64_t) UINT32_MAX) != band) {
+                    return false;
+                }
+
+                pos = (int64_t) (uint32_t) *it * length;
+            } else {
+                it = lineTiles.lower_bound(lineKey);
+                if (it == lineTiles.begin() || (*--it & ~(uint64_t) UINT32_MAX) != band) {
+                    return false;
+                }
+
+                pos = (int64_t) (uint32_t) *it * length + length - 1;
+            }
+
+            continue;
+        }
+
+        int64_t tileBegin = pos / length * length;
+        int64_t tileEnd = min(tileBegin + length, limit);
+
+        for (; pos >= tileBegin && pos < tileEnd; pos += step) {
+            int offset = (int) (pos - tileBegin);
+
+            if (vertical) {
+                /* words of bits all the same are skipped at once */
+                uint64_t word = tile->occupied[acrossOffset][offset / 64];
+
+                if (word == (nonEmpty ? 0 : ~(uint64_t) 0)) {
+                    pos += step > 0 ? 63 - offset % 64 : -(offset % 64);
+                    continue;
+                }
+
+                if ((word >> (offset % 64) & 1) == nonEmpty) {
+                    return foundAt(pos);
+                }
+            } else if (isOccupied(*tile, offset, acrossOffset) == nonEmpty) {
+                return foundAt(pos);
+            }
+        }
+    }
+
+    return false;
+}
+
+bool CellStore::getUsedRange(Address &begin, Address &end) const
+{
+    /* the columns of tiles not indexed yet are not counted */
+    if (m_Unindexed > 0) {
+        for (uint64_t key : m_TilesByCol) {
+            findIndexed(key);
+        }
+    }
+
+    if (m_ColumnCells.empty()) {
+        return false;
+    }
+
+    int minRow = INT_MAX, maxRow = 0;
+
+    /* the first and the last rows are within the tiles of the extreme row bands */
+    for (uint64_t bandKey : {*m_TilesByRow.begin(), *m_TilesByRow.rbegin()}) {
+        uint64_t band = bandKey & ~(uint64_t) UINT32_MAX;
+
+        for (set<uint64_t>::const_iterator it = m_TilesByRow.lower_bound(band);
+             it != m_TilesByRow.end() && (*it & ~(uint64_t) UINT32_MAX) == band; ++it) {
+            const Tile *tile = findIndexed(swapKey(*it));
+
+            for (int word = 0; word < TILE_ROWS / 64; ++word) {
+                uint64_t any = 0;
+                for (int col = 0; col < TILE_COLS; ++col) {
+                    any |= tile->occupied[col][word];
+                }
+
+                if (any != 0) {
+                    int first = (int) (*it >> 32) * TILE_ROWS + word * 64 + 1;
+                    minRow = min(minRow, first + __builtin_ctzll(any));
+                    maxRow = max(maxRow, first + 63 - __builtin_clzll(any));
+                }
+            }
+        }
+    }
+
+    begin = Address(m_ColumnCells.begin()->first, minRow);
+    end = Address(m_ColumnCells.rbegin()->first, maxRow);
+
+    return true;
+}
+
+void CellStore::forEach(const function<void(const shared_ptr<CellBase> &)> &fn) const
+{
+    forEach(fn, [this, &fn](const Address &addr, const Value &value) {
+        fn(Cell::make(m_Sheet, addr, value));
+    });
+}
+
+void CellStore::forEach(const function<void(const shared_ptr<CellBase> &)> &fn,
+                        const function<void(const Address &, const Value &)> &literalFn) const
+{
+    vector<uint64_t> keys;
+    keys.reserve(m_Tiles.size());
+
+    for (const pair<const uint64_t, Tile> &entry : m_Tiles) {
+        keys.push_back(entry.first);
+    }
+
+    /* the cells are copied, so that the functions may access other cells (and evict this tile) */
+    vector<shared_ptr<CellBase>> cells;
+    vector<pair<Address, Value>> literals;
+
+    for (uint64_t key : keys) {
+        cells.clear();
+        literals.clear();
+
+        Tile *tile = access(key);
+        if (tile == nullptr) {
+            continue;
+        }
+
+        for (const pair<const Address, shared_ptr<CellBase>> &entry : tile->cells) {
+            cells.push_back(entry.second);
+        }
+
+        for (size_t i = 0; i < tile->literalKeys.size(); ++i) {
+            literals.emplace_back(cellAddress(key, tile->literalKeys[i] >> 1),
+                                  literalValue(*tile, i));
+        }
+
+        for (const shared_ptr<CellBase> &cell : cells) {
+            fn(cell);
+        }
+
+        for (const pair<Address, Value> &literal : literals) {
+            literalFn(literal.first, literal.second);
+        }
+    }
+}
+
+void CellStore::scan(
+    const function<void(const Address &, const CellBase *, const Value &)> &fn,
+    unsigned threads) const
+{
+    vector<uint64_t> keys;
+    keys.reserve(m_Tiles.size());
+
+    for (const pair<const uint64_t, Tile> &entry : m_Tiles) {
+        keys.push_back(entry.first);
+    }
+
+    const Value none;
+
+    auto scanTile = [&fn, &none](uint64_t key, const Tile &tile) {
+        for (const pair<const Address, shared_ptr<CellBase>> &entry : tile.cells) {
+            fn(entry.first, entry.second.get(), none);
+        }
+
+        for (size_t i = 0; i < tile.literalKeys.size(); ++i) {
+            fn(cellAddress(key, tile.literalKeys[i] >> 1), nullptr, literalValue(tile, i));
+        }
+    };
+
+    /* loading tiles changes the store, so out-of-core stores are not shared among threads */
+    if (m_File) {
+        for (uint64_t key : keys) {
+            Tile *tile = access(key);
+            if (tile != nullptr) {
+                scanTile(key, *tile);
+            }
+        }
+
+        return;
+    }
+
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+
+    threads = (unsigned) min<size_t>(threads, (keys.size() + 15) / 16);
+
+    /* tiles differ a lot in their numbers of cells, so the threads take them one by one */
+    atomic<size_t> next(0);
+
+    auto work = [&]() {
+        for (size_t i = next++; i < keys.size(); i = next++) {
+            scanTile(keys[i], m_Tiles.at(keys[i]));
+        }
+    };
+
+    vector<thread> workers;
+
+    for (unsigned i = 1; i < threads; ++i) {
+        workers.emplace_back(work);
+    }
+
+    work();
+
+    for (thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void CellStore::save()
+{
+    for (pair<const uint64_t, Tile> &entry : m_Tiles) {
+        if (entry.second.loaded) {
+            writeBack(entry.first, entry.second);
+        }
+    }
+
+    m_File->saveIndex();
+}
+
+size_t CellStore::getLoadedBytes() const
+{
+    return m_LoadedBytes;
+}
+
+size_t CellStore::getLiteralBytes() const
+{
+    size_t bytes = 0;
+
+    for (const pair<const uint64_t, Tile> &entry : m_Tiles) {
+        bytes += entry.second.literalKeys.capacity() * sizeof(uint16_t) +
+            entry.second.literalValues.capacity() * sizeof(uint64_t);
+    }
+
+    return bytes;
+}
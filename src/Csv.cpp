@@ -0,0 +1,440 @@
+#include "Csv.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "Sheet.h"
+
+#include "exception/InvalidArgumentException.h"
+
+using namespace std;
+
+const size_t Csv::INFER_ROWS;
+const size_t Csv::BATCH_SIZE;
+const size_t Csv::CHUNK_SIZE;
+
+const char *Csv::findSpecial(const char *begin, const char *end, char delimiter)
+{
+#ifdef __SSE2__
+    const __m128i delimiters = _mm_set1_epi8(delimiter);
+    const __m128i quotes = _mm_set1_epi8('"');
+    const __m128i newlines = _mm_set1_epi8('\n');
+    const __m128i returns = _mm_set1_epi8('\r');
+
+    while (end - begin >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+
+        __m128i matches = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, delimiters), _mm_cmpeq_epi8(chunk, quotes)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, newlines), _mm_cmpeq_epi8(chunk, returns)));
+
+        int mask = _mm_movemask_epi8(matches);
+        if (mask != 0) {
+            return begin + __builtin_ctz(mask);
+        }
+
+        begin += 16;
+    }
+#endif
+
+    for (; begin < end; ++begin) {
+        if (*begin == delimiter || *begin == '"' || *begin == '\n' || *begin == '\r') {
+            break;
+        }
+    }
+
+    return begin;
+}
+
+bool Csv::parseRow(
+    const char *&pos,
+    const char *end,
+    bool atEof,
+    char delimiter,
+    vector<string> &fields)
+{
+    const char *cur = pos;
+
+    fields.clear();
+
+    while (true) {
+        string field;
+
+        if (cur < end && *cur == '"') {
+            /* quoted field - only double quotes are special inside */
+            ++cur;
+
+            while (true) {
+                const char *quote = static_cast<const char *>(memchr(cur, '"', end - cur));
+
+                if (quote == nullptr) {
+                    if (!atEof) {
+                        return false;
+                    }
+
+                    /* unterminated quotes, take the rest of input */
+                    field.append(cur, end);
+                    cur = end;
+                    break;
+                }
+
+                field.append(cur, quote);
+                cur = quote + 1;
+
+                /* we can't tell "" from " yet */
+                if (cur == end && !atEof) {
+                    return false;
+                }
+
+                if (cur < end && *cur == '"') {
+                    field += '"';
+                    ++cur;
+                } else {
+                    break;
+                }
+            }
+        }
+
+        /* unquoted field (or anything after closing quotes), double quotes are not special */
+        const char *special = findSpecial(cur, end, delimiter);
+        while (special < end && *special == '"') {
+            special = findSpecial(special + 1, end, delimiter);
+        }
+
+        field.append(cur, special);
+        cur = special;
+
+        fields.push_back(move(field));
+
+        if (cur == end) {
+            if (!atEof) {
+                return false;
+            }
+
+            pos = cur;
+            return true;
+        }
+
+        if (*cur == delimiter) {
+            ++cur;
+            continue;
+        }
+
+        if (*cur == '\r') {
+            ++cur;
+
+            /* we can't tell \r\n from \r yet */
+            if (cur == end && !atEof) {
+                return false;
+            }
+
+            if (cur < end && *cur == '\n') {
+                ++cur;
+            }
+        } else {
+            ++cur;
+        }
+
+        pos = cur;
+        return true;
+    }
+}
+
+bool Csv::isDecimal(const string &value)
+{
+    size_t i = 0, n = value.length();
+
+    if (i < n && (value[i] == '-' || value[i] == '+')) {
+        ++i;
+    }
+
+    size_t digits = 0;
+
+    for (; i < n && isdigit((unsigned char) value[i]); ++i) {
+        ++digits;
+    }
+
+    if (i < n && value[i] == '.') {
+        for (++i; i < n && isdigit((unsigned char) value[i]); ++i) {
+            ++digits;
+        }
+    }
+
+    if (digits == 0) {
+        return false;
+    }
+
+    if (i < n && (value[i] == 'e' || value[i] == 'E')) {
+        ++i;
+
+        if (i < n && (value[i] == '-' || value[i] == '+')) {
+            ++i;
+        }
+
+        size_t exponentDigits = 0;
+
+        for (; i < n && isdigit((unsigned char) value[i]); ++i) {
+            ++exponentDigits;
+        }
+
+        if (exponentDigits == 0) {
+            return false;
+        }
+    }
+
+    return i == n;
+}
+
+const string &Csv::inferType(const string &value)
+{
+    const char *begin = value.c_str();
+    char *end;
+
+    /* strtol() and strtod() skip whitespace and strtod() reads hex floats, inf and nan */
+    if (!isDecimal(value)) {
+        return Type<string>::name;
+    }
+
+    errno = 0;
+    long intVal = strtol(begin, &end, 10);
+    if (*end == '\0' && errno == 0 && intVal >= INT_MIN && intVal <= INT_MAX) {
+        return Type<int>::name;
+    }
+
+    errno = 0;
+    strtod(begin, &end);
+    if (*end == '\0' && errno == 0) {
+        return Type<double>::name;
+    }
+
+    return Type<string>::name;
+}
+
+void Csv::writeField(string &out, const string &field, char delimiter)
+{
+    const char *begin = field.data();
+    const char *end = begin + field.length();
+
+    if (findSpecial(begin, end, delimiter) == end) {
+        out += field;
+        return;
+    }
+
+    out += '"';
+    for (const char *quote; (quote = static_cast<const char *>(memchr(begin, '"', end - begin)));
+        begin = quote + 1) {
+        out.append(begin, quote + 1);
+        out += '"';
+    }
+    out.append(begin, end);
+    out += '"';
+}
+
+char Csv::delimiterFor(const string &filename)
+{
+    string lower = Utils::toLower(filename);
+
+    if (lower.length() >= 4 && lower.compare(lower.length() - 4, 4, ".tsv") == 0) {
+        return '\t';
+    }
+
+    return ',';
+}
+
+size_t Csv::read(istream &is, Sheet &sheet, const Address &origin, char delimiter, bool inferTypes)
+{
+    vector<char> buffer(CHUNK_SIZE);
+    size_t length = 0;
+    bool atEof = false;
+
+    size_t rows = 0;
+    vector<string> fields;
+
+    /* rows read before the column types are known */
+    vector<vector<string>> sample;
+    bool typesKnown = !inferTypes;
+    vector<const string *> columnTypes;
+
+    vector<shared_ptr<CellBase>> batch;
+    batch.reserve(BATCH_SIZE);
+
+    auto placeRow = [&](const vector<string> &row, size_t rowIndex) {
+        if (rowIndex > (size_t) (Address::MAX_ROW - origin.row()) ||
+            row.size() - 1 > (size_t) (Address::MAX_COL - origin.col())) {
+            throw InvalidArgumentException();
+        }
+
+        for (size_t col = 0; col < row.size(); ++col) {
+            const string &value = row[col];
+
+            if (value.empty()) {
+                continue;
+            }
+
+            Address addr(origin.col() + col, origin.row() + rowIndex);
+
+            if (value[0] == '=') {
+                /* data, not a formula - store as a string literal formula */
+                batch.push_back(CellBase::fromType(
+                    sheet,
+                    Type<string>::name,
+                    addr,
+                    string("=") + Type<string>::toString(value, true)));
+            } else {
+                const string *type = &Type<string>::name;
+                if (col < columnTypes.size()) {
+                    type = columnTypes[col];
+                }
+
+                const string &valueType = inferType(value);
+
+                if (type == &Type<int>::name && &valueType != &Type<int>::name) {
+                    type = &Type<string>::name;
+                } else if (type == &Type<double>::name && &valueType == &Type<string>::name) {
+                    type = &Type<string>::name;
+                }
+
+                batch.push_back(CellBase::fromType(sheet, *type, addr, value));
+            }
+
+            if (batch.size() >= BATCH_SIZE) {
+                sheet.setCells(batch);
+                batch.clear();
+            }
+        }
+    };
+
+    /* column type is the widest type of its values: int < double < string */
+    auto inferColumnTypes = [&]() {
+        for (const vector<string> &row : sample) {
+            if (row.size() > columnTypes.size()) {
+                columnTypes.resize(row.size(), nullptr);
+            }
+
+            for (size_t col = 0; col < row.size(); ++col) {
+                if (row[col].empty() || columnTypes[col] == &Type<string>::name) {
+                    continue;
+                }
+
+                const string *valueType = &inferType(row[col]);
+
+                if (columnTypes[col] == nullptr || valueType == &Type<string>::name ||
+                    (valueType == &Type<double>::name && columnTypes[col] == &Type<int>::name)) {
+                    columnTypes[col] = valueType;
+                }
+            }
+        }
+
+        for (const string *&type : columnTypes) {
+            if (type == nullptr) {
+                type = &Type<string>::name;
+            }
+        }
+
+        for (size_t i = 0; i < sample.size(); ++i) {
+            placeRow(sample[i], i);
+        }
+
+        sample.clear();
+        typesKnown = true;
+    };
+
+    while (!atEof) {
+        /* the row doesn't fit into the buffer */
+        if (length == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+
+        is.read(buffer.data() + length, buffer.size() - length);
+        length += is.gcount();
+        atEof = !is.good();
+
+        const char *pos = buffer.data();
+        const char *end = buffer.data() + length;
+
+        while (pos < end && parseRow(pos, end, atEof, delimiter, fields)) {
+            if (typesKnown) {
+                placeRow(fields, rows);
+            } else {
+                sample.push_back(fields);
+
+                if (sample.size() == INFER_ROWS) {
+                    inferColumnTypes();
+                }
+            }
+
+            ++rows;
+        }
+
+        /* keep the incomplete row for the next round */
+        length = end - pos;
+        memmove(buffer.data(), pos, length);
+    }
+
+    if (!typesKnown) {
+        inferColumnTypes();
+    }
+
+    if (!batch.empty()) {
+        sheet.setCells(batch);
+    }
+
+    return rows;
+}
+
+void Csv::write(ostream &os, const Sheet &sheet, char delimiter)
+{
+    shared_ptr<const SheetSnapshot> snapshot = sheet.snapshot();
+
+    string out;
+    out.reserve(CHUNK_SIZE);
+
+    int row = 1, col = 1;
+
+    snapshot->forEachRowMajor([&](const CellBase *cell, const SheetSnapshot::Literal *literal) {
+        Address addr = cell != nullptr ? cell->getAddr() : literal->addr;
+
+        for (; row < addr.row(); ++row) {
+            out += '\n';
+            col = 1;
+        }
+
+        for (; col < addr.col(); ++col) {
+            out += delimiter;
+        }
+
+        string text;
+        if (cell == nullptr) {
+            text = literal->getValue().toString();
+        } else {
+            try {
+                text = cell->getContentText();
+            } catch (...) {
+                text = "#ERROR";
+            }
+        }
+
+        writeField(out, text, delimiter);
+
+        /* stream out in chunks */
+        if (out.size() >= CHUNK_SIZE) {
+            os.write(out.data(), out.size());
+            out.clear();
+        }
+    });
+
+    if (snapshot->size() > 0) {
+        out += '\n';
+    }
+
+    os.write(out.data(), out.size());
+    os.flush();
+}
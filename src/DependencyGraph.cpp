@@ -0,0 +1,379 @@
+#include "DependencyGraph.h"
+
+#include <algorithm>
+
+using namespace std;
+
+const uint32_t DependencyGraph::Adjacency::MIN_CAPACITY;
+const size_t DependencyGraph::Adjacency::MIN_COMPACT;
+const uint64_t DependencyGraph::IdMap::EMPTY;
+
+DependencyGraph::Adjacency::Segment &DependencyGraph::Adjacency::segment(Id id)
+{
+    if (id >= m_Segments.size()) {
+        m_Segments.resize(id + 1);
+    }
+
+    return m_Segments[id];
+}
+
+void DependencyGraph::Adjacency::compact()
+{
+    vector<Id> edges;
+    edges.reserve(m_Size);
+
+    for (Segment &seg : m_Segments) {
+        uint32_t begin = edges.size();
+        edges.insert(edges.end(), m_Edges.begin() + seg.begin,
+                     m_Edges.begin() + seg.begin + seg.count);
+
+        seg.begin = begin;
+        seg.capacity = seg.count;
+    }
+
+    m_Edges.swap(edges);
+}
+
+bool DependencyGraph::Adjacency::add(Id from, Id to)
+{
+    Segment &seg = segment(from);
+
+    Id *first = m_Edges.data() + seg.begin;
+    if (find(first, first + seg.count, to) != first + seg.count) {
+        return false;
+    }
+
+    if (seg.count == seg.capacity) {
+        /* move the segment to the end */
+        uint32_t capacity = max(MIN_CAPACITY, seg.capacity * 2);
+        uint32_t begin = m_Edges.size();
+
+        m_Edges.resize(begin + capacity);
+        copy(m_Edges.begin() + seg.begin, m_Edges.begin() + seg.begin + seg.count,
+             m_Edges.begin() + begin);
+
+        seg.begin = begin;
+        seg.capacity = capacity;
+    }
+
+    m_Edges[seg.begin + seg.count] = to;
+    ++seg.count;
+    ++m_Size;
+
+    if (m_Edges.size() - m_Size >= max(MIN_COMPACT, m_Size)) {
+        compact();
+    }
+
+    return true;
+}
+
+bool DependencyGraph::Adjacency::remove(Id from, Id to)
+{
+    if (from >= m_Segments.size()) {
+        return false;
+    }
+
+    Segment &seg = m_Segments[from];
+
+    Id *first = m_Edges.data() + seg.begin;
+    Id *last = first + seg.count;
+    Id *it = find(first, last, to);
+    if (it == last) {
+        return false;
+    }
+
+    *it = *(last - 1);
+    --seg.count;
+    --m_Size;
+
+    return true;
+}
+
+pair<const DependencyGraph::Id *, const DependencyGraph::Id *>
+DependencyGraph::Adjacency::get(Id from) const
+{
+    if (from >= m_Segments.size()) {
+        return make_pair(nullptr, nullptr);
+    }
+
+    const Segment &seg = m_Segments[from];
+    const Id *first = m_Edges.data() + seg.begin;
+
+    return make_pair(first, first + seg.count);
+}
+
+void DependencyGraph::Adjacency::build(const vector<pair<Id, Id>> &edges, size_t ids)
+{
+    m_Segments.assign(max(m_Segments.size(), ids), Segment());
+
+    /* counting sort by source */
+    for (const pair<Id, Id> &edge : edges) {
+        ++m_Segments[edge.first].count;
+    }
+
+    uint32_t begin = 0;
+    for (Segment &seg : m_Segments) {
+        seg.begin = begin;
+        begin += seg.count;
+        seg.count = 0;
+    }
+
+    m_Edges.resize(edges.size());
+
+    for (const pair<Id, Id> &edge : edges) {
+        Segment &seg = m_Segments[edge.first];
+        m_Edges[seg.begin + seg.count++] = edge.second;
+    }
+
+    /* remove duplicates, moving the segments down over the freed space */
+    uint32_t end = 0;
+    for (Segment &seg : m_Segments) {
+        Id *first = m_Edges.data() + seg.begin;
+        sort(first, first + seg.count);
+        Id *last = unique(first, first + seg.count);
+
+        seg.count = last - first;
+        seg.capacity = seg.count;
+        seg.begin = end;
+
+        move(first, last, m_Edges.data() + end);
+        end += seg.count;
+    }
+
+    m_Edges.resize(end);
+    m_Edges.shrink_to_fit();
+    m_Size = end;
+}
+
+void DependencyGraph::Adjacency::transpose(const Adjacency &other, size_t ids)
+{
+    vector<pair<Id, Id>> edges;
+    edges.reserve(other.m_Size);
+
+    for (Id from = 0; from < other.m_Segments.size(); ++from) {
+        const Segment &seg = other.m_Segments[from];
+
+        for (uint32_t i = seg.begin; i < seg.begin + seg.count; ++i) {
+            edges.emplace_back(other.m_Edges[i], from);
+        }
+    }
+
+    build(edges, ids);
+}
+
+void DependencyGraph::Adjacency::collect(vector<pair<Id, Id>> &edges) const
+{
+    for (Id from = 0; from < m_Segments.size(); ++from) {
+        const Segment &seg = m_Segments[from];
+
+        for (uint32_t i = seg.begin; i < seg.begin + seg.count; ++i) {
+            edges.emplace_back(from, m_Edges[i]);
+        }
+    }
+}
+
+size_t DependencyGraph::Adjacency::size() const
+{
+    return m_Size;
+}
+
+size_t DependencyGraph::Adjacency::getBytes() const
+{
+    return m_Segments.capacity() * sizeof(Segment) + m_Edges.capacity() * sizeof(Id);
+}
+
+uint64_t DependencyGraph::IdMap::pack(const Address &addr)
+{
+    return ((uint64_t) (uint32_t) addr.col() << 32) | (uint32_t) addr.row();
+}
+
+size_t DependencyGraph::IdMap::slot(uint64_t key) const
+{
+    uint64_t hash = key;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    size_t mask = m_Slots.size() - 1;
+    size_t index = hash & mask;
+
+    while (m_Slots[index].key != EMPTY && m_Slots[index].key != key) {
+        index = (index + 1) & mask;
+    }
+
+    return index;
+}
+
+void DependencyGraph::IdMap::grow()
+{
+    vector<Slot> slots(max((size_t) 16, m_Slots.size() * 2));
+    slots.swap(m_Slots);
+
+    for (const Slot &old : slots) {
+        if (old.key != EMPTY) {
+            m_Slots[slot(old.key)] = old;
+        }
+    }
+}
+
+const DependencyGraph::Id *DependencyGraph::IdMap::find(uint64_t key) const
+{
+    if (m_Slots.empty()) {
+        return nullptr;
+    }
+
+    const Slot &found = m_Slots[slot(key)];
+
+    return found.key == EMPTY ? nullptr : &found.id;
+}
+
+DependencyGraph::Id DependencyGraph::IdMap::insert(uint64_t key, Id id)
+{
+    /* at most half full */
+    if ((m_Size + 1) * 2 > m_Slots.size()) {
+        grow();
+    }
+
+    Slot &found = m_Slots[slot(key)];
+
+    if (found.key == EMPTY) {
+        found.key = key;
+        found.id = id;
+        ++m_Size;
+    }
+
+    return found.id;
+}
+
+size_t DependencyGraph::IdMap::getBytes() const
+{
+    return m_Slots.capacity() * sizeof(Slot);
+}
+
+DependencyGraph::Id DependencyGraph::getId(const Address &addr)
+{
+    Id id = m_Ids.insert(IdMap::pack(addr), (Id) m_Addresses.size());
+
+    if (id == m_Addresses.size()) {
+        m_Addresses.push_back(addr);
+    }
+
+    return id;
+}
+
+bool DependencyGraph::findId(const Address &addr, Id &id) const
+{
+    const Id *found = m_Ids.find(IdMap::pack(addr));
+    if (found == nullptr) {
+        return false;
+    }
+
+    id = *found;
+    return true;
+}
+
+const Address &DependencyGraph::getAddress(Id id) const
+{
+    return m_Addresses[id];
+}
+
+void DependencyGraph::setPrecedents(const Address &cell, const AddressList &precedents)
+{
+    Id id;
+    if (!findId(cell, id)) {
+        if (precedents.empty()) {
+            return;
+        }
+
+        id = getId(cell);
+    }
+
+    pair<const Id *, const Id *> old = m_Precedents.get(id);
+    vector<Id> oldIds(old.first, old.second);
+
+    for (Id precedent : oldIds) {
+        m_Precedents.remove(id, precedent);
+        m_Dependents.remove(precedent, id);
+    }
+
+    for (const Address &addr : precedents) {
+        Id precedent = getId(addr);
+
+        if (m_Precedents.add(id, precedent)) {
+            m_Dependents.add(precedent, id);
+        }
+    }
+}
+
+void DependencyGraph::addAll(const vector<pair<Address, Address>> &edges)
+{
+    if (edges.size() < max((size_t) 4096, size() / 4)) {
+        for (const pair<Address, Address> &edge : edges) {
+            Id precedent = getId(edge.first);
+            Id dependent = getId(edge.second);
+
+            if (m_Precedents.add(dependent, precedent)) {
+                m_Dependents.add(precedent, dependent);
+            }
+        }
+
+        return;
+    }
+
+    /* (dependent, precedent) */
+    vector<pair<Id, Id>> ids;
+    ids.reserve(size() + edges.size());
+
+    m_Precedents.collect(ids);
+
+    for (const pair<Address, Address> &edge : edges) {
+        ids.emplace_back(getId(edge.second), getId(edge.first));
+    }
+
+    m_Precedents.build(ids, m_Addresses.size());
+    m_Dependents.transpose(m_Precedents, m_Addresses.size());
+}
+
+pair<const DependencyGraph::Id *, const DependencyGraph::Id *>
+DependencyGraph::getDependents(Id id) const
+{
+    return m_Dependents.get(id);
+}
+
+pair<const DependencyGraph::Id *, const DependencyGraph::Id *>
+DependencyGraph::getPrecedents(Id id) const
+{
+    return m_Precedents.get(id);
+}
+
+vector<Address> DependencyGraph::getDependents(const Address &addr) const
+{
+    vector<Address> dependents;
+
+    Id id;
+    if (findId(addr, id)) {
+        pair<const Id *, const Id *> range = m_Dependents.get(id);
+
+        for (const Id *it = range.first; it != range.second; ++it) {
+            dependents.push_back(m_Addresses[*it]);
+        }
+    }
+
+    return dependents;
+}
+
+size_t DependencyGraph::size() const
+{
+    return m_Precedents.size();
+}
+
+size_t DependencyGraph::getIdCount() const
+{
+    return m_Addresses.size();
+}
+
+size_t DependencyGraph::getBytes() const
+{
+    return m_Ids.getBytes() + m_Addresses.capacity() * sizeof(Address) +
+        m_Precedents.getBytes() + m_Dependents.getBytes();
+}
@@ -0,0 +1,320 @@
+#include "Headless.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include <sys/stat.h>
+
+#include "Csv.h"
+#include "Journal.h"
+
+#include "exception/InvalidArgumentException.h"
+#include "exception/InvalidInputException.h"
+#include "exception/IOException.h"
+
+using namespace std;
+
+/**
+ * Whether the file should be treated as CSV/TSV according to its extension.
+ */
+static bool isCsv(const string &filename)
+{
+    string lower = Utils::toLower(filename);
+
+    return lower.length() >= 4 &&
+        (lower.compare(lower.length() - 4, 4, ".csv") == 0 ||
+            lower.compare(lower.length() - 4, 4, ".tsv") == 0);
+}
+
+/**
+ * Whether the file should be treated as a tile file according to its extension.
+ */
+static bool isTiles(const string &filename)
+{
+    string lower = Utils::toLower(filename);
+
+    return lower.length() >= 6 && lower.compare(lower.length() - 6, 6, ".tiles") == 0;
+}
+
+/**
+ * Whether both names refer to the same existing file, however they are spelled (relative,
+ * through links...).
+ */
+static bool isSameFile(const string &lhs, const string &rhs)
+{
+    struct stat lhsStat, rhsStat;
+
+    if (stat(lhs.c_str(), &lhsStat) != 0 || stat(rhs.c_str(), &rhsStat) != 0) {
+        return false;
+    }
+
+    return lhsStat.st_dev == rhsStat.st_dev && lhsStat.st_ino == rhsStat.st_ino;
+}
+
+shared_ptr<Sheet> Headless::load(const string &filename, size_t memoryBudget)
+{
+    if (isTiles(filename)) {
+        if (!ifstream(filename).good())
+            throw IOException();
+
+        return make_shared<Sheet>(filename, memoryBudget);
+    }
+
+    ifstream file(filename, ios::binary);
+    if (!file.good())
+        throw IOException();
+
+    if (isCsv(filename)) {
+        shared_ptr<Sheet> sheet = make_shared<Sheet>();
+        Csv::read(file, *sheet, Address(1, 1), Csv::delimiterFor(filename));
+
+        return sheet;
+    }
+
+    shared_ptr<Sheet> sheet = Sheet::deserialize(file);
+
+    Journal journal(filename);
+    journal.replay(*sheet);
+
+    return sheet;
+}
+
+void Headless::save(const Sheet &sheet, const string &filename, size_t memoryBudget)
+{
+    if (isTiles(filename)) {
+        remove(filename.c_str());
+
+        /* copied in batches, so that neither sheet has to fit in memory */
+        Sheet tiles(filename, memoryBudget);
+        vector<shared_ptr<CellBase>> batch;
+
+        sheet.forEachCell([&](const CellBase &cell) {
+            batch.push_back(CellBase::fromType(
+                tiles,
+                cell.getType(),
+                cell.getAddr(),
+                cell.getContentSource()));
+
+            if (batch.size() >= 4096) {
+                tiles.setCells(batch);
+                batch.clear();
+            }
+        });
+
+        tiles.setCells(batch);
+        tiles.saveTiles();
+
+        return;
+    }
+
+    ofstream file(filename, ios::binary);
+    if (!file.good())
+        throw IOException();
+
+    if (isCsv(filename)) {
+        Csv::write(file, sheet, Csv::delimiterFor(filename));
+    } else {
+        sheet.serialize(file);
+    }
+
+    file.close();
+    if (file.fail())
+        throw IOException();
+
+    if (!isCsv(filename)) {
+        /* the journal would override the new content on load */
+        remove(Journal::journalFilename(filename).c_str());
+    }
+}
+
+void Headless::applyEdit(Sheet &sheet, const string &edit)
+{
+    size_t sepPos = edit.find_first_of("=:");
+    if (sepPos == string::npos) {
+        throw InvalidArgumentException();
+    }
+
+    Address addr(Utils::trim(edit.substr(0, sepPos)));
+
+    if (edit[sepPos] == '=') {
+        sheet.setCellContent(addr, edit.substr(sepPos + 1));
+        return;
+    }
+
+    string type = Utils::trim(edit.substr(sepPos + 1));
+
+    if (type == Type<int>::name) {
+        sheet.setCellType<int>(addr);
+    } else if (type == Type<double>::name) {
+        sheet.setCellType<double>(addr);
+    } else if (type == Type<string>::name) {
+        sheet.setCellType<string>(addr);
+    } else {
+        throw InvalidArgumentException();
+    }
+}
+
+void Headless::printCell(ostream &os, const CellBase &cell)
+{
+    string value;
+
+    try {
+        value = cell.getContentText();
+    } catch (...) {
+        value = "#ERROR";
+    }
+
+    os << (string) cell.getAddr() << '\t' << cell.getType() << '\t' << value << '\n';
+}
+
+void Headless::dump(ostream &os, const Sheet &sheet)
+{
+    shared_ptr<const SheetSnapshot> snapshot = sheet.snapshot();
+
+    snapshot->forEachRowMajor([&os](const CellBase *cell, const SheetSnapshot::Literal *literal) {
+        if (cell != nullptr) {
+            printCell(os, *cell);
+        } else {
+            os << (string) literal->addr << '\t' << literal->getType() << '\t'
+               << literal->getValue().toString() << '\n';
+        }
+    });
+}
+
+void Headless::printUsage(ostream &os)
+{
+    os << "usage: spreadsheet --batch [-m <MiB>] [<file>] [options]\n"
+       << "  -e, --edit <addr>=<content>|<addr>:<type>\n"
+       << "  -E, --edits <file>\n"
+       << "  -c, --cell <addr>\n"
+       << "  -d, --dump\n"
+       << "  --csv\n"
+       << "  --stats\n"
+       << "  -o, --output <file>\n";
+}
+
+int Headless::run(const vector<string> &args, ostream &out, ostream &err)
+{
+    size_t i = 0;
+    shared_ptr<Sheet> sheet;
+    size_t memoryBudget = CellStore::DEFAULT_MEMORY_BUDGET;
+
+    /* file the sheet was loaded from */
+    string filename;
+
+    /* what we are doing right now, for error messages */
+    string action;
+
+    try {
+        if (i + 1 < args.size() && (args[i] == "-m" || args[i] == "--memory")) {
+            char *end;
+            unsigned long long mib = strtoull(args[i + 1].c_str(), &end, 10);
+
+            if (args[i + 1].empty() || *end != '\0' || mib == 0) {
+                printUsage(err);
+                return 2;
+            }
+
+            memoryBudget = (size_t) mib << 20;
+            i += 2;
+        }
+
+        if (i < args.size() && (args[i].empty() || args[i][0] != '-')) {
+            action = "loading " + args[i];
+            filename = args[i];
+            sheet = load(args[i++], memoryBudget);
+        } else {
+            sheet = make_shared<Sheet>();
+        }
+
+        for (; i < args.size(); ++i) {
+            const string &opt = args[i];
+
+            /* options with an argument */
+            if (opt == "-e" || opt == "--edit" || opt == "-E" || opt == "--edits" ||
+                opt == "-c" || opt == "--cell" || opt == "-o" || opt == "--output") {
+                if (i + 1 >= args.size()) {
+                    printUsage(err);
+                    return 2;
+                }
+
+                const string &arg = args[++i];
+
+                if (opt == "-e" || opt == "--edit") {
+                    action = "applying edit " + arg;
+                    applyEdit(*sheet, arg);
+                } else if (opt == "-E" || opt == "--edits") {
+                    action = "reading edits from " + arg;
+
+                    ifstream file;
+                    if (arg != "-") {
+                        file.open(arg);
+                        if (!file.good())
+                            throw IOException();
+                    }
+
+                    istream &edits = arg == "-" ? cin : file;
+
+                    string line;
+                    while (getline(edits, line)) {
+                        line = Utils::trimRight(line, " \r");
+                        if (line.empty() || line[0] == '#') {
+                            continue;
+                        }
+
+                        action = "applying edit " + line;
+                        applyEdit(*sheet, line);
+                    }
+                } else if (opt == "-c" || opt == "--cell") {
+                    action = "reading cell " + arg;
+                    printCell(out, *sheet->getCell(Address(arg)));
+                } else {
+                    action = "saving " + arg;
+
+                    /* save() would remove the tile file the sheet is reading from */
+                    if (sheet->isOutOfCore() && isSameFile(arg, filename)) {
+                        sheet->saveTiles();
+                    } else {
+                        save(*sheet, arg, memoryBudget);
+                    }
+                }
+            } else if (opt == "-d" || opt == "--dump") {
+                action = "dumping";
+                dump(out, *sheet);
+            } else if (opt == "--csv") {
+                action = "dumping";
+                Csv::write(out, *sheet);
+            } else if (opt == "--stats") {
+                sheet->getStats().serialize(out);
+                out << "\n";
+            } else {
+                printUsage(err);
+                return 2;
+            }
+        }
+    } catch (const IOException &ex) {
+        err << "error: I/O failure while " << action << endl;
+        return 1;
+    } catch (const InvalidInputException &ex) {
+        err << "error: malformed input while " << action << endl;
+        return 1;
+    } catch (const IncorrectFormulaSyntaxException &ex) {
+        err << "error: incorrect formula syntax while " << action << endl;
+        return 1;
+    } catch (const InvalidTypeException &ex) {
+        err << "error: invalid type while " << action << endl;
+        return 1;
+    } catch (const InvalidArgumentException &ex) {
+        err << "error: invalid argument while " << action << endl;
+        return 1;
+    } catch (const exception &ex) {
+        err << "error: " << ex.what() << " while " << action << endl;
+        return 1;
+    }
+
+    out.flush();
+
+    return 0;
+}
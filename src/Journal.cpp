@@ -0,0 +1,235 @@
+#include "Journal.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include <unistd.h>
+
+#include "Sheet.h"
+
+#include "exception/CancelledException.h"
+#include "exception/IOException.h"
+#include "exception/InvalidInputException.h"
+
+using namespace std;
+
+const size_t Journal::DEFAULT_COMPACT_THRESHOLD;
+
+Journal::Journal(const string &baseFilename, size_t compactThreshold)
+    : m_BaseFilename(baseFilename),
+      m_CompactThreshold(compactThreshold),
+      m_Compacting(false),
+      m_CompactionFailed(false)
+{}
+
+Journal::~Journal()
+{
+    waitForCompaction();
+}
+
+string Journal::journalFilename(const string &baseFilename)
+{
+    return baseFilename + ".journal";
+}
+
+const string &Journal::getBaseFilename() const
+{
+    return m_BaseFilename;
+}
+
+void Journal::record(const string &type, const Address &addr, const string &content)
+{
+    ostringstream oss;
+
+    oss << "{";
+    oss << "\"type\":\"" << Utils::escapeString(type) << "\",";
+    oss << "\"addr\":";
+    addr.serialize(oss);
+    oss << ",";
+    oss << "\"content\":\"";
+    Utils::writeEscaped(oss, content);
+    oss << "\"";
+    oss << "}";
+
+    m_Pending.push_back(oss.str());
+}
+
+size_t Journal::pendingCount() const
+{
+    return m_Pending.size();
+}
+
+void Journal::reset(const Sheet &sheet)
+{
+    waitForCompaction();
+
+    lock_guard<mutex> lock(m_FileMutex);
+
+    ofstream base(m_BaseFilename);
+    if (!base.good())
+        throw IOException();
+
+    sheet.serialize(base);
+    base.close();
+
+    ofstream journal(journalFilename(m_BaseFilename), ios::trunc);
+    if (!journal.good())
+        throw IOException();
+
+    journal.close();
+
+    m_Pending.clear();
+    m_Size = 0;
+}
+
+void Journal::flush(const Sheet &sheet)
+{
+    if (m_CompactionFailed.exchange(false)) {
+        throw IOException();
+    }
+
+    size_t journalOffset;
+
+    {
+        lock_guard<mutex> lock(m_FileMutex);
+
+        ofstream journal(journalFilename(m_BaseFilename), ios::app);
+        if (!journal.good())
+            throw IOException();
+
+        for (const string &rec : m_Pending) {
+            journal << rec << '\n';
+            m_Size += rec.length() + 1;
+        }
+
+        journal.close();
+        if (journal.fail())
+            throw IOException();
+
+        m_Pending.clear();
+        journalOffset = m_Size;
+    }
+
+    if (journalOffset >= m_CompactThreshold && !m_Compacting) {
+        compact(sheet, journalOffset);
+    }
+}
+
+void Journal::replay(Sheet &sheet, const atomic<bool> *cancelled)
+{
+    ifstream journal(journalFilename(m_BaseFilename), ios::binary);
+
+    /* no journal yet */
+    if (!journal.good()) {
+        return;
+    }
+
+    /* end of the last complete record */
+    streamoff validSize = 0;
+
+    while (true) {
+        if (cancelled && cancelled->load(memory_order_relaxed)) {
+            throw CancelledException();
+        }
+
+        journal >> ws;
+        if (journal.peek() == EOF) {
+            break;
+        }
+
+        shared_ptr<CellBase> cell;
+        try {
+            cell = CellBase::deserialize(journal, sheet);
+        } catch (const InvalidInputException &ex) {
+            /* the last record is incomplete if the program was interrupted while writing it */
+            if (journal.eof()) {
+                break;
+            }
+
+            throw;
+        }
+
+        sheet.putCell(cell);
+
+        if (journal.peek() == '\n') {
+            journal.get();
+        }
+        journal.clear();
+        validSize = journal.tellg();
+    }
+
+    journal.clear();
+    journal.seekg(0, journal.end);
+
+    /* cut off the incomplete record, so that new records are not appended after it */
+    if (journal.tellg() != validSize &&
+        truncate(journalFilename(m_BaseFilename).c_str(), validSize) != 0) {
+        throw IOException();
+    }
+
+    m_Size = validSize;
+}
+
+void Journal::waitForCompaction()
+{
+    if (m_Compactor.joinable()) {
+        m_Compactor.join();
+    }
+}
+
+void Journal::compact(const Sheet &sheet, size_t journalOffset)
+{
+    waitForCompaction();
+
+    m_Compacting = true;
+    m_Compactor = thread([this, journalOffset](shared_ptr<const SheetSnapshot> snapshot) {
+        if (!writeBase(*snapshot, journalOffset)) {
+            m_CompactionFailed = true;
+        }
+
+        m_Compacting = false;
+    }, sheet.snapshot());
+}
+
+bool Journal::writeBase(const SheetSnapshot &snapshot, size_t journalOffset)
+{
+    string tmpFilename = m_BaseFilename + ".tmp";
+
+    ofstream base(tmpFilename);
+    if (!base.good())
+        return false;
+
+    snapshot.serialize(base);
+    base.close();
+    if (base.fail() || rename(tmpFilename.c_str(), m_BaseFilename.c_str()) != 0)
+        return false;
+
+    /* the new base contains everything up to journalOffset, keep only the rest */
+    lock_guard<mutex> lock(m_FileMutex);
+
+    string journalFile = journalFilename(m_BaseFilename);
+    string tmpJournalFile = journalFile + ".tmp";
+
+    ifstream journal(journalFile, ios::binary);
+    if (!journal.good())
+        return false;
+
+    journal.seekg(journalOffset);
+    string tail((istreambuf_iterator<char>(journal)), istreambuf_iterator<char>());
+    journal.close();
+
+    ofstream tmpJournal(tmpJournalFile, ios::binary | ios::trunc);
+    if (!tmpJournal.good())
+        return false;
+
+    tmpJournal << tail;
+    tmpJournal.close();
+    if (tmpJournal.fail() || rename(tmpJournalFile.c_str(), journalFile.c_str()) != 0)
+        return false;
+
+    m_Size = tail.length();
+
+    return true;
+}
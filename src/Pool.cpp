@@ -0,0 +1,176 @@
+#include "Pool.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+const size_t Pool::CHUNK_SIZE;
+const size_t Pool::GRANULARITY;
+const size_t Pool::MAX_SIZE;
+
+Pool::Pool()
+    : m_Closed(false),
+      m_Free(MAX_SIZE / GRANULARITY, nullptr),
+      m_LiveNodes(0)
+{
+}
+
+Pool::~Pool()
+{
+    for (void *chunk : m_Chunks) {
+        free(chunk);
+    }
+}
+
+size_t Pool::sizeClass(size_t size)
+{
+    return size == 0 ? 0 : (size - 1) / GRANULARITY;
+}
+
+Pool *Pool::owner(void *ptr)
+{
+    uintptr_t chunk = reinterpret_cast<uintptr_t>(ptr) & ~(uintptr_t) (CHUNK_SIZE - 1);
+
+    return *reinterpret_cast<Pool **>(chunk);
+}
+
+void Pool::grow()
+{
+    void *chunk;
+    if (posix_memalign(&chunk, CHUNK_SIZE, CHUNK_SIZE) != 0) {
+        throw bad_alloc();
+    }
+
+    m_Chunks.push_back(chunk);
+
+    /* the owner, padded to keep the objects aligned */
+    *static_cast<Pool **>(chunk) = this;
+
+    m_Cursor = static_cast<char *>(chunk) + GRANULARITY;
+    m_End = static_cast<char *>(chunk) + CHUNK_SIZE;
+}
+
+void *Pool::allocate(size_t size)
+{
+    if (size > MAX_SIZE) {
+        return ::operator new(size);
+    }
+
+    size_t index = sizeClass(size);
+
+    lock_guard<mutex> lock(m_Mutex);
+
+    ++m_Live;
+    ++m_Allocated;
+
+    if (m_Free[index] != nullptr) {
+        FreeObject *object = m_Free[index];
+        m_Free[index] = object->next;
+
+        return object;
+    }
+
+    size_t rounded = (index + 1) * GRANULARITY;
+
+    /* the rest of the chunk is lost, at most MAX_SIZE bytes */
+    if ((size_t) (m_End - m_Cursor) < rounded) {
+        grow();
+    }
+
+    void *object = m_Cursor;
+    m_Cursor += rounded;
+
+    return object;
+}
+
+void Pool::deallocate(void *ptr, size_t size)
+{
+    if (size > MAX_SIZE) {
+        ::operator delete(ptr);
+        return;
+    }
+
+    if (m_Closed.load(memory_order_relaxed)) {
+        return;
+    }
+
+    size_t index = sizeClass(size);
+    FreeObject *object = static_cast<FreeObject *>(ptr);
+
+    lock_guard<mutex> lock(m_Mutex);
+
+    --m_Live;
+
+    object->next = m_Free[index];
+    m_Free[index] = object;
+}
+
+void Pool::close()
+{
+    m_Closed = true;
+}
+
+void Pool::release(void *ptr, size_t size)
+{
+    if (size > MAX_SIZE) {
+        ::operator delete(ptr);
+        return;
+    }
+
+    owner(ptr)->deallocate(ptr, size);
+}
+
+void *Pool::allocateNode(size_t size)
+{
+    void *ptr = allocate(size);
+
+    if (size <= MAX_SIZE) {
+        m_LiveNodes.fetch_add(1, memory_order_relaxed);
+    }
+
+    return ptr;
+}
+
+void Pool::releaseNode(void *ptr, size_t size)
+{
+    if (size <= MAX_SIZE) {
+        owner(ptr)->m_LiveNodes.fetch_sub(1, memory_order_relaxed);
+    }
+
+    release(ptr, size);
+}
+
+size_t Pool::getChunkCount()
+{
+    lock_guard<mutex> lock(m_Mutex);
+
+    return m_Chunks.size();
+}
+
+size_t Pool::getLiveCount()
+{
+    lock_guard<mutex> lock(m_Mutex);
+
+    return m_Live;
+}
+
+size_t Pool::getAllocatedCount()
+{
+    lock_guard<mutex> lock(m_Mutex);
+
+    return m_Allocated;
+}
+
+size_t Pool::getNodeCount() const
+{
+    return m_LiveNodes.load(memory_order_relaxed);
+}
+
+size_t Pool::getChunkBytes()
+{
+    lock_guard<mutex> lock(m_Mutex);
+
+    return m_Chunks.size() * CHUNK_SIZE;
+}
@@ -0,0 +1,330 @@
+#include "Recalculator.h"
+
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+
+const size_t Recalculator::LOOP_CHECK_DEPTH;
+
+Recalculator::Recalculator(shared_ptr<Sheet> sheet, Formatter format)
+    : m_Sheet(sheet),
+      m_Format(format),
+      m_Waiting(0),
+      m_LoopCheckDepth(LOOP_CHECK_DEPTH),
+      m_Busy(false),
+      m_Done(0),
+      m_Total(0)
+{
+    m_Subscription = m_Sheet->subscribe(
+        Address(1, 1),
+        Address(Address::MAX_COL, Address::MAX_ROW),
+        [this](const vector<Address> &changed) { restart(changed); });
+
+    m_Worker = thread(&Recalculator::run, this);
+}
+
+Recalculator::~Recalculator()
+{
+    {
+        unique_lock<mutex> guard = lock();
+        m_Stopping = true;
+    }
+
+    m_Cond.notify_all();
+    m_Worker.join();
+
+    m_Sheet->unsubscribe(m_Subscription);
+}
+
+unique_lock<mutex> Recalculator::lock()
+{
+    ++m_Waiting;
+    unique_lock<mutex> guard(m_Mutex);
+    --m_Waiting;
+
+    return guard;
+}
+
+void Recalculator::run()
+{
+    unique_lock<mutex> guard(m_Mutex);
+
+    while (true) {
+        m_Cond.wait(guard, [this]() {
+            return m_Stopping || !m_Pending.empty() || !m_Walk.empty();
+        });
+
+        while (!m_Stopping && (!m_Pending.empty() || !m_Walk.empty()) && m_Waiting == 0) {
+            step();
+        }
+
+        if (m_Timing && m_Pending.empty() && m_Walk.empty()) {
+            m_LastDuration = (long) chrono::duration_cast<chrono::microseconds>(
+                chrono::steady_clock::now() - m_Start).count();
+            m_Timing = false;
+        }
+
+        updateBusy();
+
+        if (m_Stopping) {
+            return;
+        }
+
+        /* let the waiting thread in before taking the lock again */
+        if (m_Waiting > 0) {
+            guard.unlock();
+
+            while (m_Waiting > 0) {
+                this_thread::yield();
+            }
+
+            guard.lock();
+        }
+    }
+}
+
+bool Recalculator::schedule(const Address &addr, bool urgent)
+{
+    pair<unordered_map<Address, uint64_t>::iterator, bool> pending = m_Pending.emplace(addr, 0);
+    pending.first->second = ++m_Seq;
+
+    (urgent || isInViewport(addr) ? m_Visible : m_Queue).push_front({addr, m_Seq});
+
+    return pending.second;
+}
+
+Address Recalculator::takeNext()
+{
+    while (true) {
+        deque<Entry> &queue = m_Visible.empty() ? m_Queue : m_Visible;
+        Entry entry = queue.front();
+        queue.pop_front();
+
+        unordered_map<Address, uint64_t>::iterator it = m_Pending.find(entry.addr);
+
+        if (it != m_Pending.end() && it->second == entry.seq) {
+            m_Pending.erase(it);
+
+            /* whatever is left is stale */
+            if (m_Pending.empty()) {
+                m_Visible.clear();
+                m_Queue.clear();
+            }
+
+            return entry.addr;
+        }
+    }
+}
+
+void Recalculator::dropStale()
+{
+    if (m_Visible.size() + m_Queue.size() <= 2 * m_Pending.size()) {
+        return;
+    }
+
+    auto isStale = [this](const Entry &entry) {
+        unordered_map<Address, uint64_t>::const_iterator it = m_Pending.find(entry.addr);
+        return it == m_Pending.end() || it->second != entry.seq;
+    };
+
+    m_Visible.erase(remove_if(m_Visible.begin(), m_Visible.end(), isStale), m_Visible.end());
+    m_Queue.erase(remove_if(m_Queue.begin(), m_Queue.end(), isStale), m_Queue.end());
+}
+
+void Recalculator::step()
+{
+    if (m_Walk.empty()) {
+        Address addr = takeNext();
+
+        shared_ptr<const CellBase> cell = m_Sheet->getCell(addr);
+
+        if (static_cast<const Cell &>(*cell).isEvaluated()) {
+            evaluate(addr, *cell);
+            ++m_Done;
+        } else {
+            visit(addr, cell);
+        }
+
+        return;
+    }
+
+    Frame &frame = m_Walk.back();
+    const AddressList &dependencies = frame.cell->getDependencies();
+
+    while (frame.next < dependencies.size()) {
+        Address precedent = dependencies[frame.next++];
+        shared_ptr<const CellBase> cell = m_Sheet->getFormulaCell(precedent);
+
+        if (cell && !static_cast<const Cell &>(*cell).isEvaluated()) {
+            /* invalidates the frame reference */
+            visit(precedent, cell);
+            return;
+        }
+    }
+
+    /* all precedents are evaluated, evaluating the cell takes no time */
+    Frame finished = move(frame);
+    m_Walk.pop_back();
+
+    evaluate(finished.addr, *finished.cell);
+
+    if (m_Walk.empty()) {
+        ++m_Done;
+        m_LoopCheckDepth = LOOP_CHECK_DEPTH;
+    }
+}
+
+void Recalculator::visit(const Address &addr, shared_ptr<const CellBase> cell)
+{
+    m_Walk.push_back({addr, move(cell), 0});
+
+    /* a loop makes the walk grow forever, checked whenever the depth doubles rather than
+     * tracking the walked cells in a set */
+    if (m_Walk.size() < m_LoopCheckDepth) {
+        return;
+    }
+
+    if (isWalkLooping()) {
+        finishWalk();
+    } else {
+        m_LoopCheckDepth *= 2;
+    }
+}
+
+bool Recalculator::isWalkLooping() const
+{
+    /* sorting is much faster than a set of this size */
+    vector<uint64_t> walked;
+    walked.reserve(m_Walk.size());
+
+    for (const Frame &frame : m_Walk) {
+        walked.push_back((uint64_t) frame.addr.col() << 32 | (uint32_t) frame.addr.row());
+    }
+
+    sort(walked.begin(), walked.end());
+
+    return adjacent_find(walked.begin(), walked.end()) != walked.end();
+}
+
+void Recalculator::finishWalk()
+{
+    /* the cell's own evaluation turns the loop into loop errors */
+    m_Walk.front().cell->getValue();
+
+    unordered_set<Address> reported;
+
+    for (const Frame &frame : m_Walk) {
+        if (reported.insert(frame.addr).second) {
+            evaluate(frame.addr, *frame.cell);
+        }
+    }
+
+    ++m_Done;
+
+    m_Walk.clear();
+    m_LoopCheckDepth = LOOP_CHECK_DEPTH;
+}
+
+void Recalculator::evaluate(const Address &addr, const CellBase &cell)
+{
+    if (!isInViewport(addr)) {
+        cell.getValue();
+        return;
+    }
+
+    m_Results.push_back({addr, m_Format(cell)});
+}
+
+void Recalculator::abandonWalk()
+{
+    if (m_Walk.empty()) {
+        return;
+    }
+
+    schedule(m_Walk.front().addr, false);
+
+    m_Walk.clear();
+    m_LoopCheckDepth = LOOP_CHECK_DEPTH;
+}
+
+bool Recalculator::isInViewport(const Address &addr) const
+{
+    return addr.col() >= m_ViewportBegin.col() && addr.row() >= m_ViewportBegin.row() &&
+        addr.col() <= m_ViewportEnd.col() && addr.row() <= m_ViewportEnd.row();
+}
+
+void Recalculator::updateBusy()
+{
+    m_Busy = !m_Pending.empty() || !m_Walk.empty() || !m_Results.empty();
+}
+
+void Recalculator::restart(const vector<Address> &cells)
+{
+    abandonWalk();
+
+    /* to the fronts in reverse, keeping the order (topological for changed cells) ahead of
+     * the cells waiting, visible ones before the others */
+    for (vector<Address>::const_reverse_iterator it = cells.rbegin(); it != cells.rend(); ++it) {
+        schedule(*it, false);
+    }
+
+    dropStale();
+
+    m_Done = 0;
+    m_Total = m_Pending.size();
+
+    m_Start = chrono::steady_clock::now();
+    m_Timing = true;
+
+    updateBusy();
+    m_Cond.notify_all();
+}
+
+void Recalculator::request(const Address &addr)
+{
+    abandonWalk();
+
+    if (schedule(addr, true)) {
+        ++m_Total;
+    }
+
+    updateBusy();
+    m_Cond.notify_all();
+}
+
+void Recalculator::setViewport(const Address &begin, const Address &end)
+{
+    m_ViewportBegin = begin;
+    m_ViewportEnd = end;
+}
+
+vector<Recalculator::Result> Recalculator::takeResults()
+{
+    vector<Result> results;
+    results.swap(m_Results);
+
+    updateBusy();
+
+    return results;
+}
+
+bool Recalculator::isBusy() const
+{
+    return m_Busy;
+}
+
+size_t Recalculator::getDone() const
+{
+    return m_Done;
+}
+
+size_t Recalculator::getTotal() const
+{
+    return m_Total;
+}
+
+long Recalculator::getLastDuration() const
+{
+    return m_LastDuration;
+}
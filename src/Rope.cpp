@@ -0,0 +1,136 @@
+#include "Rope.h"
+
+#include <vector>
+
+using namespace std;
+
+const size_t Rope::FLAT_LENGTH;
+
+Rope::Rope(const string &leaf)
+    : m_Length(leaf.length()),
+      m_Leaf(leaf)
+{
+}
+
+Rope::Rope(string &&leaf)
+    : m_Length(leaf.length()),
+      m_Leaf(move(leaf))
+{
+}
+
+Rope::Rope(shared_ptr<const Rope> left, shared_ptr<const Rope> right)
+    : m_Length(left->m_Length + right->m_Length),
+      m_Left(move(left)),
+      m_Right(move(right))
+{
+}
+
+Rope::~Rope()
+{
+    if (!m_Left) {
+        return;
+    }
+
+    /* release parts owned only by this rope one by one instead of by recursive destructors */
+    vector<shared_ptr<const Rope>> parts;
+    parts.push_back(move(m_Left));
+    parts.push_back(move(m_Right));
+
+    while (!parts.empty()) {
+        shared_ptr<const Rope> part = move(parts.back());
+        parts.pop_back();
+
+        if (part.use_count() == 1 && part->m_Left) {
+            Rope &owned = const_cast<Rope &>(*part);
+            parts.push_back(move(owned.m_Left));
+            parts.push_back(move(owned.m_Right));
+        }
+    }
+}
+
+shared_ptr<const Rope> Rope::concat(
+    const shared_ptr<const Rope> &left,
+    const shared_ptr<const Rope> &right)
+{
+    if (left->m_Length == 0) {
+        return right;
+    }
+
+    if (right->m_Length == 0) {
+        return left;
+    }
+
+    if (left->m_Length + right->m_Length < FLAT_LENGTH) {
+        string leaf;
+        leaf.reserve(left->m_Length + right->m_Length);
+        left->appendTo(leaf);
+        right->appendTo(leaf);
+
+        return make_shared<Rope>(move(leaf));
+    }
+
+    return make_shared<Rope>(left, right);
+}
+
+size_t Rope::length() const
+{
+    return m_Length;
+}
+
+void Rope::appendTo(string &out) const
+{
+    if (!m_Left) {
+        out += m_Leaf;
+        return;
+    }
+
+    vector<const Rope *> stack(1, this);
+
+    while (!stack.empty()) {
+        const Rope *rope = stack.back();
+        stack.pop_back();
+
+        if (!rope->m_Left) {
+            out += rope->m_Leaf;
+            continue;
+        }
+
+        stack.push_back(rope->m_Right.get());
+        stack.push_back(rope->m_Left.get());
+    }
+}
+
+string Rope::flatten() const
+{
+    if (!m_Left) {
+        return m_Leaf;
+    }
+
+    string out;
+    out.reserve(m_Length);
+    appendTo(out);
+
+    return out;
+}
+
+const string *Rope::leaf() const
+{
+    return m_Left ? nullptr : &m_Leaf;
+}
+
+bool Rope::operator==(const Rope &rhs) const
+{
+    if (this == &rhs) {
+        return true;
+    }
+
+    if (m_Length != rhs.m_Length) {
+        return false;
+    }
+
+    if (!m_Left && !rhs.m_Left) {
+        return m_Leaf == rhs.m_Leaf;
+    }
+
+    return flatten() == rhs.flatten();
+}
@@ -0,0 +1,140 @@
+#include "Search.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "exception/InvalidArgumentException.h"
+
+using namespace std;
+
+Search::Search(const string &pattern)
+    : m_Text(pattern)
+{
+    if (pattern.empty()) {
+        throw InvalidArgumentException();
+    }
+
+    try {
+        m_Regex = regex(pattern, regex::ECMAScript | regex::optimize);
+    } catch (const regex_error &) {
+        throw InvalidArgumentException();
+    }
+
+    m_IsLiteral = pattern.find_first_of("\\^$.|?*+()[]{}") == string::npos;
+
+    /* includes the characters of infinities and exponents of doubles */
+    m_MatchesNumbers =
+        !m_IsLiteral || pattern.find_first_not_of("0123456789+-.eEinfaINFA") == string::npos;
+}
+
+bool Search::matches(const string &text) const
+{
+    if (m_IsLiteral) {
+        return text.find(m_Text) != string::npos;
+    }
+
+    return regex_search(text, m_Regex);
+}
+
+bool Search::matches(const CellBase *cell, const Value &literal) const
+{
+    if (cell == nullptr) {
+        return m_MatchesNumbers && matches(literal.toString(false));
+    }
+
+    if (matches(cell->getContentSource())) {
+        return true;
+    }
+
+    const Cell &content = static_cast<const Cell &>(*cell);
+
+    /* the values of literals are their sources */
+    if (!content.isFormula() || !content.isEvaluated()) {
+        return false;
+    }
+
+    try {
+        return matches(content.getContentText());
+    } catch (const Exception &) {
+        return false;
+    }
+}
+
+bool Search::matches(const CellBase &cell) const
+{
+    return matches(&cell, Value());
+}
+
+vector<Address> Search::findAll(const Sheet &sheet, TrigramIndex *index) const
+{
+    vector<Address> found;
+
+    if (index != nullptr && m_IsLiteral && TrigramIndex::canFilter(m_Text)) {
+        for (const Address &addr : index->candidates(m_Text)) {
+            if (sheet.hasCell(addr) && matches(*sheet.getCell(addr))) {
+                found.push_back(addr);
+            }
+        }
+
+        return found;
+    }
+
+    mutex foundMutex;
+
+    sheet.scanCells([this, &found, &foundMutex](
+        const Address &addr,
+        const CellBase *cell,
+        const Value &literal) {
+        if (matches(cell, literal)) {
+            lock_guard<mutex> lock(foundMutex);
+            found.push_back(addr);
+        }
+    });
+
+    sort(found.begin(), found.end(), [](const Address &lhs, const Address &rhs) {
+        return lhs.row() != rhs.row() ? lhs.row() < rhs.row() : lhs.col() < rhs.col();
+    });
+
+    return found;
+}
+
+string Search::replace(const string &text, const string &replacement) const
+{
+    return regex_replace(text, m_Regex, replacement);
+}
+
+size_t Search::replaceAll(
+    Sheet &sheet,
+    const vector<Address> &cells,
+    const string &replacement,
+    size_t *failed) const
+{
+    vector<shared_ptr<CellBase>> replaced;
+    size_t failures = 0;
+
+    for (const Address &addr : cells) {
+        shared_ptr<const CellBase> cell = sheet.getCell(addr);
+        const string &source = cell->getContentSource();
+
+        if (!matches(source)) {
+            continue;
+        }
+
+        try {
+            replaced.push_back(
+                CellBase::fromType(sheet, cell->getType(), addr, replace(source, replacement)));
+        } catch (const Exception &) {
+            ++failures;
+        }
+    }
+
+    if (!replaced.empty()) {
+        sheet.setCells(replaced);
+    }
+
+    if (failed != nullptr) {
+        *failed = failures;
+    }
+
+    return replaced.size();
+}
@@ -0,0 +1,595 @@
+#include "Server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "exception/InvalidArgumentException.h"
+#include "exception/IOException.h"
+
+using namespace std;
+
+const int Server::TILE_SIZE;
+const size_t Server::MAX_REQUEST_LENGTH;
+
+Server::Server(shared_ptr<Sheet> sheet, const string &socketPath)
+    : m_Sheet(sheet), m_SocketPath(socketPath), m_Stopping(false)
+{
+}
+
+Server::~Server()
+{
+    stop();
+}
+
+uint64_t Server::tileKey(int col, int row)
+{
+    return ((uint64_t) ((col - 1) / TILE_SIZE) << 32) | (uint32_t) ((row - 1) / TILE_SIZE);
+}
+
+string Server::escape(const string &text)
+{
+    if (text.find_first_of("\\\n\t\r") == string::npos) {
+        return text;
+    }
+
+    string escaped;
+    escaped.reserve(text.length() + 8);
+
+    for (char c : text) {
+        switch (c) {
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            case '\t':
+                escaped += "\\t";
+                break;
+            case '\r':
+                escaped += "\\r";
+                break;
+            default:
+                escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+Server::CellValue Server::evaluate(const CellBase &cell)
+{
+    CellValue value;
+    value.type = cell.getType();
+
+    try {
+        value.text = escape(cell.getContentText());
+    } catch (...) {
+        value.text = "#ERROR";
+    }
+
+    return value;
+}
+
+shared_ptr<const Server::Snapshot> Server::buildSnapshot(uint64_t version) const
+{
+    unordered_map<uint64_t, shared_ptr<Tile>> tiles;
+
+    shared_ptr<const SheetSnapshot> cells = m_Sheet->snapshot();
+
+    for (const shared_ptr<const CellBase> &cell : cells->getCells()) {
+        const Address &addr = cell->getAddr();
+
+        shared_ptr<Tile> &tile = tiles[tileKey(addr.col(), addr.row())];
+        if (!tile) {
+            tile = make_shared<Tile>();
+        }
+
+        tile->emplace(addr, evaluate(*cell));
+    }
+
+    for (const SheetSnapshot::Literal &literal : cells->getLiterals()) {
+        shared_ptr<Tile> &tile = tiles[tileKey(literal.addr.col(), literal.addr.row())];
+        if (!tile) {
+            tile = make_shared<Tile>();
+        }
+
+        tile->emplace(literal.addr,
+                      CellValue{literal.getType(), escape(literal.getValue().toString())});
+    }
+
+    shared_ptr<Snapshot> snapshot = make_shared<Snapshot>();
+    snapshot->version = version;
+    snapshot->tiles.insert(tiles.begin(), tiles.end());
+
+    return snapshot;
+}
+
+shared_ptr<const Server::Snapshot> Server::updateSnapshot(const vector<Address> &changed) const
+{
+    shared_ptr<const Snapshot> current = atomic_load(&m_Snapshot);
+
+    shared_ptr<Snapshot> snapshot = make_shared<Snapshot>(*current);
+    ++snapshot->version;
+
+    /* tiles already copied for this version */
+    unordered_map<uint64_t, shared_ptr<Tile>> copied;
+
+    for (const Address &addr : changed) {
+        uint64_t key = tileKey(addr.col(), addr.row());
+
+        shared_ptr<Tile> &tile = copied[key];
+        if (!tile) {
+            auto it = snapshot->tiles.find(key);
+            tile = it != snapshot->tiles.end() ? make_shared<Tile>(*it->second) : make_shared<Tile>();
+        }
+
+        shared_ptr<const CellBase> cell = m_Sheet->getCell(addr);
+
+        if (cell->getContentSource().empty() && cell->getType() == Type<string>::name) {
+            tile->erase(addr);
+        } else {
+            (*tile)[addr] = evaluate(*cell);
+        }
+    }
+
+    for (auto &entry : copied) {
+        if (entry.second->empty()) {
+            snapshot->tiles.erase(entry.first);
+        } else {
+            snapshot->tiles[entry.first] = entry.second;
+        }
+    }
+
+    return snapshot;
+}
+
+void Server::writerLoop()
+{
+    while (true) {
+        vector<shared_ptr<Edit>> batch;
+
+        {
+            unique_lock<mutex> lock(m_QueueMutex);
+            m_QueueCond.wait(lock, [this] { return !m_Queue.empty() || m_Stopping; });
+
+            if (m_Queue.empty()) {
+                return;
+            }
+
+            batch.swap(m_Queue);
+        }
+
+        m_Changed.clear();
+
+        vector<string> responses;
+        responses.reserve(batch.size());
+
+        bool recalc = false;
+
+        for (const shared_ptr<Edit> &edit : batch) {
+            if (edit->kind == Edit::RECALC) {
+                recalc = true;
+            }
+
+            responses.push_back(apply(*edit));
+        }
+
+        shared_ptr<const Snapshot> snapshot;
+        if (recalc) {
+            m_Sheet->forEachCell([](const CellBase &cell) {
+                static_cast<const Cell &>(cell).invalidate();
+            });
+
+            snapshot = buildSnapshot(atomic_load(&m_Snapshot)->version + 1);
+        } else {
+            /* an address may be reported several times within a batch */
+            sort(m_Changed.begin(), m_Changed.end());
+            m_Changed.erase(unique(m_Changed.begin(), m_Changed.end()), m_Changed.end());
+
+            snapshot = updateSnapshot(m_Changed);
+        }
+
+        atomic_store(&m_Snapshot, snapshot);
+
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (batch[i]->kind == Edit::RECALC && responses[i] == "OK") {
+                responses[i] += " " + to_string(snapshot->version);
+            }
+
+            batch[i]->response.set_value(responses[i]);
+        }
+    }
+}
+
+string Server::apply(Edit &edit)
+{
+    try {
+        switch (edit.kind) {
+            case Edit::CONTENT:
+                m_Sheet->setCellContent(Address(edit.addr), edit.arg);
+                break;
+
+            case Edit::TYPE:
+                if (edit.arg == Type<int>::name) {
+                    m_Sheet->setCellType<int>(Address(edit.addr));
+                } else if (edit.arg == Type<double>::name) {
+                    m_Sheet->setCellType<double>(Address(edit.addr));
+                } else if (edit.arg == Type<string>::name) {
+                    m_Sheet->setCellType<string>(Address(edit.addr));
+                } else {
+                    return "ERR unknown type";
+                }
+                break;
+
+            case Edit::RECALC:
+                break;
+        }
+    } catch (const InvalidArgumentException &ex) {
+        return "ERR invalid address";
+    } catch (const IncorrectFormulaSyntaxException &ex) {
+        return "ERR incorrect formula syntax";
+    } catch (const InvalidTypeException &ex) {
+        return "ERR invalid type";
+    } catch (...) {
+        return "ERR failed";
+    }
+
+    return "OK";
+}
+
+string Server::submit(Edit::Kind kind, const string &addr, const string &arg)
+{
+    shared_ptr<Edit> edit = make_shared<Edit>();
+    edit->kind = kind;
+    edit->addr = addr;
+    edit->arg = arg;
+
+    future<string> response = edit->response.get_future();
+
+    {
+        lock_guard<mutex> lock(m_QueueMutex);
+        if (m_Stopping) {
+            return "ERR stopping";
+        }
+
+        m_Queue.push_back(edit);
+    }
+
+    m_QueueCond.notify_one();
+
+    return response.get();
+}
+
+string Server::handle(const string &line, bool &close)
+{
+    size_t cmdEnd = line.find(' ');
+    string cmd = Utils::toLower(line.substr(0, cmdEnd));
+    string rest = cmdEnd == string::npos ? "" : line.substr(cmdEnd + 1);
+
+    if (cmd == "get") {
+        Address addr(1, 1);
+        try {
+            addr = Address(Utils::trim(rest));
+        } catch (const InvalidArgumentException &ex) {
+            return "ERR invalid address\n";
+        }
+
+        shared_ptr<const Snapshot> snapshot = atomic_load(&m_Snapshot);
+
+        auto tileIt = snapshot->tiles.find(tileKey(addr.col(), addr.row()));
+        if (tileIt != snapshot->tiles.end()) {
+            auto it = tileIt->second->find(addr);
+            if (it != tileIt->second->end()) {
+                return "OK " + it->second.type + "\t" + it->second.text + "\n";
+            }
+        }
+
+        return "OK " + Type<string>::name + "\t\n";
+    }
+
+    if (cmd == "range") {
+        rest = Utils::trim(rest);
+        size_t sep = rest.find(' ');
+
+        Address from(1, 1), to(1, 1);
+        try {
+            if (sep == string::npos) {
+                throw InvalidArgumentException();
+            }
+
+            from = Address(rest.substr(0, sep));
+            to = Address(Utils::trim(rest.substr(sep + 1)));
+        } catch (const InvalidArgumentException &ex) {
+            return "ERR invalid address\n";
+        }
+
+        int minCol = min(from.col(), to.col()), maxCol = max(from.col(), to.col());
+        int minRow = min(from.row(), to.row()), maxRow = max(from.row(), to.row());
+
+        shared_ptr<const Snapshot> snapshot = atomic_load(&m_Snapshot);
+
+        vector<const pair<const Address, CellValue> *> cells;
+
+        auto collect = [&](const Tile &tile) {
+            for (const auto &entry : tile) {
+                const Address &addr = entry.first;
+                if (addr.col() >= minCol && addr.col() <= maxCol && addr.row() >= minRow &&
+                    addr.row() <= maxRow) {
+                    cells.push_back(&entry);
+                }
+            }
+        };
+
+        uint64_t minTileCol = (minCol - 1) / TILE_SIZE, maxTileCol = (maxCol - 1) / TILE_SIZE;
+        uint64_t minTileRow = (minRow - 1) / TILE_SIZE, maxTileRow = (maxRow - 1) / TILE_SIZE;
+
+        /* visit whichever is smaller - tiles covered by the range or all non-empty tiles */
+        if ((maxTileCol - minTileCol + 1) * (maxTileRow - minTileRow + 1) <= snapshot->tiles.size()) {
+            for (uint64_t col = minTileCol; col <= maxTileCol; ++col) {
+                for (uint64_t row = minTileRow; row <= maxTileRow; ++row) {
+                    auto it = snapshot->tiles.find((col << 32) | row);
+                    if (it != snapshot->tiles.end()) {
+                        collect(*it->second);
+                    }
+                }
+            }
+        } else {
+            for (const auto &entry : snapshot->tiles) {
+                uint64_t col = entry.first >> 32, row = entry.first & 0xffffffffu;
+                if (col >= minTileCol && col <= maxTileCol && row >= minTileRow &&
+                    row <= maxTileRow) {
+                    collect(*entry.second);
+                }
+            }
+        }
+
+        sort(cells.begin(), cells.end(), [](
+            const pair<const Address, CellValue> *a,
+            const pair<const Address, CellValue> *b) {
+            return a->first.row() < b->first.row() ||
+                (a->first.row() == b->first.row() && a->first.col() < b->first.col());
+        });
+
+        string response = "OK " + to_string(cells.size()) + "\n";
+        for (const pair<const Address, CellValue> *cell : cells) {
+            response += (string) cell->first + "\t" + cell->second.type + "\t" +
+                cell->second.text + "\n";
+        }
+
+        return response;
+    }
+
+    if (cmd == "set") {
+        size_t sep = rest.find(' ');
+        string addr = rest.substr(0, sep);
+        string content = sep == string::npos ? "" : rest.substr(sep + 1);
+
+        return submit(Edit::CONTENT, addr, content) + "\n";
+    }
+
+    if (cmd == "type") {
+        rest = Utils::trim(rest);
+        size_t sep = rest.find(' ');
+        if (sep == string::npos) {
+            return "ERR missing type\n";
+        }
+
+        return submit(Edit::TYPE, rest.substr(0, sep), Utils::trim(rest.substr(sep + 1))) + "\n";
+    }
+
+    if (cmd == "recalc") {
+        return submit(Edit::RECALC, "", "") + "\n";
+    }
+
+    if (cmd == "quit") {
+        close = true;
+        return "OK\n";
+    }
+
+    return "ERR unknown command\n";
+}
+
+void Server::serveClient(int fd)
+{
+    string buffer;
+    char chunk[4096];
+    bool close = false;
+
+    while (!close) {
+        ssize_t length = recv(fd, chunk, sizeof(chunk), 0);
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            break;
+        }
+
+        buffer.append(chunk, length);
+
+        /* answer all complete requests in one write */
+        string responses;
+        size_t pos = 0;
+
+        for (size_t end; !close && (end = buffer.find('\n', pos)) != string::npos; pos = end + 1) {
+            responses += handle(Utils::trimRight(buffer.substr(pos, end - pos), "\r"), close);
+        }
+
+        buffer.erase(0, pos);
+
+        /* a request that never ends would take all memory */
+        if (!close && buffer.length() > MAX_REQUEST_LENGTH) {
+            responses += "ERR request too long\n";
+            close = true;
+        }
+
+        for (size_t sent = 0; sent < responses.length();) {
+            ssize_t written = send(fd, responses.data() + sent, responses.length() - sent,
+                MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                close = true;
+                break;
+            }
+
+            sent += written;
+        }
+    }
+
+    lock_guard<mutex> lock(m_ClientsMutex);
+
+    /* stop() closes the descriptors of connections still open */
+    auto it = find(m_ClientFds.begin(), m_ClientFds.end(), fd);
+    if (it != m_ClientFds.end()) {
+        m_ClientFds.erase(it);
+        ::close(fd);
+    }
+
+    m_Finished.push_back(this_thread::get_id());
+}
+
+void Server::reapClients()
+{
+    for (thread::id id : m_Finished) {
+        auto it = find_if(m_Clients.begin(), m_Clients.end(), [id](const thread &client) {
+            return client.get_id() == id;
+        });
+
+        /* the thread is past its last use of the lock, so it ends right away */
+        if (it != m_Clients.end()) {
+            it->join();
+            m_Clients.erase(it);
+        }
+    }
+
+    m_Finished.clear();
+}
+
+void Server::listen()
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (m_SocketPath.length() >= sizeof(addr.sun_path)) {
+        throw IOException();
+    }
+
+    strncpy(addr.sun_path, m_SocketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    m_ListenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_ListenFd < 0) {
+        throw IOException();
+    }
+
+    unlink(m_SocketPath.c_str());
+
+    if (bind(m_ListenFd, (sockaddr *) &addr, sizeof(addr)) < 0 || ::listen(m_ListenFd, 128) < 0) {
+        ::close(m_ListenFd);
+        m_ListenFd = -1;
+        throw IOException();
+    }
+
+    atomic_store(&m_Snapshot, buildSnapshot(0));
+
+    /* cells whose value may have changed, including dependents */
+    m_Subscription = m_Sheet->subscribe(
+        Address(1, 1),
+        Address(Address::MAX_COL, Address::MAX_ROW),
+        [this](const vector<Address> &changed) {
+            m_Changed.insert(m_Changed.end(), changed.begin(), changed.end());
+        });
+
+    m_Writer = thread(&Server::writerLoop, this);
+}
+
+void Server::run()
+{
+    while (!m_Stopping) {
+        int fd = accept(m_ListenFd, nullptr, nullptr);
+
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+
+            break;
+        }
+
+        lock_guard<mutex> lock(m_ClientsMutex);
+
+        if (m_Stopping) {
+            ::close(fd);
+            break;
+        }
+
+        reapClients();
+
+        m_ClientFds.push_back(fd);
+        m_Clients.emplace_back(&Server::serveClient, this, fd);
+    }
+}
+
+void Server::stop()
+{
+    {
+        lock_guard<mutex> lock(m_QueueMutex);
+        if (m_Stopping && m_ListenFd < 0) {
+            return;
+        }
+
+        m_Stopping = true;
+    }
+
+    m_QueueCond.notify_all();
+
+    vector<thread> clients;
+
+    {
+        lock_guard<mutex> lock(m_ClientsMutex);
+
+        /* wakes up accept() */
+        if (m_ListenFd >= 0) {
+            shutdown(m_ListenFd, SHUT_RDWR);
+        }
+
+        /* wakes up recv() */
+        for (int fd : m_ClientFds) {
+            shutdown(fd, SHUT_RDWR);
+        }
+
+        clients.swap(m_Clients);
+        m_Finished.clear();
+    }
+
+    for (thread &client : clients) {
+        client.join();
+    }
+
+    if (m_Writer.joinable()) {
+        m_Writer.join();
+
+        m_Sheet->unsubscribe(m_Subscription);
+    }
+
+    lock_guard<mutex> lock(m_ClientsMutex);
+
+    for (int fd : m_ClientFds) {
+        ::close(fd);
+    }
+    m_ClientFds.clear();
+
+    if (m_ListenFd >= 0) {
+        ::close(m_ListenFd);
+        m_ListenFd = -1;
+        unlink(m_SocketPath.c_str());
+    }
+}
@@ -1,111 +1,419 @@
 #include "Sheet.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
 
 using namespace std;
 
-size_t hash<Address>::operator()(const Address &addr) const
+const uint32_t Sheet::CellHandle::NONE;
+
+Sheet::Sheet()
+    : m_Pool(make_shared<Pool>()),
+      m_Sources(make_shared<StringPool>(m_Pool)),
+      m_Cells(*this)
 {
-    return hash<string>()(addr);
 }
 
-void Sheet::createDependencies(shared_ptr<const CellBase> cell)
+Sheet::Sheet(const string &tileFilename, size_t memoryBudget, const atomic<bool> *cancelled)
+    : m_Pool(make_shared<Pool>()),
+      m_Sources(make_shared<StringPool>(m_Pool)),
+      m_Cells(*this)
 {
-    for (const Address &depAddr : cell->getDependencies()) {
-        m_Dependencies[depAddr].insert(cell);
+    m_Cells.open(tileFilename, memoryBudget);
+
+    createAllDependencies(cancelled);
+}
+
+Sheet::~Sheet()
+{
+    m_Sources->close();
+    m_Pool->close();
+}
+
+void Sheet::createDependencies(const CellBase &cell)
+{
+    m_Dependencies.setPrecedents(cell.getAddr(), cell.getDependencies());
+}
+
+void Sheet::createAllDependencies(const atomic<bool> *cancelled)
+{
+    vector<pair<Address, Address>> pairs;
+
+    m_Cells.forEach([&pairs, cancelled](const shared_ptr<CellBase> &cell) {
+        if (cancelled && cancelled->load(memory_order_relaxed)) {
+            throw CancelledException();
+        }
+
+        for (const Address &depAddr : cell->getDependencies()) {
+            pairs.emplace_back(depAddr, cell->getAddr());
+        }
+    });
+
+    m_Dependencies.addAll(pairs);
+}
+
+void Sheet::deleteDependencies(const Address &addr)
+{
+    m_Dependencies.setPrecedents(addr, AddressList());
+}
+
+void Sheet::distributeContentChangedEvent(shared_ptr<const CellBase> cell)
+{
+    distributeContentChangedEvent(vector<shared_ptr<const CellBase>>(1, cell));
+}
+
+void Sheet::distributeContentChangedEvent(const vector<shared_ptr<const CellBase>> &cells)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    vector<DependencyGraph::Id> dependents = collectDependents(cells);
+
+    /* drop all cached values before any listener can evaluate the dependents; cells in
+     * unloaded tiles have none */
+    for (DependencyGraph::Id id : dependents) {
+        shared_ptr<CellBase> dependent = m_Cells.findLoaded(m_Dependencies.getAddress(id));
+
+        if (dependent) {
+            static_cast<const Cell &>(*dependent).invalidate();
+        }
+    }
+
+    if (!dependents.empty()) {
+        SheetCounters::increment(m_Counters.recalcs);
+        m_Counters.lastInvalidationMicros = (long) chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now() - start).count();
+    }
+
+    if (m_CellContentChanged) {
+        for (const shared_ptr<const CellBase> &cell : cells) {
+            m_CellContentChanged(*cell);
+        }
+
+        for (DependencyGraph::Id id : dependents) {
+            m_CellContentChanged(*getCell(m_Dependencies.getAddress(id)));
+        }
+    }
+
+    if (m_Subscriptions.empty()) {
+        return;
+    }
+
+    /* only addresses are compared, the cells are left for the listeners to look up */
+    vector<vector<Address>> batches(m_Subscriptions.size());
+
+    auto offer = [this, &batches](const Address &addr) {
+        for (size_t i = 0; i < m_Subscriptions.size(); ++i) {
+            const Subscription &subscription = m_Subscriptions[i];
+
+            if (addr.col() >= subscription.begin.col() && addr.row() >= subscription.begin.row() &&
+                addr.col() <= subscription.end.col() && addr.row() <= subscription.end.row()) {
+                batches[i].push_back(addr);
+            }
+        }
+    };
+
+    for (const shared_ptr<const CellBase> &cell : cells) {
+        offer(cell->getAddr());
+    }
+
+    for (DependencyGraph::Id id : dependents) {
+        offer(m_Dependencies.getAddress(id));
+    }
+
+    for (size_t i = 0; i < m_Subscriptions.size(); ++i) {
+        if (!batches[i].empty()) {
+            m_Subscriptions[i].listener(batches[i]);
+        }
     }
 }
 
-void Sheet::deleteDependencies(shared_ptr<const CellBase> cell)
+vector<DependencyGraph::Id> Sheet::collectDependents(
+    const vector<shared_ptr<const CellBase>> &cells)
 {
-    for (const Address &depAddr : cell->getDependencies()) {
-        unordered_set<shared_ptr<const CellBase>> &deps = m_Dependencies[depAddr];
-        unordered_set<shared_ptr<const CellBase>>::iterator it = deps.find(cell);
-        if (it != deps.end()) {
-            deps.erase(it);
+    /* a dependent being visited and its dependents not visited yet */
+    struct Frame
+    {
+        DependencyGraph::Id id;
+        const DependencyGraph::Id *next;
+        const DependencyGraph::Id *end;
+    };
+
+    vector<DependencyGraph::Id> dependents;
+    vector<Frame> stack;
+
+    if (m_VisitMarks.size() < m_Dependencies.getIdCount()) {
+        m_VisitMarks.resize(m_Dependencies.getIdCount(), 0);
+    }
+
+    /* a new mark instead of clearing the old ones */
+    if (++m_VisitEpoch == 0) {
+        fill(m_VisitMarks.begin(), m_VisitMarks.end(), 0);
+        m_VisitEpoch = 1;
+    }
+
+    for (const shared_ptr<const CellBase> &cell : cells) {
+        DependencyGraph::Id id;
+
+        if (m_Dependencies.findId(cell->getAddr(), id)) {
+            m_VisitMarks[id] = m_VisitEpoch;
         }
     }
+
+    for (const shared_ptr<const CellBase> &cell : cells) {
+        DependencyGraph::Id id;
+
+        if (!m_Dependencies.findId(cell->getAddr(), id)) {
+            continue;
+        }
+
+        pair<const DependencyGraph::Id *, const DependencyGraph::Id *> range =
+            m_Dependencies.getDependents(id);
+        stack.push_back({id, range.first, range.second});
+
+        while (!stack.empty()) {
+            Frame &frame = stack.back();
+
+            if (frame.next == frame.end) {
+                /* the changed cells themselves are not dependents */
+                if (stack.size() > 1) {
+                    dependents.push_back(frame.id);
+                }
+
+                stack.pop_back();
+                continue;
+            }
+
+            DependencyGraph::Id dependent = *frame.next++;
+
+            if (m_VisitMarks[dependent] == m_VisitEpoch) {
+                continue;
+            }
+
+            m_VisitMarks[dependent] = m_VisitEpoch;
+
+            /* the frame reference is invalidated by pushing */
+            range = m_Dependencies.getDependents(dependent);
+            stack.push_back({dependent, range.first, range.second});
+        }
+    }
+
+    /* finished in post-order, reversed it is topological */
+    reverse(dependents.begin(), dependents.end());
+
+    return dependents;
 }
 
-void Sheet::distributeContentChangedEvent(
-    shared_ptr<const CellBase> cell,
-    unordered_set<shared_ptr<const CellBase>> processedCells)
+void Sheet::storeCell(shared_ptr<CellBase> cell)
 {
-    if (!m_CellContentChanged || processedCells.find(cell) != processedCells.end()) {
-        return;
+    DependencyGraph::Id id;
+    if (m_Dependencies.findId(cell->getAddr(), id) && id < m_Generations.size()) {
+        ++m_Generations[id];
     }
 
-    m_CellContentChanged(*cell);
+    m_Cells.put(cell);
+}
 
-    unordered_map<Address, unordered_set<shared_ptr<const CellBase>>>::const_iterator it
-        = m_Dependencies.find(cell->getAddr());
+void Sheet::eraseCell(const Address &addr)
+{
+    DependencyGraph::Id id;
+    if (m_Dependencies.findId(addr, id) && id < m_Generations.size()) {
+        ++m_Generations[id];
+    }
+
+    m_Cells.erase(addr);
+}
+
+void Sheet::recordEdit(const CellBase &cell)
+{
+    if (m_Journal) {
+        m_Journal->record(cell.getType(), cell.getAddr(), cell.getContentSource());
+    }
+}
+
+void Sheet::putCell(shared_ptr<CellBase> cell, vector<pair<Address, Address>> *newDependencies)
+{
+    shared_ptr<CellBase> existing = m_Cells.find(cell->getAddr());
+
+    if (existing) {
+        deleteDependencies(existing->getAddr());
+    }
+
+    /* delete empty string cell */
+    if (cell->getContentSource().empty() && cell->getTag() == TypeTag::STRING) {
+        if (existing) {
+            eraseCell(cell->getAddr());
+        }
 
-    /* no dependents */
-    if (it == m_Dependencies.end()) {
         return;
     }
 
-    unordered_set<shared_ptr<const CellBase>> newProcessedCells;
-    newProcessedCells.insert(processedCells.begin(), processedCells.end());
-    newProcessedCells.insert(cell);
+    storeCell(cell);
+
+    if (newDependencies == nullptr) {
+        createDependencies(*cell);
+        return;
+    }
 
-    for (shared_ptr<const CellBase> dependent : it->second) {
-        distributeContentChangedEvent(dependent, newProcessedCells);
+    for (const Address &depAddr : cell->getDependencies()) {
+        newDependencies->emplace_back(depAddr, cell->getAddr());
     }
 }
 
+const shared_ptr<Pool> &Sheet::getPool() const
+{
+    return m_Pool;
+}
+
+const shared_ptr<StringPool> &Sheet::getSources() const
+{
+    return m_Sources;
+}
+
 void Sheet::attachCellContentChangedEvent(
     const function<void(const CellBase &)> &cellContentChanged)
 {
     m_CellContentChanged = cellContentChanged;
 }
 
+uint32_t Sheet::subscribe(
+    const Address &begin,
+    const Address &end,
+    const function<void(const vector<Address> &)> &listener)
+{
+    m_Subscriptions.push_back({++m_LastSubscriptionId, begin, end, listener});
+
+    return m_LastSubscriptionId;
+}
+
+void Sheet::setSubscriptionRange(uint32_t id, const Address &begin, const Address &end)
+{
+    for (Subscription &subscription : m_Subscriptions) {
+        if (subscription.id == id) {
+            subscription.begin = begin;
+            subscription.end = end;
+        }
+    }
+}
+
+void Sheet::unsubscribe(uint32_t id)
+{
+    m_Subscriptions.erase(
+        remove_if(
+            m_Subscriptions.begin(),
+            m_Subscriptions.end(),
+            [id](const Subscription &subscription) { return subscription.id == id; }),
+        m_Subscriptions.end());
+}
+
+void Sheet::attachJournal(shared_ptr<Journal> journal)
+{
+    m_Journal = journal;
+}
+
+shared_ptr<Journal> Sheet::getJournal() const
+{
+    return m_Journal;
+}
+
 shared_ptr<const CellBase> Sheet::getCell(const Address &addr) const
 {
-    unordered_map<Address, shared_ptr<CellBase>>::const_iterator it = m_Cells.find(addr);
+    shared_ptr<const CellBase> cell = m_Cells.find(addr);
 
     /* cell doesn't exist */
-    if (it == m_Cells.end()) {
-        return make_shared<const Cell<string>>(*this, addr, "");
+    if (!cell) {
+        return Cell::make(*this, addr, TypeTag::STRING, "");
     }
 
-    return it->second;
+    return cell;
 }
 
-void Sheet::setCellContent(const Address &addr, const string &text)
+bool Sheet::hasCell(const Address &addr) const
 {
-    unordered_map<Address, shared_ptr<CellBase>>::iterator it = m_Cells.find(addr);
+    return m_Cells.contains(addr);
+}
 
-    shared_ptr<CellBase> cell;
+bool Sheet::findCell(
+    const Address &from,
+    int colStep,
+    int rowStep,
+    bool nonEmpty,
+    Address &found) const
+{
+    return m_Cells.findCell(from, colStep, rowStep, nonEmpty, found);
+}
+
+bool Sheet::getUsedRange(Address &begin, Address &end) const
+{
+    return m_Cells.getUsedRange(begin, end);
+}
+
+shared_ptr<const CellBase> Sheet::getFormulaCell(const Address &addr) const
+{
+    Value literal;
+    shared_ptr<const CellBase> cell = m_Cells.findObject(addr, literal);
+
+    if (cell && static_cast<const Cell &>(*cell).isFormula()) {
+        return cell;
+    }
+
+    return nullptr;
+}
+
+shared_ptr<const CellBase> Sheet::resolveCell(const Address &addr, CellHandle &handle) const
+{
+    shared_ptr<const CellBase> cell = m_Cells.findObject(addr, handle.value);
+
+    DependencyGraph::Id id;
+    if (m_Cells.isOutOfCore() || !m_Dependencies.findId(addr, id)) {
+        handle.slot = CellHandle::NONE;
+    } else {
+        if (id >= m_Generations.size()) {
+            m_Generations.resize(id + 1);
+        }
+
+        handle.slot = id;
+        handle.generation = m_Generations[id];
+    }
+
+    handle.cell = cell.get();
+
+    return cell;
+}
+
+void Sheet::setCellContent(const Address &addr, const string &text)
+{
+    shared_ptr<CellBase> cell = m_Cells.find(addr);
 
     /* cell doesn't exist yet */
-    if (it == m_Cells.end()) {
+    if (!cell) {
         if (text.empty()) {
             return;
         }
 
-        cell = make_shared<Cell<string>>(*this, addr, text);
-        m_Cells[addr] = cell;
+        cell = Cell::make(*this, addr, TypeTag::STRING, text);
+        storeCell(cell);
 
-        createDependencies(cell);
+        createDependencies(*cell);
+        recordEdit(*cell);
 
         distributeContentChangedEvent(cell);
     } else {
-        cell = it->second;
-
-        deleteDependencies(cell);
+        deleteDependencies(cell->getAddr());
 
         cell = cell->create(text);
 
         /* delete empty string cell */
         if (cell->getContentSource().empty() &&
-            dynamic_cast<Cell<string> *>(cell.get()) != nullptr) {
-            m_Cells.erase(it);
+            cell->getTag() == TypeTag::STRING) {
+            eraseCell(addr);
         } else {
-            m_Cells[addr] = cell;
-            createDependencies(cell);
+            storeCell(cell);
+            createDependencies(*cell);
         }
 
+        recordEdit(*cell);
+
         /* if the cell is of string type, it is now removed from m_Cells, but "cell" still holds
          * the last reference, so we can use it to trigger the content-changed event */
         distributeContentChangedEvent(cell);
@@ -121,26 +429,154 @@ void Sheet::setCellContent(const Address &addr, const string &text)
      */
 }
 
+void Sheet::setCellType(const Address &addr, TypeTag type)
+{
+    shared_ptr<CellBase> existing = m_Cells.find(addr);
+
+    shared_ptr<CellBase> cell;
+
+    /* cell doesn't exist yet */
+    if (!existing) {
+        /* don't create empty string cell */
+        if (type == TypeTag::STRING) {
+            return;
+        }
+
+        cell = Cell::make(*this, addr, type);
+        storeCell(cell);
+        recordEdit(*cell);
+    } else if (type == TypeTag::STRING && existing->getContentSource().empty()) {
+        cell = existing;
+        deleteDependencies(cell->getAddr());
+        eraseCell(addr);
+
+        if (m_Journal) {
+            m_Journal->record(Type<string>::name, addr, "");
+        }
+    } else {
+        // todo: don't recreate cell if the type doesn't change
+
+        cell = Cell::make(*this, addr, type, existing->getContentSource());
+
+        deleteDependencies(existing->getAddr());
+        storeCell(cell);
+        createDependencies(*cell);
+        recordEdit(*cell);
+    }
+
+    /* if the type is string and cell's content is empty, it is now removed from m_Cells, but
+     * "cell" still holds the last reference, so we can use it to trigger the content-changed
+     * event */
+    distributeContentChangedEvent(cell);
+}
+
+shared_ptr<const SheetSnapshot> Sheet::snapshot() const
+{
+    vector<shared_ptr<const CellBase>> cells;
+    vector<SheetSnapshot::Literal> literals;
+    literals.reserve(m_Cells.size());
+
+    /* number literals stay records, no objects are created for them */
+    m_Cells.forEach(
+        [&cells](const shared_ptr<CellBase> &cell) {
+            cells.push_back(cell);
+        },
+        [&literals](const Address &addr, const Value &value) {
+            bool isInt = value.getKind() == Value::Kind::INT;
+            literals.push_back({addr, isInt ? value.getInt() : value.getDouble(), isInt});
+        });
+
+    return make_shared<const SheetSnapshot>(move(cells), move(literals));
+}
+
+void Sheet::forEachCell(const function<void(const CellBase &)> &fn) const
+{
+    m_Cells.forEach([&fn](const shared_ptr<CellBase> &cell) {
+        fn(*cell);
+    });
+}
+
+Stats Sheet::getStats() const
+{
+    Stats stats;
+
+    stats.cells = m_Cells.size();
+    stats.formulaNodes = m_Pool->getNodeCount();
+    stats.dependencyEdges = m_Dependencies.size();
+    stats.internedStrings = m_Sources->size();
+
+    stats.poolBytes = m_Pool->getChunkBytes();
+    stats.literalBytes = m_Cells.getLiteralBytes();
+    stats.dependencyBytes = m_Dependencies.getBytes();
+    stats.loadedTileBytes = m_Cells.isOutOfCore() ? m_Cells.getLoadedBytes() : 0;
+
+    stats.evaluations = m_Counters.evaluations;
+    stats.valueHits = m_Counters.valueHits;
+    stats.valueMisses = m_Counters.valueMisses;
+    stats.linkHits = m_Counters.linkHits;
+    stats.linkMisses = m_Counters.linkMisses;
+    stats.recalcs = m_Counters.recalcs;
+    stats.lastInvalidationMicros = m_Counters.lastInvalidationMicros;
+
+    return stats;
+}
+
+void Sheet::scanCells(
+    const function<void(const Address &, const CellBase *, const Value &)> &fn,
+    unsigned threads) const
+{
+    m_Cells.scan(fn, threads);
+}
+
+bool Sheet::isOutOfCore() const
+{
+    return m_Cells.isOutOfCore();
+}
+
+void Sheet::saveTiles()
+{
+    m_Cells.save();
+}
+
+void Sheet::setCells(const vector<shared_ptr<CellBase>> &cells)
+{
+    vector<pair<Address, Address>> newDependencies;
+
+    for (const shared_ptr<CellBase> &cell : cells) {
+        putCell(cell, &newDependencies);
+        recordEdit(*cell);
+    }
+
+    m_Dependencies.addAll(newDependencies);
+
+    distributeContentChangedEvent(vector<shared_ptr<const CellBase>>(cells.begin(), cells.end()));
+}
+
 void Sheet::serialize(ostream &os) const
 {
-    os << "[";
+    /* cell by cell rather than from a snapshot, so that out-of-core sheets stay within budget */
+    bool first = true;
 
-    for (unordered_map<Address, shared_ptr<CellBase>>::const_iterator it = m_Cells.begin();
-        it != m_Cells.end();
-        ++it) {
-        it->second->serialize(os);
+    os << "[";
 
-        if (next(it) != m_Cells.end()) {
+    forEachCell([&os, &first](const CellBase &cell) {
+        if (!first) {
             os << ",";
         }
-    }
+
+        cell.serialize(os);
+        first = false;
+    });
 
     os << "]";
 
     os.flush();
 }
 
-shared_ptr<Sheet> Sheet::deserialize(istream &is)
+shared_ptr<Sheet> Sheet::deserialize(
+    istream &is,
+    const function<void(const CellBase &)> &loaded,
+    const atomic<bool> *cancelled)
 {
     shared_ptr<Sheet> sheet = make_shared<Sheet>();
     char c;
@@ -156,9 +592,16 @@ shared_ptr<Sheet> Sheet::deserialize(istream &is)
     }
 
     do {
+        if (cancelled && cancelled->load(memory_order_relaxed)) {
+            throw CancelledException();
+        }
+
         shared_ptr<CellBase> cell = CellBase::deserialize(is, *sheet);
-        sheet->m_Cells[cell->getAddr()] = cell;
-        sheet->createDependencies(cell);
+        sheet->m_Cells.put(cell);
+
+        if (loaded) {
+            loaded(*cell);
+        }
 
         is >> skipws;
         is >> c;
@@ -167,5 +610,7 @@ shared_ptr<Sheet> Sheet::deserialize(istream &is)
 
     Utils::assertInput(is, ']');
 
+    sheet->createAllDependencies(cancelled);
+
     return sheet;
 }
@@ -0,0 +1,99 @@
+#include "SheetSnapshot.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "Utils.h"
+
+using namespace std;
+
+Value SheetSnapshot::Literal::getValue() const
+{
+    return isInt ? Value((int) number) : Value(number);
+}
+
+const string &SheetSnapshot::Literal::getType() const
+{
+    return typeName(isInt ? TypeTag::INT : TypeTag::DOUBLE);
+}
+
+SheetSnapshot::SheetSnapshot(vector<shared_ptr<const CellBase>> cells, vector<Literal> literals)
+    : m_Cells(move(cells)), m_Literals(move(literals))
+{}
+
+const vector<shared_ptr<const CellBase>> &SheetSnapshot::getCells() const
+{
+    return m_Cells;
+}
+
+const vector<SheetSnapshot::Literal> &SheetSnapshot::getLiterals() const
+{
+    return m_Literals;
+}
+
+void SheetSnapshot::forEachRowMajor(
+    const function<void(const CellBase *, const Literal *)> &fn) const
+{
+    /* sort by a packed (row, col) key, literals marked by the highest bit of the index */
+    const size_t LITERAL = (size_t) 1 << (sizeof(size_t) * 8 - 1);
+
+    vector<pair<uint64_t, size_t>> keyed;
+    keyed.reserve(size());
+
+    for (size_t i = 0; i < m_Cells.size(); ++i) {
+        Address addr = m_Cells[i]->getAddr();
+        keyed.emplace_back(((uint64_t) addr.row() << 32) | (uint32_t) addr.col(), i);
+    }
+
+    for (size_t i = 0; i < m_Literals.size(); ++i) {
+        const Address &addr = m_Literals[i].addr;
+        keyed.emplace_back(((uint64_t) addr.row() << 32) | (uint32_t) addr.col(), i | LITERAL);
+    }
+
+    sort(keyed.begin(), keyed.end());
+
+    for (const pair<uint64_t, size_t> &entry : keyed) {
+        if (entry.second & LITERAL) {
+            fn(nullptr, &m_Literals[entry.second & ~LITERAL]);
+        } else {
+            fn(m_Cells[entry.second].get(), nullptr);
+        }
+    }
+}
+
+size_t SheetSnapshot::size() const
+{
+    return m_Cells.size() + m_Literals.size();
+}
+
+void SheetSnapshot::serialize(ostream &os) const
+{
+    os << "[";
+
+    for (size_t i = 0; i < m_Cells.size(); ++i) {
+        if (i > 0) {
+            os << ",";
+        }
+
+        m_Cells[i]->serialize(os);
+    }
+
+    /* the same object Cell::serialize() writes for the cell */
+    for (size_t i = 0; i < m_Literals.size(); ++i) {
+        const Literal &literal = m_Literals[i];
+
+        if (i > 0 || !m_Cells.empty()) {
+            os << ",";
+        }
+
+        os << "{\"type\":\"" << Utils::escapeString(literal.getType()) << "\",\"addr\":";
+        literal.addr.serialize(os);
+        os << ",\"content\":\"";
+        Utils::writeEscaped(os, literal.getValue().toString(false));
+        os << "\"}";
+    }
+
+    os << "]";
+
+    os.flush();
+}
@@ -0,0 +1,46 @@
+#include "Stats.h"
+
+using namespace std;
+
+SheetCounters::SheetCounters()
+    : evaluations(0),
+      valueHits(0),
+      valueMisses(0),
+      linkHits(0),
+      linkMisses(0),
+      recalcs(0),
+      lastInvalidationMicros(-1)
+{
+}
+
+static void writeDuration(ostream &os, long micros)
+{
+    if (micros < 0) {
+        os << "null";
+    } else {
+        os << micros;
+    }
+}
+
+void Stats::serialize(ostream &os) const
+{
+    os << "{\"cells\":" << cells
+       << ",\"formulaNodes\":" << formulaNodes
+       << ",\"dependencyEdges\":" << dependencyEdges
+       << ",\"internedStrings\":" << internedStrings
+       << ",\"bytes\":{\"pool\":" << poolBytes
+       << ",\"literals\":" << literalBytes
+       << ",\"dependencies\":" << dependencyBytes
+       << ",\"loadedTiles\":" << loadedTileBytes
+       << "},\"evaluations\":" << evaluations
+       << ",\"valueCache\":{\"hits\":" << valueHits << ",\"misses\":" << valueMisses
+       << "},\"linkCache\":{\"hits\":" << linkHits << ",\"misses\":" << linkMisses
+       << "},\"recalcs\":" << recalcs
+       << ",\"lastInvalidationMicros\":";
+    writeDuration(os, lastInvalidationMicros);
+    os << ",\"lastEvaluationMicros\":";
+    writeDuration(os, lastEvaluationMicros);
+    os << ",\"lastRepaintMicros\":";
+    writeDuration(os, lastRepaintMicros);
+    os << "}";
+}
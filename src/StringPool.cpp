@@ -0,0 +1,76 @@
+#include "StringPool.h"
+
+using namespace std;
+
+StringPool::Entry::Entry(shared_ptr<StringPool> pool, string &&str)
+    : pool(move(pool)),
+      str(move(str))
+{
+}
+
+StringPool::Entry::~Entry()
+{
+    pool->release(&str);
+}
+
+StringPool::StringPool(shared_ptr<Pool> pool)
+    : m_Pool(pool),
+      m_Closed(false),
+      m_Strings(0, Hash(), Equal(), StringMap::allocator_type(pool))
+{
+}
+
+void StringPool::release(const string *str)
+{
+    if (m_Closed.load(memory_order_relaxed)) {
+        return;
+    }
+
+    lock_guard<mutex> lock(m_Mutex);
+
+    /* an equal string may have been interned since the last reference was released */
+    StringMap::iterator it = m_Strings.find(str);
+
+    if (it != m_Strings.end() && it->first == str) {
+        m_Strings.erase(it);
+    }
+}
+
+shared_ptr<const string> StringPool::intern(string str)
+{
+    lock_guard<mutex> lock(m_Mutex);
+
+    StringMap::iterator it = m_Strings.find(&str);
+
+    if (it != m_Strings.end()) {
+        shared_ptr<const string> interned = it->second.lock();
+        if (interned) {
+            return interned;
+        }
+
+        /* being released, release() leaves the new string alone */
+        m_Strings.erase(it);
+    }
+
+    shared_ptr<Entry> entry =
+        allocate_shared<Entry>(PoolAllocator<Entry>(m_Pool), shared_from_this(), move(str));
+
+    /* points to the string, shares the entry's reference counts */
+    shared_ptr<const string> interned(entry, &entry->str);
+
+    m_Strings.emplace(interned.get(), interned);
+
+    return interned;
+}
+
+void StringPool::close()
+{
+    m_Closed = true;
+}
+
+size_t StringPool::size()
+{
+    lock_guard<mutex> lock(m_Mutex);
+
+    return m_Strings.size();
+}
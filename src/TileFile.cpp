@@ -0,0 +1,239 @@
+#include "TileFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "exception/InvalidInputException.h"
+#include "exception/IOException.h"
+
+using namespace std;
+
+const char TileFile::MAGIC[8] = {'S', 'S', 'T', 'I', 'L', 'E', 'S', '1'};
+
+const uint64_t TileFile::HEADER_SIZE;
+
+TileFile::TileFile(const string &filename)
+{
+    m_Fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_Fd < 0) {
+        throw IOException();
+    }
+
+    struct stat st;
+    if (fstat(m_Fd, &st) < 0) {
+        close(m_Fd);
+        throw IOException();
+    }
+
+    try {
+        if (st.st_size == 0) {
+            writeAt(0, MAGIC, sizeof(MAGIC));
+            saveIndex();
+            return;
+        }
+
+        char magic[sizeof(MAGIC)];
+        uint64_t indexOffset, count;
+
+        readAt(0, magic, sizeof(magic));
+        readAt(sizeof(MAGIC), &indexOffset, sizeof(indexOffset));
+
+        if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || indexOffset < HEADER_SIZE ||
+            indexOffset > (uint64_t) st.st_size) {
+            throw InvalidInputException();
+        }
+
+        readAt(indexOffset, &count, sizeof(count));
+
+        if (count > ((uint64_t) st.st_size - indexOffset) / (4 * sizeof(uint64_t))) {
+            throw InvalidInputException();
+        }
+
+        vector<uint64_t> entries(count * 4);
+        readAt(indexOffset + sizeof(count), entries.data(), entries.size() * sizeof(uint64_t));
+
+        m_SavedIndexExtent = {indexOffset, sizeof(count) + entries.size() * sizeof(uint64_t), 0};
+
+        /* used space, to find the holes */
+        vector<pair<uint64_t, uint64_t>> used;
+        used.emplace_back(m_SavedIndexExtent.offset, m_SavedIndexExtent.length);
+
+        for (uint64_t i = 0; i < count; ++i) {
+            Extent extent = {entries[i * 4 + 1], entries[i * 4 + 2], entries[i * 4 + 3]};
+
+            if (extent.offset < HEADER_SIZE ||
+                extent.offset + extent.length > (uint64_t) st.st_size) {
+                throw InvalidInputException();
+            }
+
+            m_Index[entries[i * 4]] = extent;
+            used.emplace_back(extent.offset, extent.length);
+        }
+
+        m_SavedIndex = m_Index;
+
+        sort(used.begin(), used.end());
+
+        m_End = HEADER_SIZE;
+        for (const pair<uint64_t, uint64_t> &extent : used) {
+            if (extent.first > m_End) {
+                m_Free.emplace_back(m_End, extent.first - m_End);
+            }
+
+            m_End = max(m_End, extent.first + extent.second);
+        }
+    } catch (...) {
+        close(m_Fd);
+        throw;
+    }
+}
+
+TileFile::~TileFile()
+{
+    close(m_Fd);
+}
+
+void TileFile::writeAt(uint64_t offset, const void *data, size_t length)
+{
+    const char *bytes = static_cast<const char *>(data);
+
+    while (length > 0) {
+        ssize_t written = pwrite(m_Fd, bytes, length, offset);
+        if (written <= 0) {
+            throw IOException();
+        }
+
+        bytes += written;
+        offset += written;
+        length -= written;
+    }
+}
+
+void TileFile::readAt(uint64_t offset, void *data, size_t length) const
+{
+    char *bytes = static_cast<char *>(data);
+
+    while (length > 0) {
+        ssize_t read = pread(m_Fd, bytes, length, offset);
+        if (read < 0) {
+            throw IOException();
+        }
+        if (read == 0) {
+            throw InvalidInputException();
+        }
+
+        bytes += read;
+        offset += read;
+        length -= read;
+    }
+}
+
+void TileFile::release(uint64_t key, const Extent &extent)
+{
+    unordered_map<uint64_t, Extent>::const_iterator saved = m_SavedIndex.find(key);
+
+    if (saved != m_SavedIndex.end() && saved->second.offset == extent.offset) {
+        m_PendingFree.emplace_back(extent.offset, extent.length);
+    } else if (extent.length > 0) {
+        m_Free.emplace_back(extent.offset, extent.length);
+    }
+}
+
+uint64_t TileFile::allocate(uint64_t length)
+{
+    /* first fit */
+    for (size_t i = 0; i < m_Free.size(); ++i) {
+        if (m_Free[i].second >= length) {
+            uint64_t offset = m_Free[i].first;
+
+            m_Free[i].first += length;
+            m_Free[i].second -= length;
+
+            if (m_Free[i].second == 0) {
+                m_Free[i] = m_Free.back();
+                m_Free.pop_back();
+            }
+
+            return offset;
+        }
+    }
+
+    uint64_t offset = m_End;
+    m_End += length;
+
+    return offset;
+}
+
+const unordered_map<uint64_t, TileFile::Extent> &TileFile::getIndex() const
+{
+    return m_Index;
+}
+
+string TileFile::read(uint64_t key) const
+{
+    unordered_map<uint64_t, Extent>::const_iterator it = m_Index.find(key);
+    if (it == m_Index.end()) {
+        return "";
+    }
+
+    string data(it->second.length, '\0');
+    readAt(it->second.offset, &data[0], data.length());
+
+    return data;
+}
+
+void TileFile::write(uint64_t key, const string &data, uint64_t cells)
+{
+    Extent extent = {allocate(data.length()), data.length(), cells};
+    writeAt(extent.offset, data.data(), data.length());
+
+    unordered_map<uint64_t, Extent>::iterator it = m_Index.find(key);
+    if (it != m_Index.end()) {
+        release(key, it->second);
+        it->second = extent;
+    } else {
+        m_Index[key] = extent;
+    }
+}
+
+void TileFile::remove(uint64_t key)
+{
+    unordered_map<uint64_t, Extent>::iterator it = m_Index.find(key);
+    if (it != m_Index.end()) {
+        release(key, it->second);
+        m_Index.erase(it);
+    }
+}
+
+void TileFile::saveIndex()
+{
+    vector<uint64_t> data;
+    data.reserve(1 + m_Index.size() * 4);
+
+    data.push_back(m_Index.size());
+    for (const pair<const uint64_t, Extent> &entry : m_Index) {
+        data.push_back(entry.first);
+        data.push_back(entry.second.offset);
+        data.push_back(entry.second.length);
+        data.push_back(entry.second.cells);
+    }
+
+    Extent extent = {allocate(data.size() * sizeof(uint64_t)), data.size() * sizeof(uint64_t), 0};
+    writeAt(extent.offset, data.data(), extent.length);
+
+    /* commit */
+    writeAt(sizeof(MAGIC), &extent.offset, sizeof(extent.offset));
+
+    if (m_SavedIndexExtent.length > 0) {
+        m_Free.emplace_back(m_SavedIndexExtent.offset, m_SavedIndexExtent.length);
+    }
+    m_Free.insert(m_Free.end(), m_PendingFree.begin(), m_PendingFree.end());
+    m_PendingFree.clear();
+
+    m_SavedIndex = m_Index;
+    m_SavedIndexExtent = extent;
+}
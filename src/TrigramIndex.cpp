@@ -0,0 +1,168 @@
+#include "TrigramIndex.h"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace std;
+
+const size_t TrigramIndex::REBUILD_RATIO;
+
+uint64_t TrigramIndex::packAddress(const Address &addr)
+{
+    return (uint64_t) addr.row() << 32 | (uint32_t) addr.col();
+}
+
+Address TrigramIndex::unpackAddress(uint64_t packed)
+{
+    return Address((int) (uint32_t) packed, (int) (packed >> 32));
+}
+
+template<typename Function>
+void TrigramIndex::forEachTrigram(const string &text, Function fn)
+{
+    if (text.length() < 3) {
+        return;
+    }
+
+    vector<uint32_t> trigrams;
+    trigrams.reserve(text.length() - 2);
+
+    for (size_t i = 0; i + 2 < text.length(); ++i) {
+        trigrams.push_back((uint32_t) (unsigned char) text[i] << 16 |
+                           (uint32_t) (unsigned char) text[i + 1] << 8 |
+                           (unsigned char) text[i + 2]);
+    }
+
+    sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    for (uint32_t trigram : trigrams) {
+        fn(trigram);
+    }
+}
+
+TrigramIndex::TrigramIndex(shared_ptr<Sheet> sheet)
+    : m_Sheet(sheet)
+{
+    m_Subscription = m_Sheet->subscribe(
+        Address(1, 1),
+        Address(Address::MAX_COL, Address::MAX_ROW),
+        [this](const vector<Address> &changed) {
+            m_Changed.insert(changed.begin(), changed.end());
+        });
+
+    build();
+}
+
+TrigramIndex::~TrigramIndex()
+{
+    m_Sheet->unsubscribe(m_Subscription);
+}
+
+void TrigramIndex::build()
+{
+    m_Postings.clear();
+    m_Formulas.clear();
+    m_Changed.clear();
+    m_Indexed = 0;
+
+    /* one thread, the postings are not worth merging */
+    m_Sheet->scanCells([this](const Address &addr, const CellBase *cell, const Value &literal) {
+        uint64_t packed = packAddress(addr);
+
+        ++m_Indexed;
+
+        if (cell == nullptr) {
+            forEachTrigram(literal.toString(false), [this, packed](uint32_t trigram) {
+                m_Postings[trigram].push_back(packed);
+            });
+            return;
+        }
+
+        if (static_cast<const Cell *>(cell)->isFormula()) {
+            m_Formulas.push_back(packed);
+        }
+
+        forEachTrigram(cell->getContentSource(), [this, packed](uint32_t trigram) {
+            m_Postings[trigram].push_back(packed);
+        });
+    }, 1);
+
+    /* tiles are scanned in no particular order */
+    for (pair<const uint32_t, vector<uint64_t>> &entry : m_Postings) {
+        sort(entry.second.begin(), entry.second.end());
+        entry.second.shrink_to_fit();
+    }
+
+    sort(m_Formulas.begin(), m_Formulas.end());
+}
+
+bool TrigramIndex::canFilter(const string &text)
+{
+    return text.length() >= 3;
+}
+
+vector<Address> TrigramIndex::candidates(const string &text)
+{
+    if (m_Changed.size() * REBUILD_RATIO > m_Indexed) {
+        build();
+    }
+
+    /* the rarest trigrams first, so that the intersection shrinks fast */
+    vector<const vector<uint64_t> *> postings;
+    bool missing = false;
+
+    forEachTrigram(text, [this, &postings, &missing](uint32_t trigram) {
+        unordered_map<uint32_t, vector<uint64_t>>::const_iterator it = m_Postings.find(trigram);
+
+        if (it == m_Postings.end()) {
+            missing = true;
+        } else {
+            postings.push_back(&it->second);
+        }
+    });
+
+    vector<uint64_t> found;
+
+    if (!missing && !postings.empty()) {
+        sort(postings.begin(), postings.end(),
+             [](const vector<uint64_t> *lhs, const vector<uint64_t> *rhs) {
+                 return lhs->size() < rhs->size();
+             });
+
+        found = *postings[0];
+
+        vector<uint64_t> intersection;
+
+        for (size_t i = 1; i < postings.size() && !found.empty(); ++i) {
+            intersection.clear();
+            set_intersection(found.begin(), found.end(),
+                             postings[i]->begin(), postings[i]->end(),
+                             back_inserter(intersection));
+            found.swap(intersection);
+        }
+    }
+
+    found.insert(found.end(), m_Formulas.begin(), m_Formulas.end());
+
+    for (const Address &addr : m_Changed) {
+        found.push_back(packAddress(addr));
+    }
+
+    sort(found.begin(), found.end());
+    found.erase(unique(found.begin(), found.end()), found.end());
+
+    vector<Address> addrs;
+    addrs.reserve(found.size());
+
+    for (uint64_t packed : found) {
+        addrs.push_back(unpackAddress(packed));
+    }
+
+    return addrs;
+}
+
+size_t TrigramIndex::size() const
+{
+    return m_Postings.size();
+}
@@ -2,10 +2,16 @@
 
 #include "Utils.h"
 
-#include <regex>
-
 using namespace std;
 
+/**
+ * Whether the string consists of whitespace only.
+ */
+static bool isBlank(const string &val)
+{
+    return val.find_first_not_of(" \t\n\v\f\r") == string::npos;
+}
+
 template<>
 const string Type<int>::name = "int";
 
@@ -15,6 +21,15 @@ const string Type<double>::name = "double";
 template<>
 const string Type<string>::name = "string";
 
+template<>
+const TypeTag Type<int>::tag = TypeTag::INT;
+
+template<>
+const TypeTag Type<double>::tag = TypeTag::DOUBLE;
+
+template<>
+const TypeTag Type<string>::tag = TypeTag::STRING;
+
 template<>
 const int Type<int>::defaultValue = 0;
 
@@ -24,6 +39,33 @@ const double Type<double>::defaultValue = 0;
 template<>
 const string Type<string>::defaultValue = "";
 
+const string &typeName(TypeTag tag)
+{
+    switch (tag) {
+    case TypeTag::INT:
+        return Type<int>::name;
+    case TypeTag::DOUBLE:
+        return Type<double>::name;
+    case TypeTag::STRING:
+        break;
+    }
+
+    return Type<string>::name;
+}
+
+TypeTag typeTag(const string &name)
+{
+    if (name == Type<int>::name) {
+        return TypeTag::INT;
+    } else if (name == Type<double>::name) {
+        return TypeTag::DOUBLE;
+    } else if (name == Type<string>::name) {
+        return TypeTag::STRING;
+    }
+
+    throw InvalidTypeException();
+}
+
 template<>
 string Type<int>::toString(const int &val, bool isLiteral)
 {
@@ -54,7 +96,7 @@ string Type<string>::toString(const string &val, bool isLiteral)
 template<>
 int Type<int>::fromString(const string &val, bool isLiteral)
 {
-    if (regex_match(val, regex("^\\s*$"))) {
+    if (isBlank(val)) {
         return 0;
     }
 
@@ -73,7 +115,7 @@ int Type<int>::fromString(const string &val, bool isLiteral)
 template<>
 double Type<double>::fromString(const string &val, bool isLiteral)
 {
-    if (regex_match(val, regex("^\\s*$"))) {
+    if (isBlank(val)) {
         return 0.0;
     }
 
@@ -1,7 +1,16 @@
 #include "UI.h"
 
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "Csv.h"
+#include "Search.h"
 
 #include "exception/InvalidArgumentException.h"
 #include "exception/IOException.h"
@@ -10,16 +19,55 @@
 
 using namespace std;
 
-void UI::start()
+static string formatBytes(size_t bytes)
+{
+    ostringstream out;
+    out << fixed << setprecision(1);
+
+    if (bytes >= (size_t) 1 << 20) {
+        out << bytes / (double) (1 << 20) << " MiB";
+    } else {
+        out << bytes / 1024.0 << " KiB";
+    }
+
+    return out.str();
+}
+
+static uint64_t packAddress(const Address &addr)
+{
+    return (uint64_t) addr.col() << 32 | (uint32_t) addr.row();
+}
+
+static string formatMicros(long micros)
+{
+    if (micros < 0) {
+        return "-";
+    }
+
+    ostringstream out;
+    out << fixed << setprecision(micros < 10000 ? 2 : 0) << micros / 1000.0 << " ms";
+
+    return out.str();
+}
+
+void UI::start(const string &filename)
 {
     UI ui;
-    ui.init(make_shared<Sheet>());
+
+    if (filename.empty()) {
+        ui.init(make_shared<Sheet>());
+    } else {
+        ui.init(filename);
+    }
 
     /* run returns 1 if it needs to re-run (i.e. terminal size changed) */
     while (ui.run());
 }
 
 UI::UI()
+    : m_LoadViewportBegin(0),
+      m_LoadViewportEnd(0),
+      m_LoadCancelled(false)
 {
     initscr();
     start_color();
@@ -41,9 +89,11 @@ UI::UI()
 
 void UI::init(const string &filename)
 {
-    // todo
+    init(make_shared<Sheet>());
 
-    // init(sheet);
+    /* the viewport is known once running */
+    m_LoadFilename = filename;
+    m_LoadStart = chrono::steady_clock::now();
 }
 
 void UI::init(shared_ptr<Sheet> sheet)
@@ -52,11 +102,20 @@ void UI::init(shared_ptr<Sheet> sheet)
     m_ViewportShift = Address(1, 1);
     m_ActiveCellAddr = Address(1, 1);
     m_Mode = WorkingMode::BROWSE;
+    m_SearchIndex.reset();
     m_Sheet = sheet;
+    m_DisplayCache.clear();
+    m_SearchResults.clear();
 }
 
 UI::~UI()
 {
+    /* the pending load uses the members, so it must end before any of them is destroyed */
+    m_LoadCancelled = true;
+    if (m_PendingLoad.valid()) {
+        m_PendingLoad.wait();
+    }
+
     endwin();
 }
 
@@ -69,6 +128,9 @@ int UI::run()
     noecho();
     keypad(stdscr, true);
 
+    /* lets ncurses scroll the terminal instead of rewriting lines that only moved */
+    idlok(stdscr, true);
+
     /* 11 chars for header (incl. border) */
     m_ViewportCols = (getmaxx(stdscr) - 11) / (m_CellWidth + 1);
 
@@ -82,30 +144,104 @@ int UI::run()
 
     m_VerticalHeaderCellWidth = getmaxx(stdscr) - m_ViewportCols * (m_CellWidth + 1) - 1;
 
+    if (!m_LoadFilename.empty()) {
+        loadInBackground(m_LoadFilename);
+        m_LoadFilename.clear();
+    }
+
     createPromptForm();
 
-    drawHeadersGrid();
-    drawGrid();
-    drawHeaderLabels();
+    m_Recalc.reset(new Recalculator(m_Sheet, [this](const CellBase &cell) {
+        return formatCell(cell);
+    }));
 
-    printAllCells();
+    /* the sheet may be replaced by loading another one */
+    shared_ptr<Sheet> subscribedSheet = m_Sheet;
 
-    m_Sheet->attachCellContentChangedEvent([&](const CellBase &cell) {
-        printCell(cell);
-    });
+    {
+        unique_lock<mutex> sheetLock = m_Recalc->lock();
 
-    moveActiveCell(m_ActiveCellAddr);
+        /* the range follows the viewport, see printCells() */
+        m_Subscription = m_Sheet->subscribe(
+            m_ViewportShift,
+            m_ViewportShift,
+            [this](const vector<Address> &changed) { printChangedCells(changed); });
 
-    updatePrompt();
+        drawHeadersGrid();
+        drawGrid();
+        drawHeaderLabels();
+
+        printAllCells();
+
+        moveActiveCell(m_ActiveCellAddr);
+
+        updatePrompt();
+
+        if (m_PendingLoad.valid()) {
+            printSuccess("Loading...");
+        } else if (!m_LoadReport.empty()) {
+            printSuccess(m_LoadReport);
+            m_LoadReport.clear();
+        }
+    }
 
     bool exit = false, reset = false;
     int c;
-    while (!exit && (c = getch())) {
+    while (!exit) {
+        /* everything drawn while handling the previous input goes out as one frame */
+        flushFrame();
+
+        if (m_PendingLoad.valid() && m_LoadInteractive < 0) {
+            m_LoadInteractive = chrono::duration_cast<chrono::milliseconds>(
+                chrono::steady_clock::now() - m_LoadStart).count();
+        }
+
+        /* wake up periodically to report the result of a background save or load and
+         * recalculated cells */
+        timeout(m_PendingSave.valid() || m_PendingLoad.valid() || m_Recalc->isBusy() ? 50 : -1);
+
+        if (!(c = getch())) {
+            break;
+        }
+
+        /* the recalculation pauses until the input is handled */
+        unique_lock<mutex> sheetLock = m_Recalc->lock();
+
+        printRecalculatedCells();
+
+        if (m_StatsShown) {
+            drawStats();
+        }
+
+        checkPendingSave();
+
+        if (checkPendingLoad()) {
+            reset = true;
+            break;
+        }
+
+        if (c == ERR) {
+            continue;
+        }
+
+        m_FrameStart = chrono::steady_clock::now();
+        m_FrameTimed = true;
+
+        /* any key hides the panel and is handled as usual */
+        if (m_StatsShown) {
+            hideStats();
+        }
+
         if (c == KEY_RESIZE) {
             reset = true;
             break;
         }
 
+        /* the loaded sheet would replace anything done to the empty one */
+        if (m_PendingLoad.valid() && !worksWhileLoading(c)) {
+            continue;
+        }
+
         /* for debug */
         if (c == KEY_F(10)) {
             moveActiveCell(Address(2147483640, 2147483640));
@@ -141,7 +277,31 @@ int UI::run()
                 moveActiveCell(
                     Address(
                         m_ActiveCellAddr.col(),
-                        min(Address::MAX_ROW, m_ActiveCellAddr.row() + m_ViewportRows)));
+                        m_ActiveCellAddr.row() +
+                            min(m_ViewportRows, Address::MAX_ROW - m_ActiveCellAddr.row())));
+                break;
+
+            case KEY_HOME:
+                moveActiveCell(Address(1, 1));
+                break;
+            case KEY_END: {
+                Address begin(1, 1), end(1, 1);
+                if (m_Sheet->getUsedRange(begin, end)) {
+                    moveActiveCell(end);
+                }
+                break;
+            }
+
+            case 'n':
+                if (!m_SearchResults.empty()) {
+                    showSearchResult((m_SearchPos + 1) % m_SearchResults.size());
+                }
+                break;
+            case 'N':
+                if (!m_SearchResults.empty()) {
+                    showSearchResult(
+                        (m_SearchPos + m_SearchResults.size() - 1) % m_SearchResults.size());
+                }
                 break;
 
             case 'I':
@@ -172,14 +332,34 @@ int UI::run()
 
             case '\n': /* enter */
                 m_Mode = WorkingMode::EDIT;
+                set_field_fore(m_PromptField[0], COLOR_PAIR(WHITE_BLACK));
                 curs_set(1);
                 break;
 
             case ':':
                 m_Mode = WorkingMode::CONTROL;
+                set_field_fore(m_PromptField[0], COLOR_PAIR(WHITE_BLACK));
                 set_field_buffer(m_PromptField[0], 0, "");
                 curs_set(1);
                 break;
+
+            default: {
+                /* ctrl+arrows have no constants, they are extended keys of the terminal */
+                const char *name = keyname(c);
+
+                if (name == nullptr) {
+                    break;
+                } else if (strcmp(name, "kUP5") == 0) {
+                    jump(0, -1);
+                } else if (strcmp(name, "kDN5") == 0) {
+                    jump(0, 1);
+                } else if (strcmp(name, "kLFT5") == 0) {
+                    jump(-1, 0);
+                } else if (strcmp(name, "kRIT5") == 0) {
+                    jump(1, 0);
+                }
+                break;
+            }
             }
             break;
 
@@ -250,26 +430,124 @@ int UI::run()
                             arg = Utils::trim(command.substr(spacePos + 1));
                         }
 
-                        if (cmdName == "write" || cmdName == "w") {
-                            ofstream file(arg);
+                        if (m_PendingLoad.valid() && cmdName != "quit" && cmdName != "q") {
+                            /* the loaded sheet would replace whatever the command did */
+                            printError("Still loading.");
+                        } else if ((cmdName == "write" || cmdName == "w") && arg.empty() &&
+                            m_Sheet->isOutOfCore()) {
+                            m_Sheet->saveTiles();
+                            printSuccess("Written.");
+                        } else if (cmdName == "write" || cmdName == "w") {
+                            shared_ptr<Journal> journal = m_Sheet->getJournal();
+
+                            if (arg.empty() && journal) {
+                                arg = journal->getBaseFilename();
+                            }
+
+                            if (journal && journal->getBaseFilename() == arg) {
+                                /* a compaction must not race the base still being written */
+                                checkPendingSave(true);
+
+                                journal->flush(*m_Sheet);
+                                printSuccess("Written.");
+                            } else {
+                                saveInBackground(arg);
+
+                                /* edits from now on belong to the new file: journaled over
+                                 * the base being written, or not at all */
+                                m_Sheet->attachJournal(
+                                    m_JournalMode ? make_shared<Journal>(arg) : nullptr);
+                                printSuccess("Writing...");
+                            }
+                        } else if (cmdName == "load" || cmdName == "l") {
+                            init(loadSheet(arg, m_JournalMode));
+                            reset = true;
+                            exit = true;
+                        } else if (cmdName == "import") {
+                            ifstream file(arg, ios::binary);
                             if (!file.good())
                                 throw IOException();
 
-                            m_Sheet->serialize(file);
-                            file.close();
+                            size_t rows = Csv::read(
+                                file,
+                                *m_Sheet,
+                                m_ActiveCellAddr,
+                                Csv::delimiterFor(arg));
 
-                            printSuccess("Written.");
-                        } else if (cmdName == "load" || cmdName == "l") {
-                            ifstream file(arg);
+                            printSuccess(string("Imported ") + to_string(rows) + " rows.");
+                        } else if (cmdName == "export") {
+                            ofstream file(arg, ios::binary);
                             if (!file.good())
                                 throw IOException();
 
-                            shared_ptr<Sheet> sheet = Sheet::deserialize(file);
+                            Csv::write(file, *m_Sheet, Csv::delimiterFor(arg));
                             file.close();
 
-                            init(sheet);
-                            reset = true;
-                            exit = true;
+                            if (file.fail())
+                                throw IOException();
+
+                            printSuccess("Exported.");
+                        } else if (cmdName == "journal" || cmdName == "j") {
+                            if (arg == "on") {
+                                m_JournalMode = true;
+                            } else if (arg == "off") {
+                                m_JournalMode = false;
+                                m_Sheet->attachJournal(nullptr);
+                            } else
+                                throw UnknownCommandException();
+
+                            printSuccess(string("Journal ") + arg + ".");
+                        } else if (cmdName == "find" || cmdName == "f") {
+                            m_SearchResults = Search(arg).findAll(*m_Sheet, m_SearchIndex.get());
+
+                            if (m_SearchResults.empty()) {
+                                printError("No match.");
+                                return;
+                            }
+
+                            /* the first match from the active cell on, row by row */
+                            size_t pos = 0;
+                            while (pos < m_SearchResults.size() &&
+                                   (m_SearchResults[pos].row() < m_ActiveCellAddr.row() ||
+                                    (m_SearchResults[pos].row() == m_ActiveCellAddr.row() &&
+                                     m_SearchResults[pos].col() < m_ActiveCellAddr.col()))) {
+                                ++pos;
+                            }
+
+                            showSearchResult(pos % m_SearchResults.size());
+                        } else if (cmdName == "replace") {
+                            size_t spacePos = arg.find(' ');
+                            string replacement;
+
+                            if (spacePos != string::npos) {
+                                replacement = arg.substr(spacePos + 1);
+                                arg = arg.substr(0, spacePos);
+                            }
+
+                            Search search(arg);
+                            size_t failed = 0;
+                            size_t replaced = search.replaceAll(
+                                *m_Sheet,
+                                search.findAll(*m_Sheet, m_SearchIndex.get()),
+                                replacement,
+                                &failed);
+
+                            m_SearchResults.clear();
+
+                            string report = "Replaced in " + to_string(replaced) + " cells";
+                            if (failed > 0) {
+                                report += ", " + to_string(failed) + " invalid left alone";
+                            }
+
+                            printSuccess(report + ".");
+                        } else if (cmdName == "index") {
+                            m_SearchIndex.reset();
+                            m_SearchIndex.reset(new TrigramIndex(m_Sheet));
+
+                            printSuccess(string("Indexed ") + to_string(m_SearchIndex->size()) +
+                                         " trigrams.");
+                        } else if (cmdName == "stats") {
+                            m_StatsShown = true;
                         } else if (cmdName == "quit" || cmdName == "q") {
                             exit = true;
                         } else
@@ -288,9 +566,18 @@ int UI::run()
             }
             break;
         }
+
+        drawProgress();
+
+        if (m_StatsShown) {
+            drawStats();
+        }
     }
 
-    m_Sheet->attachCellContentChangedEvent(nullptr);
+    /* the sheet is not locked here anymore */
+    m_Recalc.reset();
+
+    subscribedSheet->unsubscribe(m_Subscription);
 
     deletePromptForm();
 
@@ -330,64 +617,287 @@ void UI::moveActiveCell(Address addr)
 
     /* apply new viewport shift, redraw header labels and rewrite grid content */
     if (newShiftCol != m_ViewportShift.col() || newShiftRow != m_ViewportShift.row()) {
+        bool sameCols = newShiftCol == m_ViewportShift.col();
+        int rowDelta = newShiftRow - m_ViewportShift.row();
+
         m_ViewportShift = Address(newShiftCol, newShiftRow);
-        drawHeaderLabels();
-        printAllCells();
+
+        if (sameCols && abs(rowDelta) < m_ViewportRows) {
+            scrollRows(rowDelta);
+        } else {
+            drawHeaderLabels();
+            printAllCells();
+        }
     }
 
     highlightCell(m_ActiveCellAddr - m_ViewportShift);
 
     updatePrompt();
-
-    refresh();
 }
 
-void UI::printAllCells()
+void UI::jump(int colStep, int rowStep)
 {
-    for (int row = m_ViewportShift.row(); row < m_ViewportShift.row() + m_ViewportRows; ++row) {
-        for (int col = m_ViewportShift.col(); col < m_ViewportShift.col() + m_ViewportCols; ++col) {
-            shared_ptr<const CellBase> cell = m_Sheet->getCell(Address(col, row));
-            printCell(*cell);
+    const Address &from = m_ActiveCellAddr;
+
+    /* the edge of the sheet, if there is nothing on the way */
+    Address target(
+        colStep > 0 ? Address::MAX_COL : colStep < 0 ? 1 : from.col(),
+        rowStep > 0 ? Address::MAX_ROW : rowStep < 0 ? 1 : from.row());
+
+    if (target == from) {
+        return;
+    }
+
+    Address found(1, 1);
+    Address next(from.col() + colStep, from.row() + rowStep);
+
+    if (m_Sheet->hasCell(from) && m_Sheet->hasCell(next)) {
+        /* within a block, to its last cell */
+        if (m_Sheet->findCell(from, colStep, rowStep, false, found)) {
+            target = Address(found.col() - colStep, found.row() - rowStep);
         }
+    } else if (m_Sheet->findCell(from, colStep, rowStep, true, found)) {
+        /* to the next block */
+        target = found;
+    }
+
+    moveActiveCell(target);
+}
+
+void UI::showSearchResult(size_t pos)
+{
+    m_SearchPos = pos;
+    moveActiveCell(m_SearchResults[pos]);
+
+    printSuccess(string("Match ") + to_string(pos + 1) + " of " +
+                 to_string(m_SearchResults.size()) + ".");
+}
+
+void UI::scrollRows(int rows)
+{
+    /* the lines of the rows, including their vertical header */
+    wsetscrreg(stdscr, 2, 1 + m_ViewportRows * 2);
+    scrollok(stdscr, true);
+
+    wscrl(stdscr, rows * 2);
+
+    /* writing the prompt must not scroll the screen */
+    scrollok(stdscr, false);
+    wsetscrreg(stdscr, 0, getmaxy(stdscr) - 1);
+
+    /* relative to viewport, 1-based */
+    int firstExposed = rows > 0 ? m_ViewportRows - rows + 1 : 1;
+    int lastExposed = rows > 0 ? m_ViewportRows : -rows;
+
+    for (int row = firstExposed; row <= lastExposed; ++row) {
+        drawGridRow(row);
     }
+
+    printCells(
+        m_ViewportShift.row() + firstExposed - 1,
+        m_ViewportShift.row() + lastExposed - 1);
 }
 
-void UI::printCell(const CellBase &cell)
+void UI::printAllCells()
 {
+    printCells(m_ViewportShift.row(), m_ViewportShift.row() + m_ViewportRows - 1);
+}
+
+void UI::printCells(int firstRow, int lastRow)
+{
+    /* texts formatted for another width are useless */
+    if (m_DisplayCacheWidth != m_CellWidth) {
+        m_DisplayCache.clear();
+        m_DisplayCacheWidth = m_CellWidth;
+    }
+
+    /* forget cells scrolled out of the viewport, their changes are not tracked */
+    for (auto it = m_DisplayCache.begin(); it != m_DisplayCache.end();) {
+        if (isInViewport(it->first)) {
+            ++it;
+        } else {
+            it = m_DisplayCache.erase(it);
+        }
+    }
+
     Address viewportEnd(
         m_ViewportShift.col() + m_ViewportCols - 1,
         m_ViewportShift.row() + m_ViewportRows - 1);
 
-    /* cell out of viewport */
-    if (cell.getAddr().col() < m_ViewportShift.col() ||
-        cell.getAddr().row() < m_ViewportShift.row() ||
-        cell.getAddr().col() > viewportEnd.col() ||
-        cell.getAddr().row() > viewportEnd.row()) {
-        return;
+    m_Recalc->setViewport(m_ViewportShift, viewportEnd);
+    m_Sheet->setSubscriptionRange(m_Subscription, m_ViewportShift, viewportEnd);
+
+    /* by offsets, the viewport may end at the edge of the sheet */
+    for (int rowOffset = 0; rowOffset <= lastRow - firstRow; ++rowOffset) {
+        for (int colOffset = 0; colOffset < m_ViewportCols; ++colOffset) {
+            Address addr(m_ViewportShift.col() + colOffset, firstRow + rowOffset);
+
+            auto it = m_DisplayCache.find(addr);
+            if (it == m_DisplayCache.end()) {
+                shared_ptr<const CellBase> cell = m_Sheet->getCell(addr);
+
+                if (static_cast<const Cell &>(*cell).isEvaluated()) {
+                    it = m_DisplayCache.emplace(addr, DisplayText{formatCell(*cell), false}).first;
+                } else {
+                    /* evaluating is up to the recalculation, it may take long */
+                    it = m_DisplayCache.emplace(
+                        addr,
+                        DisplayText{string(max(m_CellWidth, 0), ' '), true}).first;
+                    m_Recalc->request(addr);
+                }
+            }
+
+            printCellText(addr, it->second);
+        }
+    }
+}
+
+void UI::printChangedCells(const vector<Address> &changed)
+{
+    for (const Address &addr : changed) {
+        shared_ptr<const CellBase> cell = m_Sheet->getCell(addr);
+        DisplayText &display = m_DisplayCache[addr];
+
+        if (static_cast<const Cell &>(*cell).isEvaluated()) {
+            display = DisplayText{formatCell(*cell), false};
+        } else {
+            /* keeps showing the previous text until the cell is recalculated */
+            if (display.text.empty()) {
+                display.text = string(max(m_CellWidth, 0), ' ');
+            }
+
+            display.stale = true;
+        }
+
+        printCellText(addr, display);
     }
+}
+
+void UI::printRecalculatedCells()
+{
+    for (const Recalculator::Result &result : m_Recalc->takeResults()) {
+        /* the viewport may have moved since the cell was evaluated */
+        if (!isInViewport(result.addr)) {
+            continue;
+        }
+
+        DisplayText &display = m_DisplayCache[result.addr];
+        display = DisplayText{result.text, false};
 
+        printCellText(result.addr, display);
+    }
+
+    drawProgress();
+}
+
+bool UI::isInViewport(const Address &addr) const
+{
+    return addr.col() >= m_ViewportShift.col() &&
+        addr.row() >= m_ViewportShift.row() &&
+        addr.col() - m_ViewportShift.col() < m_ViewportCols &&
+        addr.row() - m_ViewportShift.row() < m_ViewportRows;
+}
+
+string UI::formatCell(const CellBase &cell) const
+{
     /* cell too small */
     if (m_CellWidth <= 0) {
-        return;
+        return "";
     }
 
-    Address relAddr = cell.getAddr() - m_ViewportShift;
-
     // todo: align different cell-types differently
-    string cellContent;
-
     try {
-        cellContent = Utils::strPadRight(cell.getContentText().substr(0, m_CellWidth), m_CellWidth);
+        return Utils::strPadRight(cell.getContentText().substr(0, m_CellWidth), m_CellWidth);
     } catch (...) {
-        cellContent = Utils::strPadCenter("[-error-]", m_CellWidth);
+        return Utils::strPadCenter("[-error-]", m_CellWidth);
+    }
+}
+
+void UI::printCellText(const Address &addr, const DisplayText &display)
+{
+    Address relAddr = addr - m_ViewportShift;
+
+    if (display.stale) {
+        attron(INACTIVE_CELL_COLOR);
     }
 
     mvprintw(
         2 + (relAddr.row() - 1) * 2,
         m_VerticalHeaderCellWidth + 1 + (relAddr.col() - 1) * (m_CellWidth + 1),
-        cellContent.c_str());
+        display.text.c_str());
+
+    if (display.stale) {
+        attroff(INACTIVE_CELL_COLOR);
+    }
+}
+
+void UI::drawProgress()
+{
+    string progress;
+
+    if (m_Recalc->isBusy() && m_Recalc->getTotal() > 0) {
+        progress = to_string(m_Recalc->getDone() * 100 / m_Recalc->getTotal()) + "%";
+    }
+
+    attron(COLOR_PAIR(YELLOW_BLACK));
+    mvprintw(0, 0, Utils::strPadCenter(progress, m_VerticalHeaderCellWidth).c_str());
+    attroff(COLOR_PAIR(YELLOW_BLACK));
+}
+
+void UI::drawStats()
+{
+    Stats stats = m_Sheet->getStats();
+    stats.lastEvaluationMicros = m_Recalc->getLastDuration();
+    stats.lastRepaintMicros = m_LastRepaint;
+
+    size_t lookups = stats.valueHits + stats.valueMisses;
+
+    vector<pair<string, string>> lines = {
+        {"Cells", to_string(stats.cells)},
+        {"Formula nodes", to_string(stats.formulaNodes)},
+        {"Dependency edges", to_string(stats.dependencyEdges)},
+        {"Interned sources", to_string(stats.internedStrings)},
+        {"Memory: cell pool", formatBytes(stats.poolBytes)},
+        {"Memory: literals", formatBytes(stats.literalBytes)},
+        {"Memory: dependencies", formatBytes(stats.dependencyBytes)},
+        {"Memory: loaded tiles", formatBytes(stats.loadedTileBytes)},
+        {"Evaluations", to_string(stats.evaluations)},
+        {"Value cache hits", to_string(stats.valueHits) + " (" +
+            to_string(lookups > 0 ? stats.valueHits * 100 / lookups : 100) + "%)"},
+        {"Value cache misses", to_string(stats.valueMisses)},
+        {"Link cache hits/misses", to_string(stats.linkHits) + "/" + to_string(stats.linkMisses)},
+        {"Recalcs", to_string(stats.recalcs)},
+        {"Last invalidation", formatMicros(stats.lastInvalidationMicros)},
+        {"Last evaluation", formatMicros(stats.lastEvaluationMicros)},
+        {"Last repaint", formatMicros(stats.lastRepaintMicros)},
+    };
+
+    int top = 2;
+    int left = m_VerticalHeaderCellWidth + 1;
+    int width = min(46, m_ViewportCols * (m_CellWidth + 1) - 1);
+
+    /* clipped by the prompt */
+    int height = min((int) lines.size(), getmaxy(stdscr) - 1 - top);
+
+    attron(COLOR_PAIR(CYAN_BLACK));
+
+    for (int i = 0; i < height; ++i) {
+        string line = " " + Utils::strPadRight(lines[i].first, 24) +
+            Utils::strPadLeft(lines[i].second, 20) + " ";
+
+        mvprintw(top + i, left, "%s", Utils::strPadRight(line, width).substr(0, width).c_str());
+    }
+
+    attroff(COLOR_PAIR(CYAN_BLACK));
+}
+
+void UI::hideStats()
+{
+    m_StatsShown = false;
 
-    refresh();
+    drawGrid();
+    printAllCells();
+    highlightCell(m_ActiveCellAddr - m_ViewportShift);
 }
 
 void UI::createPromptForm()
@@ -435,12 +945,221 @@ void UI::updatePrompt()
     mvprintw(promptRow, getmaxx(stdscr) - prompt_right.length(), prompt_right.c_str());
 
     /* active cell value */
+    set_field_fore(m_PromptField[0], COLOR_PAIR(WHITE_BLACK));
     set_field_buffer(
         m_PromptField[0],
         0,
         activeCell->getContentSource().c_str());
+}
+
+void UI::flushFrame()
+{
+    /* drawing moves the cursor around, put it back into the prompt while typing */
+    if (m_Mode != WorkingMode::BROWSE) {
+        pos_form_cursor(m_PromptForm);
+    }
+
+    /* ncurses compares the frame with the screen and sends only the changed characters */
+    wnoutrefresh(stdscr);
+    doupdate();
+
+    if (m_FrameTimed) {
+        m_LastRepaint = (long) chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now() - m_FrameStart).count();
+        m_FrameTimed = false;
+    }
+}
+
+void UI::saveInBackground(const string &filename)
+{
+    checkPendingSave(true);
+
+    shared_ptr<const SheetSnapshot> snapshot = m_Sheet->snapshot();
+
+    /* the journal would override the new content on load; removed now rather than after
+     * writing, as edits made meanwhile may be journaled anew */
+    remove(Journal::journalFilename(filename).c_str());
+
+    m_PendingSave = async(launch::async, [snapshot, filename]() {
+        ofstream file(filename);
+        if (!file.good())
+            throw IOException();
+
+        snapshot->serialize(file);
+        file.close();
+
+        if (file.fail())
+            throw IOException();
+    });
+}
+
+void UI::checkPendingSave(bool wait)
+{
+    if (!m_PendingSave.valid()) {
+        return;
+    }
+
+    if (!wait && (m_Mode != WorkingMode::BROWSE ||
+        m_PendingSave.wait_for(chrono::seconds(0)) != future_status::ready)) {
+        return;
+    }
+
+    try {
+        m_PendingSave.get();
+        printSuccess("Written.");
+    } catch (const Exception &ex) {
+        printError("Write failed.");
+    }
+}
+
+shared_ptr<Sheet> UI::loadSheet(
+    const string &filename,
+    bool journalMode,
+    const function<void(const CellBase &)> &loaded,
+    const atomic<bool> *cancelled)
+{
+    if (filename.length() > 6 &&
+        Utils::toLower(filename.substr(filename.length() - 6)) == ".tiles") {
+        return make_shared<Sheet>(filename, CellStore::DEFAULT_MEMORY_BUDGET, cancelled);
+    }
+
+    ifstream file(filename);
+    if (!file.good())
+        throw IOException();
 
-    refresh();
+    shared_ptr<Sheet> sheet = Sheet::deserialize(file, loaded, cancelled);
+    file.close();
+
+    bool hasJournal = ifstream(Journal::journalFilename(filename)).good();
+    if (hasJournal || journalMode) {
+        shared_ptr<Journal> journal = make_shared<Journal>(filename);
+        journal->replay(*sheet, cancelled);
+        sheet->attachJournal(journal);
+    }
+
+    return sheet;
+}
+
+void UI::loadInBackground(const string &filename)
+{
+    bool journalMode = m_JournalMode;
+    m_LoadFirstPaint = -1;
+    m_LoadInteractive = -1;
+
+    updateLoadViewport();
+
+    m_PendingLoad = async(launch::async, [this, filename, journalMode]() {
+        return loadSheet(filename, journalMode, [this](const CellBase &cell) {
+            const Address &addr = cell.getAddr();
+
+            /* the ends may be of different viewports while it moves, checkPendingLoad()
+             * skips cells out of the current one */
+            uint64_t begin = m_LoadViewportBegin.load(memory_order_relaxed);
+            uint64_t end = m_LoadViewportEnd.load(memory_order_relaxed);
+
+            if (addr.col() < (int) (begin >> 32) || addr.row() < (int) (uint32_t) begin ||
+                addr.col() > (int) (end >> 32) || addr.row() > (int) (uint32_t) end) {
+                return;
+            }
+
+            /* literals only, formulas are evaluated once the whole sheet is loaded */
+            DisplayText display{string(max(m_CellWidth, 0), ' '), true};
+            if (static_cast<const Cell &>(cell).isEvaluated()) {
+                display = DisplayText{formatCell(cell), false};
+            }
+
+            lock_guard<mutex> lock(m_LoadPreviewMutex);
+            m_LoadPreview.emplace_back(addr, display);
+        }, &m_LoadCancelled);
+    });
+}
+
+void UI::updateLoadViewport()
+{
+    m_LoadViewportBegin = packAddress(m_ViewportShift);
+    m_LoadViewportEnd = packAddress(Address(
+        m_ViewportShift.col() + m_ViewportCols - 1,
+        m_ViewportShift.row() + m_ViewportRows - 1));
+}
+
+bool UI::worksWhileLoading(int c) const
+{
+    if (m_Mode != WorkingMode::BROWSE) {
+        return true;
+    }
+
+    switch (c) {
+    case KEY_UP:
+    case KEY_DOWN:
+    case KEY_LEFT:
+    case KEY_RIGHT:
+    case KEY_PPAGE:
+    case KEY_NPAGE:
+    case KEY_HOME:
+    case ':':
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool UI::checkPendingLoad()
+{
+    if (!m_PendingLoad.valid()) {
+        return false;
+    }
+
+    /* cells read from now on, the ones of the previous viewport are dropped on scrolling */
+    updateLoadViewport();
+
+    vector<pair<Address, DisplayText>> preview;
+    {
+        lock_guard<mutex> lock(m_LoadPreviewMutex);
+        preview.swap(m_LoadPreview);
+    }
+
+    long elapsed = chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now() - m_LoadStart).count();
+
+    if (!preview.empty() && m_LoadFirstPaint < 0) {
+        m_LoadFirstPaint = elapsed;
+    }
+
+    for (const pair<Address, DisplayText> &cell : preview) {
+        /* the viewport may have been resized since */
+        if (isInViewport(cell.first)) {
+            m_DisplayCache[cell.first] = cell.second;
+            printCellText(cell.first, cell.second);
+        }
+    }
+
+    if (m_PendingLoad.wait_for(chrono::seconds(0)) != future_status::ready) {
+        return false;
+    }
+
+    Address activeCell = m_ActiveCellAddr, viewportShift = m_ViewportShift;
+
+    try {
+        init(m_PendingLoad.get());
+    } catch (const Exception &ex) {
+        printError("Load failed.");
+        return false;
+    }
+
+    /* where the user has moved while loading */
+    m_ActiveCellAddr = activeCell;
+    m_ViewportShift = viewportShift;
+
+    m_LoadReport = "Loaded in " + to_string(elapsed) + " ms";
+    if (m_LoadInteractive >= 0) {
+        m_LoadReport += ", interactive after " + to_string(m_LoadInteractive) + " ms";
+    }
+    if (m_LoadFirstPaint >= 0) {
+        m_LoadReport += ", first cells after " + to_string(m_LoadFirstPaint) + " ms";
+    }
+    m_LoadReport += ".";
+
+    return true;
 }
 
 void UI::runSafe(const function<void()> &fun)
@@ -454,20 +1173,16 @@ void UI::runSafe(const function<void()> &fun)
 
 void UI::printError(const string &text)
 {
-    set_field_buffer(m_PromptField[0], 0, text.c_str());
+    /* stays colored until the prompt is updated or edited */
     set_field_fore(m_PromptField[0], COLOR_PAIR(RED_BLACK));
-    refresh();
-
-    set_field_fore(m_PromptField[0], COLOR_PAIR(WHITE_BLACK));
+    set_field_buffer(m_PromptField[0], 0, text.c_str());
 }
 
 void UI::printSuccess(const string &text)
 {
-    set_field_buffer(m_PromptField[0], 0, text.c_str());
+    /* stays colored until the prompt is updated or edited */
     set_field_fore(m_PromptField[0], COLOR_PAIR(GREEN_BLACK));
-    refresh();
-
-    set_field_fore(m_PromptField[0], COLOR_PAIR(WHITE_BLACK));
+    set_field_buffer(m_PromptField[0], 0, text.c_str());
 }
 
 void UI::drawHeadersGrid()
@@ -531,6 +1246,42 @@ void UI::drawGrid()
     attroff(INACTIVE_CELL_COLOR);
 }
 
+void UI::drawGridRow(int row)
+{
+    int contentLine = 2 + (row - 1) * 2;
+    int separatorLine = contentLine + 1;
+
+    attron(INACTIVE_CELL_COLOR);
+
+    /* vertical header */
+    mvhline(separatorLine, 0, ACS_HLINE, m_VerticalHeaderCellWidth);
+    move(contentLine, m_VerticalHeaderCellWidth);
+    addch(ACS_VLINE);
+    move(separatorLine, m_VerticalHeaderCellWidth);
+    addch(ACS_RTEE);
+
+    /* cells, with line intersections cleared */
+    mvhline(
+        separatorLine,
+        m_VerticalHeaderCellWidth + 1,
+        ACS_HLINE,
+        m_ViewportCols * (m_CellWidth + 1));
+
+    for (int col = 0; col < m_ViewportCols; ++col) {
+        move(contentLine, m_VerticalHeaderCellWidth + (col + 1) * (m_CellWidth + 1));
+        addch(ACS_VLINE);
+        move(separatorLine, m_VerticalHeaderCellWidth + (col + 1) * (m_CellWidth + 1));
+        addch(' ');
+    }
+
+    attroff(INACTIVE_CELL_COLOR);
+
+    string label = Utils::strPadCenter(
+        to_string(m_ViewportShift.row() + row - 1),
+        m_VerticalHeaderCellWidth);
+    mvprintw(contentLine, 0, label.c_str());
+}
+
 void UI::drawHeaderLabels()
 {
     Address cell_cursor = Address(1, 1);
@@ -89,6 +89,21 @@ string Utils::escapeString(const string &str)
     return oss.str();
 }
 
+void Utils::writeEscaped(ostream &os, const string &str)
+{
+    size_t begin = 0;
+
+    for (size_t i = 0; i < str.length(); ++i) {
+        if (str[i] == '"' || str[i] == '\\') {
+            os.write(str.data() + begin, i - begin);
+            os << '\\' << str[i];
+            begin = i + 1;
+        }
+    }
+
+    os.write(str.data() + begin, str.length() - begin);
+}
+
 string Utils::unescapeString(const string &str)
 {
     istringstream iss(str);
@@ -116,7 +131,8 @@ string Utils::unescapeString(const string &str)
 
 string Utils::readString(istream &is)
 {
-    ostringstream oss;
+    /* appended directly, short strings need no allocation at all */
+    string res;
     char c;
 
     is >> noskipws;
@@ -124,13 +140,13 @@ string Utils::readString(istream &is)
         is >> c;
 
         if (c == '\\') {
-            oss << c;
+            res += c;
             is >> c;
         } else if (c == '"') {
-            return oss.str();
+            return res;
         }
 
-        oss << c;
+        res += c;
     }
 
     throw InvalidInputException();
@@ -0,0 +1,136 @@
+#include "Value.h"
+
+#include "exception/ArithmeticException.h"
+#include "exception/DependencyLoopException.h"
+#include "exception/InvalidTypeException.h"
+
+using namespace std;
+
+Value::Value(const string &val)
+    : m_Kind(Kind::STRING)
+{
+    new (&m_String) shared_ptr<const Rope>(make_shared<Rope>(val));
+}
+
+Value::Value(string &&val)
+    : m_Kind(Kind::STRING)
+{
+    new (&m_String) shared_ptr<const Rope>(make_shared<Rope>(move(val)));
+}
+
+Value::Value(shared_ptr<const Rope> val)
+    : m_Kind(Kind::STRING)
+{
+    new (&m_String) shared_ptr<const Rope>(move(val));
+}
+
+Value Value::error(Error error)
+{
+    Value val;
+    val.m_Kind = Kind::ERROR;
+    val.m_Error = error;
+
+    return val;
+}
+
+Value Value::fromString(const string &val, TypeTag type, bool isLiteral)
+{
+    switch (type) {
+    case TypeTag::INT:
+        return Value(Type<int>::fromString(val, isLiteral));
+    case TypeTag::DOUBLE:
+        return Value(Type<double>::fromString(val, isLiteral));
+    case TypeTag::STRING:
+        return Value(Type<string>::fromString(val, isLiteral));
+    }
+
+    throw InvalidTypeException();
+}
+
+string Value::getString() const
+{
+    return m_String->flatten();
+}
+
+Value Value::convertOther(TypeTag type) const
+{
+    switch (m_Kind) {
+    case Kind::ERROR:
+        return *this;
+    case Kind::EMPTY:
+        return type == TypeTag::STRING ? Value(Type<string>::defaultValue) : error(Error::TYPE);
+    case Kind::INT:
+        if (type == TypeTag::DOUBLE) {
+            return Value((double) m_Int);
+        }
+
+        return type == TypeTag::INT ? *this : error(Error::TYPE);
+    case Kind::DOUBLE:
+        return type == TypeTag::DOUBLE ? *this : error(Error::TYPE);
+    case Kind::STRING:
+        return type == TypeTag::STRING ? *this : error(Error::TYPE);
+    }
+
+    return error(Error::TYPE);
+}
+
+string Value::toString(bool isLiteral) const
+{
+    switch (m_Kind) {
+    case Kind::EMPTY:
+        return isLiteral ? "\"\"" : "";
+    case Kind::INT:
+        return Type<int>::toString(m_Int, isLiteral);
+    case Kind::DOUBLE:
+        return Type<double>::toString(m_Double, isLiteral);
+    case Kind::STRING:
+        return Type<string>::toString(m_String->flatten(), isLiteral);
+    case Kind::ERROR:
+        break;
+    }
+
+    return "#ERROR";
+}
+
+void Value::throwIfError() const
+{
+    if (m_Kind != Kind::ERROR) {
+        return;
+    }
+
+    switch (m_Error) {
+    case Error::TYPE:
+        throw InvalidTypeException();
+    case Error::LOOP:
+        throw DependencyLoopException();
+    case Error::DIV_ZERO:
+        throw ArithmeticException();
+    }
+}
+
+bool Value::operator==(const Value &rhs) const
+{
+    if (m_Kind != rhs.m_Kind) {
+        return false;
+    }
+
+    switch (m_Kind) {
+    case Kind::EMPTY:
+        return true;
+    case Kind::INT:
+        return m_Int == rhs.m_Int;
+    case Kind::DOUBLE:
+        return m_Double == rhs.m_Double;
+    case Kind::STRING:
+        return m_String == rhs.m_String || *m_String == *rhs.m_String;
+    case Kind::ERROR:
+        return m_Error == rhs.m_Error;
+    }
+
+    return false;
+}
+
+bool Value::operator!=(const Value &rhs) const
+{
+    return !(*this == rhs);
+}
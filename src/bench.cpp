@@ -0,0 +1,493 @@
+/**
+ * Benchmarks of the sheet's internals. Run by make bench; build with OPTFLAGS=-O2 for
+ * meaningful numbers.
+ *
+ * USAGE:
+ *     spreadsheet_bench [<benchmark>...]
+ *
+ *     Runs the given benchmarks, all of them by default.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <malloc.h>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "DependencyGraph.h"
+#include "Sheet.h"
+
+using namespace std;
+
+/**
+ * Number of heap allocations made through operator new.
+ */
+static atomic<size_t> allocations(0);
+
+void *operator new(size_t size)
+{
+    ++allocations;
+
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw bad_alloc();
+    }
+
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+/**
+ * @return Seconds the function took.
+ */
+static double measure(const function<void()> &fn)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    fn();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Building the dependency graph: per-cell insertion vs one bulk pass, compared to a hash map
+ * of hash sets keyed by addresses. Then visiting all dependents of all cells.
+ */
+static void benchDependencyGraph()
+{
+    const int cells = 1000000;
+
+    mt19937 random(1);
+    uniform_int_distribution<int> col(1, 10), row(1, cells / 10);
+
+    vector<pair<Address, Address>> pairs;
+    vector<pair<Address, AddressList>> precedents;
+    pairs.reserve(cells * 3);
+    precedents.reserve(cells);
+
+    for (int i = 0; i < cells; ++i) {
+        Address addr(1 + i % 10, 1 + i / 10);
+        precedents.emplace_back(addr, AddressList());
+
+        for (int j = 0; j < 3; ++j) {
+            pairs.emplace_back(Address(col(random), row(random)), addr);
+            precedents.back().second.push_back(pairs.back().first);
+        }
+    }
+
+    printf("dependency graph, %zu edges:\n", pairs.size());
+
+    unordered_map<Address, unordered_set<Address>> index;
+    double hashSets = measure([&]() {
+        for (const pair<Address, Address> &dep : pairs) {
+            index[dep.first].insert(dep.second);
+        }
+    });
+    printf("  per-edge, hash map of hash sets        %8.3f s\n", hashSets);
+
+    double perCell = measure([&]() {
+        DependencyGraph graph;
+        for (const pair<Address, AddressList> &cell : precedents) {
+            graph.setPrecedents(cell.first, cell.second);
+        }
+    });
+    printf("  per-cell, DependencyGraph::setPrecedents %6.3f s\n", perCell);
+
+    DependencyGraph graph;
+    double bulk = measure([&]() {
+        graph.addAll(pairs);
+    });
+    printf("  bulk, DependencyGraph::addAll          %8.3f s\n", bulk);
+
+    size_t visited = 0;
+    double hashSetsVisit = measure([&]() {
+        for (const pair<Address, AddressList> &cell : precedents) {
+            unordered_map<Address, unordered_set<Address>>::const_iterator it =
+                index.find(cell.first);
+
+            if (it != index.end()) {
+                for (const Address &dependent : it->second) {
+                    visited += dependent.row() & 1;
+                }
+            }
+        }
+    });
+    printf("  visit dependents, hash sets            %8.3f s\n", hashSetsVisit);
+
+    double graphVisit = measure([&]() {
+        for (DependencyGraph::Id id = 0; id < (DependencyGraph::Id) cells; ++id) {
+            pair<const DependencyGraph::Id *, const DependencyGraph::Id *> range =
+                graph.getDependents(id);
+
+            for (const DependencyGraph::Id *it = range.first; it != range.second; ++it) {
+                visited += *it & 1;
+            }
+        }
+    });
+    printf("  visit dependents, DependencyGraph IDs  %8.3f s\n", graphVisit);
+
+    /* keeps the loops from being optimized out */
+    if (visited == 0) {
+        printf("  nothing visited\n");
+    }
+}
+
+/**
+ * Evaluating formulas full of links, repeatedly, with no edits in between.
+ */
+static void benchLinkEvaluation()
+{
+    const int cells = 2000;
+    const int rounds = 200;
+
+    Sheet sheet;
+
+    for (int row = 1; row <= cells; ++row) {
+        sheet.setCellType<int>(Address(1, row));
+        sheet.setCellContent(Address(1, row), to_string(row));
+
+        string formula = "=";
+        for (int i = 0; i < 8; ++i) {
+            formula += (i > 0 ? "+" : "") + (string) Address(1, (row + i * 97) % cells + 1);
+        }
+
+        sheet.setCellType<int>(Address(2, row));
+        sheet.setCellContent(Address(2, row), formula);
+    }
+
+    vector<shared_ptr<const CellBase>> formulas;
+    for (int row = 1; row <= cells; ++row) {
+        formulas.push_back(sheet.getCell(Address(2, row)));
+    }
+
+    size_t length = 0;
+    double seconds = measure([&]() {
+        for (int round = 0; round < rounds; ++round) {
+            for (const shared_ptr<const CellBase> &cell : formulas) {
+                length += cell->getContentText().length();
+            }
+        }
+    });
+
+    printf("link evaluation, %d links:\n", cells * rounds * 8);
+    printf("  evaluate                               %8.3f s\n", seconds);
+
+    if (length == 0) {
+        printf("  nothing evaluated\n");
+    }
+}
+
+/**
+ * Editing the head of a long chain of formulas, A2 = A1+1 and so on: the edit itself, which
+ * invalidates the whole chain, then evaluating its tail again.
+ */
+static void benchChainEdit()
+{
+    const int length = 200000;
+    const int rounds = 20;
+
+    Sheet sheet;
+
+    vector<shared_ptr<CellBase>> chain;
+    chain.push_back(make_shared<Cell>(sheet, Address(1, 1), TypeTag::INT, "0"));
+    for (int row = 2; row <= length; ++row) {
+        chain.push_back(make_shared<Cell>(sheet, Address(1, row), TypeTag::INT,
+                                          "=A" + to_string(row - 1) + "+1"));
+    }
+
+    double load = measure([&]() {
+        sheet.setCells(chain);
+    });
+
+    Address tail(1, length);
+    long long sum = 0;
+
+    double first = measure([&]() {
+        sum += sheet.getCell(tail)->getValue().getInt();
+    });
+
+    double edit = 0, evaluate = 0;
+    for (int round = 1; round <= rounds; ++round) {
+        edit += measure([&]() {
+            sheet.setCellContent(Address(1, 1), to_string(round));
+        });
+        evaluate += measure([&]() {
+            sum += sheet.getCell(tail)->getValue().getInt();
+        });
+    }
+
+    size_t notified = 0;
+    sheet.attachCellContentChangedEvent([&notified](const CellBase &) {
+        ++notified;
+    });
+
+    double notify = measure([&]() {
+        sheet.setCellContent(Address(1, 1), "0");
+    });
+
+    printf("chain edit, %d cells:\n", length);
+    printf("  load                                   %8.3f s\n", load);
+    printf("  first evaluation of the tail           %8.3f s\n", first);
+    printf("  edit the head                          %8.3f ms\n", edit / rounds * 1000);
+    printf("  evaluate the tail again                %8.3f ms\n", evaluate / rounds * 1000);
+    printf("  edit the head with a listener          %8.3f ms (%zu calls)\n", notify * 1000,
+           notified);
+
+    if (sum == 0) {
+        printf("  nothing evaluated\n");
+    }
+}
+
+/**
+ * Building long strings: along a chain of cells, each appending to the previous one, and by one
+ * formula concatenating many cells. Evaluation and rendering measured separately.
+ */
+static void benchStringConcatenation()
+{
+    const int length = 5000;
+    const int terms = 500;
+    const int rounds = 20;
+    const string piece(10, 'x');
+
+    Sheet sheet;
+
+    vector<shared_ptr<CellBase>> cells;
+    cells.push_back(make_shared<Cell>(sheet, Address(1, 1), TypeTag::STRING, piece));
+    for (int row = 2; row <= length; ++row) {
+        cells.push_back(make_shared<Cell>(sheet, Address(1, row), TypeTag::STRING,
+                                          "=A" + to_string(row - 1) + "+\"" + piece + "\""));
+    }
+
+    string formula = "=\"\"";
+    for (int row = 1; row <= terms; ++row) {
+        cells.push_back(make_shared<Cell>(sheet, Address(2, row), TypeTag::STRING,
+                                          string(100, 'y')));
+        formula += "+B" + to_string(row);
+    }
+    cells.push_back(make_shared<Cell>(sheet, Address(3, 1), TypeTag::STRING, formula));
+
+    sheet.setCells(cells);
+
+    size_t size = 0;
+
+    double chain = measure([&]() {
+        size += sheet.getCell(Address(1, length))->getValue().getRope()->length();
+    });
+
+    double chainText = measure([&]() {
+        size += sheet.getCell(Address(1, length))->getContentText().length();
+    });
+
+    double concatenation = 0;
+    for (int round = 0; round < rounds; ++round) {
+        sheet.setCellContent(Address(2, 1), string(100, 'z'));
+
+        concatenation += measure([&]() {
+            size += sheet.getCell(Address(3, 1))->getContentText().length();
+        });
+    }
+
+    printf("string concatenation:\n");
+    printf("  chain of %d cells, evaluate         %8.3f s\n", length, chain);
+    printf("  chain of %d cells, render           %8.3f s\n", length, chainText);
+    printf("  %d terms, evaluate and render       %8.3f ms\n", terms,
+           concatenation / rounds * 1000);
+
+    if (size == 0) {
+        printf("  nothing evaluated\n");
+    }
+}
+
+/**
+ * Loading a sheet of literals and formulas, counting heap allocations, and destroying it.
+ */
+static void benchSheetLifetime()
+{
+    const int rows = 100000;
+
+    ostringstream os;
+    os << '[';
+
+    for (int row = 1; row <= rows; ++row) {
+        os << (row > 1 ? "," : "")
+           << "{\"type\":\"int\",\"addr\":\"A" << row << "\",\"content\":\"" << row << "\"},"
+           << "{\"type\":\"double\",\"addr\":\"B" << row << "\",\"content\":\"" << row << ".5\"},"
+           << "{\"type\":\"double\",\"addr\":\"C" << row << "\",\"content\":\"=A" << row
+           << "*B" << row << "+1\"}";
+    }
+
+    os << ']';
+
+    istringstream is(os.str());
+    shared_ptr<Sheet> sheet;
+
+    size_t before = allocations;
+    double load = measure([&]() {
+        sheet = Sheet::deserialize(is);
+    });
+    size_t loadAllocations = allocations - before;
+
+    double destroy = measure([&]() {
+        sheet.reset();
+    });
+
+    printf("sheet lifetime, %d cells:\n", rows * 3);
+    printf("  load                                   %8.3f s (%zu allocations)\n", load,
+           loadAllocations);
+    printf("  destroy                                %8.3f s\n", destroy);
+}
+
+/**
+ * Serializing a sheet of formulas, most of them repeated, and reading their sources the way
+ * the prompt does.
+ */
+static void benchFormulaSources()
+{
+    const int rows = 100000;
+
+    Sheet sheet;
+    vector<shared_ptr<CellBase>> cells;
+
+    for (int row = 1; row <= rows; ++row) {
+        cells.push_back(Cell::make(sheet, Address(1, row), TypeTag::DOUBLE,
+                                   "=ABS(SIN(1.5)*3-COS(0.25))/(2+TAN(0.5))"));
+        cells.push_back(Cell::make(sheet, Address(2, row), TypeTag::DOUBLE,
+                                   "=A" + to_string(row) + "*2.5+1"));
+    }
+
+    sheet.setCells(cells);
+    cells.clear();
+
+    double serialize = measure([&]() {
+        ostringstream os;
+        sheet.serialize(os);
+    });
+
+    size_t length = 0;
+    double sources = measure([&]() {
+        for (int row = 1; row <= rows; ++row) {
+            length += sheet.getCell(Address(1, row))->getContentSource().length();
+        }
+    });
+
+    printf("formula sources, %d cells:\n", rows * 2);
+    printf("  serialize                              %8.3f s\n", serialize);
+    printf("  getContentSource of %d cells       %8.3f s (%zu chars)\n", rows, sources, length);
+}
+
+/**
+ * @return Bytes of the heap in use.
+ */
+static size_t heapInUse()
+{
+    struct mallinfo2 info = mallinfo2();
+
+    return info.uordblks + info.hblkhd;
+}
+
+/**
+ * Memory taken by a sheet of number literals, per cell, including all containers.
+ */
+static void benchCellMemory()
+{
+    const int cols = 10, rows = 100000;
+
+    ostringstream os;
+    os << '[';
+
+    for (int row = 1; row <= rows; ++row) {
+        for (int col = 1; col <= cols; ++col) {
+            os << (row > 1 || col > 1 ? "," : "") << "{\"type\":\""
+               << (col % 2 ? "int" : "double") << "\",\"addr\":\"" << (string) Address(col, row)
+               << "\",\"content\":\"" << row << (col % 2 ? "" : ".25") << "\"}";
+        }
+    }
+
+    os << ']';
+
+    istringstream is(os.str());
+
+    size_t before = heapInUse();
+    shared_ptr<Sheet> sheet = Sheet::deserialize(is);
+    size_t bytes = heapInUse() - before;
+
+    printf("cell memory, %d number literal cells:\n", cols * rows);
+    printf("  sheet                                  %8.1f MiB\n", bytes / 1048576.0);
+    printf("  per cell                               %8.1f B\n", (double) bytes / (cols * rows));
+}
+
+/**
+ * Loading a sheet full of formulas, which is dominated by parsing them.
+ */
+static void benchFormulaParsing()
+{
+    const int cells = 20000;
+
+    ostringstream os;
+    os << '[';
+
+    for (int row = 1; row <= cells; ++row) {
+        os << (row > 1 ? "," : "") << "{\"type\":\"double\",\"addr\":\"" << (string) Address(1, row)
+           << "\",\"content\":\"=ABS(B" << row << "*2.5-C" << row << ")+SIN(1)/3\"}";
+    }
+
+    os << ']';
+
+    istringstream is(os.str());
+    shared_ptr<Sheet> sheet;
+
+    double seconds = measure([&]() {
+        sheet = Sheet::deserialize(is);
+    });
+
+    printf("formula parsing, %d formulas:\n", cells);
+    printf("  deserialize                            %8.3f s\n", seconds);
+}
+
+int main(int argc, char *argv[])
+{
+    map<string, function<void()>> benchmarks = {
+        {"cell-memory", benchCellMemory},
+        {"chain-edit", benchChainEdit},
+        {"dependency-graph", benchDependencyGraph},
+        {"formula-parsing", benchFormulaParsing},
+        {"formula-sources", benchFormulaSources},
+        {"link-evaluation", benchLinkEvaluation},
+        {"sheet-lifetime", benchSheetLifetime},
+        {"string-concatenation", benchStringConcatenation},
+    };
+
+    vector<string> names(argv + 1, argv + argc);
+    if (names.empty()) {
+        for (const auto &entry : benchmarks) {
+            names.push_back(entry.first);
+        }
+    }
+
+    for (const string &name : names) {
+        map<string, function<void()>>::const_iterator it = benchmarks.find(name);
+        if (it == benchmarks.end()) {
+            fprintf(stderr, "unknown benchmark %s\n", name.c_str());
+            return 2;
+        }
+
+        it->second();
+    }
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include "Sheet.h"
+
+using namespace std;
+
+namespace Formula
+{
+    Value Link::evaluate(const Sheet &sheet)
+    {
+        /* holds the cell while evaluating if it is not resolved */
+        shared_ptr<const CellBase> linkedCellBase;
+
+        if (sheet.isValid(m_Target)) {
+            SheetCounters::increment(sheet.getCounters().linkHits);
+        } else {
+            SheetCounters::increment(sheet.getCounters().linkMisses);
+            linkedCellBase = sheet.resolveCell(m_Addr, m_Target);
+        }
+
+        const CellBase *linkedCell = m_Target.cell;
+
+        /* number literal or empty cell */
+        if (linkedCell == nullptr) {
+            return m_Target.value.convert(m_Type);
+        }
+
+        Value res = linkedCell->getValue();
+
+        /* cells' values are of their types already */
+        if (linkedCell->getTag() == m_Type) {
+            return res;
+        }
+
+        return res.convert(m_Type);
+    }
+}
@@ -1,94 +1,265 @@
 #include "Sheet.h"
 
-#include <regex>
-
-#include "exception/InvalidInputException.h"
+#include <cctype>
 
 using namespace std;
 
 namespace Formula
 {
-    bool Parser::isLink(const string &source)
+    /**
+     * @return Whether source[begin, end) consists of digits only, at least one.
+     */
+    static bool isDigits(const string &source, size_t begin, size_t end)
     {
-        return regex_match(source, regex("^[a-zA-Z]+[1-9][0-9]*$"));
+        if (begin >= end) {
+            return false;
+        }
+
+        for (size_t i = begin; i < end; ++i) {
+            if (!isdigit((unsigned char) source[i])) {
+                return false;
+            }
+        }
+
+        return true;
     }
 
-    template<>
-    bool Parser::isLiteral<int>(const string &source)
+    /**
+     * @return Position of the first non-whitespace character in source[pos, end), or end.
+     */
+    static size_t skipSpaces(const string &source, size_t pos, size_t end)
     {
-        return regex_match(source, regex("^[0-9]+$"));
+        while (pos < end && isspace((unsigned char) source[pos])) {
+            ++pos;
+        }
+
+        return pos;
     }
 
-    template<>
-    bool Parser::isLiteral<double>(const string &source)
+    /**
+     * @return Whether source[begin, end) equals the lower case name, case-insensitively.
+     */
+    static bool isName(const string &source, size_t begin, size_t end, const char *name)
     {
-        /* int to double implicit conversion */
-        return regex_match(source, regex("^[0-9]*\\.[0-9]+$")) || isLiteral<int>(source);
+        for (size_t i = begin; i < end; ++i, ++name) {
+            if (*name == '\0' || tolower((unsigned char) source[i]) != *name) {
+                return false;
+            }
+        }
+
+        return *name == '\0';
     }
 
-    template<>
-    bool Parser::isLiteral<string>(const string &source)
+    bool Parser::isLink(const string &source, size_t begin, size_t end)
     {
-        return regex_match(source, regex("^\"([^\"\\\\]|\\\\.)*\"$"));
+        /* [a-zA-Z]+[1-9][0-9]* */
+        size_t i = begin;
+        while (i < end && isalpha((unsigned char) source[i])) {
+            ++i;
+        }
+
+        return i > begin && i < end && source[i] != '0' && isDigits(source, i, end);
     }
 
-    vector<string> Parser::splitLogical(const string &source, const string &separators)
+    bool Parser::parseLiteral(
+        const string &source,
+        size_t begin,
+        size_t end,
+        TypeTag type,
+        Value &value)
     {
-        vector<string> res;
-        istringstream source_iss(source);
-        char c;
+        switch (type) {
+        case TypeTag::INT:
+            /* [0-9]+ */
+            if (!isDigits(source, begin, end)) {
+                return false;
+            }
+            break;
 
-        string cur = "";
+        case TypeTag::DOUBLE: {
+            /* [0-9]*\.[0-9]+ or int to double implicit conversion */
+            size_t dot = source.find('.', begin);
+            if (dot >= end ? !isDigits(source, begin, end) :
+                (!isDigits(source, dot + 1, end) ||
+                 (dot > begin && !isDigits(source, begin, dot)))) {
+                return false;
+            }
+            break;
+        }
 
-        auto pushCur = [&]() {
-            if (cur.size() >= 2 && cur[0] == '(' && cur[cur.size() - 1] == ')') {
-                cur = cur.substr(1, cur.size() - 2);
+        case TypeTag::STRING:
+            /* "([^"\\]|\\.)*" */
+            if (end - begin < 2 || source[begin] != '"' || source[end - 1] != '"') {
+                return false;
             }
 
-            if (cur.size() > 0) {
-                res.push_back(cur);
-                cur.clear();
+            for (size_t i = begin + 1; i < end - 1; ++i) {
+                if (source[i] == '"') {
+                    return false;
+                }
+
+                if (source[i] == '\\' && ++i == end - 1) {
+                    return false;
+                }
             }
-        };
+            break;
+        }
+
+        value = Value::fromString(source.substr(begin, end - begin), type, true);
+        return true;
+    }
 
+    size_t Parser::findOperandEnd(const string &source, size_t pos, size_t end)
+    {
         int logicalLevel = 0; /* how deep in nested parentheses we are */
 
-        source_iss >> c;
-        while (!source_iss.eof()) {
-            if (separators.find(c) != string::npos && logicalLevel == 0) {
-                /* we've found separator and we're at root level */
-                pushCur();
-                res.push_back(string(1, c));
-
-                source_iss >> c;
-                continue;
-            } else if (c == '"') {
-                if (!cur.empty()) {
-                    throw IncorrectFormulaSyntaxException();
-                }
+        for (; pos < end; ++pos) {
+            char c = source[pos];
 
-                try {
-                    cur = string(1, '"') + Utils::readString(source_iss) + '"';
-                    source_iss >> noskipws;
-                    pushCur();
+            if (c == '"') {
+                /* skip the string literal, its closing quote included */
+                for (++pos; pos < end && source[pos] != '"'; ++pos) {
+                    if (source[pos] == '\\') {
+                        ++pos;
+                    }
+                }
 
-                    source_iss >> c;
-                    continue;
-                } catch (const InvalidInputException &ex) {
+                if (pos >= end) {
                     throw IncorrectFormulaSyntaxException();
                 }
             } else if (c == '(') {
                 ++logicalLevel;
             } else if (c == ')') {
-                --logicalLevel;
+                if (--logicalLevel < 0) {
+                    throw IncorrectFormulaSyntaxException();
+                }
+            } else if (logicalLevel == 0 &&
+                       (c == '+' || c == '-' || c == '*' || c == '/' || c == ',' ||
+                        isspace((unsigned char) c))) {
+                break;
             }
+        }
 
-            cur += c;
-            source_iss >> c;
+        if (logicalLevel != 0) {
+            throw IncorrectFormulaSyntaxException();
         }
 
-        pushCur();
+        return pos;
+    }
+
+    unique_ptr<Function> Parser::parseExpression(
+        const string &source,
+        size_t begin,
+        size_t end,
+        TypeTag type,
+        AddressList &dependencies,
+        Pool &pool)
+    {
+        size_t pos = skipSpaces(source, begin, end);
+        size_t operandEnd = findOperandEnd(source, pos, end);
+
+        unique_ptr<Function> res = parseOperand(source, pos, operandEnd, type, dependencies, pool);
+
+        pos = skipSpaces(source, operandEnd, end);
+
+        while (pos < end) {
+            char op = source[pos];
+
+            pos = skipSpaces(source, pos + 1, end);
+            operandEnd = findOperandEnd(source, pos, end);
+
+            unique_ptr<Function> arg1 = move(res);
+            unique_ptr<Function> arg2 =
+                parseOperand(source, pos, operandEnd, type, dependencies, pool);
+
+            switch (op) {
+            case '+':
+                res = unique_ptr<Function>(new (pool) Add(move(arg1), move(arg2)));
+                break;
+            case '-':
+                res = unique_ptr<Function>(new (pool) Sub(move(arg1), move(arg2)));
+                break;
+            case '*':
+                res = unique_ptr<Function>(new (pool) Mul(move(arg1), move(arg2)));
+                break;
+            case '/':
+                res = unique_ptr<Function>(new (pool) Div(move(arg1), move(arg2)));
+                break;
+            default:
+                throw IncorrectFormulaSyntaxException();
+            }
+
+            pos = skipSpaces(source, operandEnd, end);
+        }
 
         return res;
     }
+
+    unique_ptr<Function> Parser::parseOperand(
+        const string &source,
+        size_t begin,
+        size_t end,
+        TypeTag type,
+        AddressList &dependencies,
+        Pool &pool)
+    {
+        if (begin >= end) {
+            throw IncorrectFormulaSyntaxException();
+        }
+
+        /* literal */
+        Value value;
+        if (parseLiteral(source, begin, end, type, value)) {
+            return unique_ptr<Function>(new (pool) Literal(value));
+        }
+
+        /* link */
+        if (isLink(source, begin, end)) {
+            Address addr = source.substr(begin, end - begin);
+            dependencies.push_back(addr);
+            return unique_ptr<Function>(new (pool) Link(addr, type));
+        }
+
+        if (source[end - 1] != ')') {
+            throw IncorrectFormulaSyntaxException();
+        }
+
+        /* nested expression */
+        if (source[begin] == '(') {
+            return parseExpression(source, begin + 1, end - 1, type, dependencies, pool);
+        }
+
+        /* function */
+        size_t parenthesesPos = source.find('(', begin);
+
+        unique_ptr<Function> arg =
+            parseExpression(source, parenthesesPos + 1, end - 1, type, dependencies, pool);
+
+        if (isName(source, begin, parenthesesPos, "abs")) {
+            return unique_ptr<Function>(new (pool) Abs(move(arg)));
+        }
+
+        if (isName(source, begin, parenthesesPos, "sin")) {
+            return unique_ptr<Function>(new (pool) Sin(move(arg)));
+        }
+
+        if (isName(source, begin, parenthesesPos, "cos")) {
+            return unique_ptr<Function>(new (pool) Cos(move(arg)));
+        }
+
+        if (isName(source, begin, parenthesesPos, "tan")) {
+            return unique_ptr<Function>(new (pool) Tan(move(arg)));
+        }
+
+        throw IncorrectFormulaSyntaxException();
+    }
+
+    unique_ptr<Function> Parser::parseSource(
+        const string &source,
+        TypeTag type,
+        AddressList &dependencies,
+        Pool &pool)
+    {
+        return parseExpression(source, 0, source.length(), type, dependencies, pool);
+    }
 }
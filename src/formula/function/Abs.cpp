@@ -6,15 +6,19 @@ using namespace std;
 
 namespace Formula
 {
-    template<>
-    int Abs<int>::evaluate(const Sheet &sheet)
+    Value Abs::evaluate(const Sheet &sheet)
     {
-        return abs(this->m_Arg->evaluate(sheet));
-    }
+        Value arg = m_Arg->evaluate(sheet);
 
-    template<>
-    double Abs<double>::evaluate(const Sheet &sheet)
-    {
-        return abs(this->m_Arg->evaluate(sheet));
+        switch (arg.getKind()) {
+        case Value::Kind::INT:
+            return Value(abs(arg.getInt()));
+        case Value::Kind::DOUBLE:
+            return Value(abs(arg.getDouble()));
+        case Value::Kind::ERROR:
+            return arg;
+        default:
+            return Value::error(Value::Error::TYPE);
+        }
     }
 }
@@ -4,21 +4,30 @@ using namespace std;
 
 namespace Formula
 {
-    template<>
-    int Add<int>::evaluate(const Sheet &sheet)
+    Value Add::evaluate(const Sheet &sheet)
     {
-        return this->m_Arg1->evaluate(sheet) + this->m_Arg2->evaluate(sheet);
-    }
+        Value arg1 = m_Arg1->evaluate(sheet);
+        if (arg1.isError()) {
+            return arg1;
+        }
 
-    template<>
-    double Add<double>::evaluate(const Sheet &sheet)
-    {
-        return this->m_Arg1->evaluate(sheet) + this->m_Arg2->evaluate(sheet);
-    }
+        Value arg2 = m_Arg2->evaluate(sheet);
+        if (arg2.isError()) {
+            return arg2;
+        }
 
-    template<>
-    string Add<string>::evaluate(const Sheet &sheet)
-    {
-        return this->m_Arg1->evaluate(sheet) + this->m_Arg2->evaluate(sheet);
+        if (arg1.getKind() == Value::Kind::INT && arg2.getKind() == Value::Kind::INT) {
+            return Value(arg1.getInt() + arg2.getInt());
+        }
+
+        if (arg1.isNumber() && arg2.isNumber()) {
+            return Value(arg1.toDouble() + arg2.toDouble());
+        }
+
+        if (arg1.getKind() == Value::Kind::STRING && arg2.getKind() == Value::Kind::STRING) {
+            return Value(Rope::concat(arg1.getRope(), arg2.getRope()));
+        }
+
+        return Value::error(Value::Error::TYPE);
     }
 }
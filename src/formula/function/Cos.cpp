@@ -6,15 +6,19 @@ using namespace std;
 
 namespace Formula
 {
-    template<>
-    int Cos<int>::evaluate(const Sheet &sheet)
+    Value Cos::evaluate(const Sheet &sheet)
     {
-        return round(cos(this->m_Arg->evaluate(sheet)));
-    }
+        Value arg = m_Arg->evaluate(sheet);
 
-    template<>
-    double Cos<double>::evaluate(const Sheet &sheet)
-    {
-        return cos(this->m_Arg->evaluate(sheet));
+        switch (arg.getKind()) {
+        case Value::Kind::INT:
+            return Value((int) round(cos(arg.getInt())));
+        case Value::Kind::DOUBLE:
+            return Value(cos(arg.getDouble()));
+        case Value::Kind::ERROR:
+            return arg;
+        default:
+            return Value::error(Value::Error::TYPE);
+        }
     }
 }
@@ -4,15 +4,30 @@ using namespace std;
 
 namespace Formula
 {
-    template<>
-    int Div<int>::evaluate(const Sheet &sheet)
+    Value Div::evaluate(const Sheet &sheet)
     {
-        return this->m_Arg1->evaluate(sheet) / this->m_Arg2->evaluate(sheet);
-    }
+        Value arg1 = m_Arg1->evaluate(sheet);
+        if (arg1.isError()) {
+            return arg1;
+        }
 
-    template<>
-    double Div<double>::evaluate(const Sheet &sheet)
-    {
-        return this->m_Arg1->evaluate(sheet) / this->m_Arg2->evaluate(sheet);
+        Value arg2 = m_Arg2->evaluate(sheet);
+        if (arg2.isError()) {
+            return arg2;
+        }
+
+        if (arg1.getKind() == Value::Kind::INT && arg2.getKind() == Value::Kind::INT) {
+            if (arg2.getInt() == 0) {
+                return Value::error(Value::Error::DIV_ZERO);
+            }
+
+            return Value(arg1.getInt() / arg2.getInt());
+        }
+
+        if (arg1.isNumber() && arg2.isNumber()) {
+            return Value(arg1.toDouble() / arg2.toDouble());
+        }
+
+        return Value::error(Value::Error::TYPE);
     }
 }
@@ -6,15 +6,19 @@ using namespace std;
 
 namespace Formula
 {
-    template<>
-    int Sin<int>::evaluate(const Sheet &sheet)
+    Value Sin::evaluate(const Sheet &sheet)
     {
-        return round(sin(this->m_Arg->evaluate(sheet)));
-    }
+        Value arg = m_Arg->evaluate(sheet);
 
-    template<>
-    double Sin<double>::evaluate(const Sheet &sheet)
-    {
-        return sin(this->m_Arg->evaluate(sheet));
+        switch (arg.getKind()) {
+        case Value::Kind::INT:
+            return Value((int) round(sin(arg.getInt())));
+        case Value::Kind::DOUBLE:
+            return Value(sin(arg.getDouble()));
+        case Value::Kind::ERROR:
+            return arg;
+        default:
+            return Value::error(Value::Error::TYPE);
+        }
     }
 }
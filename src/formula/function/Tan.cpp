@@ -6,15 +6,19 @@ using namespace std;
 
 namespace Formula
 {
-    template<>
-    int Tan<int>::evaluate(const Sheet &sheet)
+    Value Tan::evaluate(const Sheet &sheet)
     {
-        return round(tan(this->m_Arg->evaluate(sheet)));
-    }
+        Value arg = m_Arg->evaluate(sheet);
 
-    template<>
-    double Tan<double>::evaluate(const Sheet &sheet)
-    {
-        return tan(this->m_Arg->evaluate(sheet));
+        switch (arg.getKind()) {
+        case Value::Kind::INT:
+            return Value((int) round(tan(arg.getInt())));
+        case Value::Kind::DOUBLE:
+            return Value(tan(arg.getDouble()));
+        case Value::Kind::ERROR:
+            return arg;
+        default:
+            return Value::error(Value::Error::TYPE);
+        }
     }
 }
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <climits>
+#include <functional>
 
 #include "Serializable.h"
 
@@ -103,4 +104,13 @@ public:
     // todo: with() ...
 };
 
+namespace std
+{
+    template<>
+    struct hash<Address>
+    {
+        size_t operator()(const Address &addr) const;
+    };
+}
+
 #endif /* SPREADSHEET_ADDRESS_H */
@@ -0,0 +1,101 @@
+#ifndef SPREADSHEET_ADDRESS_LIST_H
+#define SPREADSHEET_ADDRESS_LIST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+#include "Address.h"
+
+using namespace std;
+
+/**
+ * List of addresses, e.g. dependencies of a cell. Stores bare coordinates, 8 bytes per address,
+ * and up to INLINE_CAPACITY addresses inside the list itself, so that most formulas need no
+ * allocation for their dependencies.
+ */
+class AddressList
+{
+    static const uint32_t INLINE_CAPACITY = 2;
+
+    struct Coords
+    {
+        int col;
+        int row;
+    };
+
+    uint32_t m_Size = 0;
+
+    uint32_t m_Capacity = INLINE_CAPACITY;
+
+    union
+    {
+        Coords m_Inline[INLINE_CAPACITY];
+        Coords *m_Heap;
+    };
+
+    Coords *data();
+    const Coords *data() const;
+
+    void release();
+
+public:
+    class const_iterator
+    {
+        const Coords *m_Pos;
+
+    public:
+        explicit const_iterator(const Coords *pos)
+            : m_Pos(pos)
+        {}
+
+        Address operator*() const
+        {
+            return Address(m_Pos->col, m_Pos->row);
+        }
+
+        const_iterator &operator++()
+        {
+            ++m_Pos;
+            return *this;
+        }
+
+        bool operator==(const const_iterator &rhs) const
+        {
+            return m_Pos == rhs.m_Pos;
+        }
+
+        bool operator!=(const const_iterator &rhs) const
+        {
+            return m_Pos != rhs.m_Pos;
+        }
+    };
+
+    AddressList();
+    AddressList(initializer_list<Address> addrs);
+    AddressList(const AddressList &other);
+    AddressList(AddressList &&other);
+
+    AddressList &operator=(const AddressList &other);
+    AddressList &operator=(AddressList &&other);
+
+    ~AddressList();
+
+    void push_back(const Address &addr);
+
+    void clear();
+
+    size_t size() const;
+
+    bool empty() const;
+
+    Address operator[](size_t i) const;
+
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    bool operator==(const AddressList &rhs) const;
+    bool operator!=(const AddressList &rhs) const;
+};
+
+#endif /* SPREADSHEET_ADDRESS_LIST_H */
@@ -3,10 +3,12 @@
 
 #include <memory>
 #include <string>
-#include <vector>
 
 #include "Address.h"
+#include "AddressList.h"
 #include "Serializable.h"
+#include "Type.h"
+#include "Value.h"
 
 using namespace std;
 
@@ -30,22 +32,32 @@ protected:
      */
     const Address m_Addr;
 
+    /**
+     * Tag of the cell's type.
+     */
+    const TypeTag m_Tag;
+
     /**
      * Addresses of cells this cell depends on.
      */
-    vector<Address> m_Dependencies;
+    AddressList m_Dependencies;
 
 public:
     /**
-     * Initializes sheet and address.
+     * Initializes sheet, address and type tag.
      */
-    CellBase(const Sheet &sheet, const Address &addr);
+    CellBase(const Sheet &sheet, const Address &addr, TypeTag tag);
 
     /**
      * @return Type name of the cell.
      */
     virtual string getType() const = 0;
 
+    /**
+     * @return Tag of the cell's type. Cheaper than getType() or dynamic_cast.
+     */
+    TypeTag getTag() const;
+
     /**
      * @return The address of this cell.
      */
@@ -54,19 +66,26 @@ public:
     /**
      * @return Addresses of cells this cell depends on.
      */
-    const vector<Address> &getDependencies() const;
+    const AddressList &getDependencies() const;
+
+    /**
+     * @return Evaluated cell's content. Errors are returned as error values.
+     */
+    virtual Value getValue() const = 0;
 
     /**
      * @return Evaluated cell's content converted to string.
      *
      * @throws InvalidTypeException
+     * @throws DependencyLoopException
+     * @throws ArithmeticException
      */
     virtual string getContentText() const = 0;
 
     /**
      * @return Cell's content's source.
      */
-    virtual string getContentSource() const = 0;
+    virtual const string &getContentSource() const = 0;
 
     /**
      * Creates a new cell of the same type, copying the sheet ref and address.
@@ -75,6 +94,21 @@ public:
      */
     virtual shared_ptr<CellBase> create(const string &content) = 0;
 
+    /**
+     * Creates a new cell of the type specified by its name.
+     *
+     * @param sheet Sheet this cell belongs to.
+     *
+     * @throws InvalidInputException Unknown type.
+     * @throws IncorrectFormulaSyntaxException
+     * @throws InvalidTypeException
+     */
+    static shared_ptr<CellBase> fromType(
+        const Sheet &sheet,
+        const string &type,
+        const Address &addr,
+        const string &content);
+
     /**
      * Creates a new CellBase from given input stream in JSON.
      *
@@ -0,0 +1,421 @@
+#ifndef SPREADSHEET_CELL_STORE_H
+#define SPREADSHEET_CELL_STORE_H
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Address.h"
+#include "Pool.h"
+#include "TileFile.h"
+#include "Value.h"
+
+using namespace std;
+
+class CellBase;
+class Sheet;
+
+/**
+ * Storage of the cells of a sheet. Cells are grouped into tiles of TILE_COLS x TILE_ROWS cells.
+ *
+ * NUMBER LITERALS:
+ *     Int and double cells without formulas, usually most of the cells of large sheets, are not
+ *     kept as objects but as 10-byte records of their tiles: the cell's offset within the tile
+ *     and its value. The sheet and the address are implied by the tile. The cell objects are
+ *     created only when they are asked for, by find() or forEach(), and are not kept; scan() and
+ *     the two-function forEach() pass the values instead.
+ *
+ * OUT-OF-CORE MODE:
+ *     If opened with a tile file, only the recently used tiles are kept in memory, within the
+ *     memory budget. Accessing a cell of an evicted tile reads the tile from the file. Modified
+ *     (dirty) tiles are written to the file when they are evicted and on save(). Tiles with
+ *     cells referenced from outside the store (e.g. cells being evaluated) are never evicted,
+ *     so the budget may be exceeded temporarily. Memory of a tile is estimated from the number
+ *     of its cells and the length of their sources.
+ *
+ * OCCUPANCY:
+ *     Every tile has a bitmap of its non-empty cells, kept even while the tile is not loaded,
+ *     and the tiles are indexed by their bands of columns and rows. So the nearest non-empty
+ *     (or empty) cell in a direction is found by skipping missing tiles and whole words
+ *     of bits, without looking up any cells.
+ */
+class CellStore
+{
+    static const int TILE_COLS = 16;
+    static const int TILE_ROWS = 256;
+
+    /**
+     * Estimated memory taken by a cell (objects, formula, map node) apart from its source.
+     */
+    static const size_t CELL_OVERHEAD = 192;
+
+    /**
+     * Memory taken by a number literal record.
+     */
+    static const size_t LITERAL_SIZE = sizeof(uint16_t) + sizeof(uint64_t);
+
+    typedef unordered_map<
+        Address,
+        shared_ptr<CellBase>,
+        hash<Address>,
+        equal_to<Address>,
+        PoolAllocator<pair<const Address, shared_ptr<CellBase>>>> CellMap;
+
+    struct Tile
+    {
+        /**
+         * Cells of the tile stored as objects, in the pool of the sheet. Empty if the tile is not
+         * loaded.
+         */
+        CellMap cells;
+
+        /**
+         * Number literal cells of the tile, empty if the tile is not loaded. Keys are offsets
+         * of the cells within the tile shifted left by one, with the lowest bit set for
+         * doubles. Sorted, so that cells are found by binary search. Values (bits of the int
+         * or the double) are at the same positions as their keys.
+         */
+        vector<uint16_t> literalKeys;
+        vector<uint64_t> literalValues;
+
+        /**
+         * Number of cells, even if the tile is not loaded.
+         */
+        size_t count = 0;
+
+        /**
+         * Estimated memory taken by the cells.
+         */
+        size_t bytes = 0;
+
+        bool loaded = true;
+
+        /**
+         * Whether the tile differs from its version in the tile file.
+         */
+        bool dirty = false;
+
+        /**
+         * Position in m_Lru, if the tile is loaded.
+         */
+        list<uint64_t>::iterator lru;
+
+        /**
+         * Non-empty cells, column by column: bit r % 64 of word r / 64 of column c is set if
+         * there is a cell at column c and row r within the tile. Kept while the tile is not
+         * loaded.
+         */
+        uint64_t occupied[TILE_COLS][TILE_ROWS / 64] = {};
+
+        /**
+         * Whether occupied is known. Tiles of a tile file are not until loaded for the first
+         * time.
+         */
+        bool indexed = true;
+
+        Tile(const shared_ptr<Pool> &pool)
+            : cells(0, hash<Address>(), equal_to<Address>(), CellMap::allocator_type(pool))
+        {}
+    };
+
+    const Sheet &m_Sheet;
+
+    /**
+     * Tile file, if the store is out-of-core.
+     */
+    unique_ptr<TileFile> m_File;
+
+    size_t m_MemoryBudget = 0;
+
+    /**
+     * All non-empty tiles, loaded or not.
+     */
+    mutable unordered_map<uint64_t, Tile> m_Tiles;
+
+    /**
+     * Keys of loaded tiles, the most recently used first. Maintained only in out-of-core mode.
+     */
+    mutable list<uint64_t> m_Lru;
+
+    /**
+     * Estimated memory taken by the loaded tiles.
+     */
+    mutable size_t m_LoadedBytes = 0;
+
+    size_t m_Size = 0;
+
+    /**
+     * Keys of all tiles, ordered by their column band, then row band (as the keys are).
+     */
+    set<uint64_t> m_TilesByCol;
+
+    /**
+     * Keys of all tiles with their halves swapped, ordered by their row band, then column band.
+     */
+    set<uint64_t> m_TilesByRow;
+
+    /**
+     * Numbers of cells of the non-empty columns, in indexed tiles.
+     */
+    mutable map<int, size_t> m_ColumnCells;
+
+    /**
+     * Number of tiles whose occupancy is not known yet.
+     */
+    mutable size_t m_Unindexed = 0;
+
+    static uint64_t tileKey(const Address &addr);
+
+    /**
+     * @return The key with its column band and row band swapped, see m_TilesByRow.
+     */
+    static uint64_t swapKey(uint64_t key);
+
+    /**
+     * @return New empty tile with the key.
+     */
+    Tile &createTile(uint64_t key);
+
+    /**
+     * @return Offset of the cell within its tile, row by row.
+     */
+    static uint16_t cellOffset(const Address &addr);
+
+    /**
+     * @return Address of the cell at the offset within the tile with the key.
+     */
+    static Address cellAddress(uint64_t key, uint16_t offset);
+
+    /**
+     * @return Whether the cell is stored as a number literal record.
+     */
+    static bool isNumberLiteral(const CellBase &cell);
+
+    static size_t estimateSize(const CellBase &cell);
+
+    /**
+     * @return Position of the number literal record at the offset within the tile, number of
+     *         the records if there is none.
+     */
+    static size_t findLiteral(const Tile &tile, uint16_t offset);
+
+    static Value literalValue(const Tile &tile, size_t i);
+
+    /**
+     * @return New cell object of the i-th number literal record of the tile with the key.
+     */
+    shared_ptr<CellBase> makeLiteralCell(uint64_t key, const Tile &tile, size_t i) const;
+
+    /**
+     * Adds the cell to the loaded tile, which has no cell at the cell's address.
+     */
+    static void insert(Tile &tile, shared_ptr<CellBase> cell);
+
+    /**
+     * Removes the cell at the address from the loaded tile.
+     *
+     * @param bytes If given, set to the estimated memory taken by the removed cell.
+     *
+     * @return Whether there was a cell.
+     */
+    static bool remove(Tile &tile, const Address &addr, size_t *bytes);
+
+    /**
+     * Drops all cells of the tile from memory.
+     */
+    static void unload(Tile &tile);
+
+    static void setOccupied(Tile &tile, uint16_t offset, bool occupied);
+
+    /**
+     * @param col Column within the tile, 0-based.
+     * @param row Row within the tile, 0-based.
+     */
+    static bool isOccupied(const Tile &tile, int col, int row);
+
+    /**
+     * @return The tile with its occupancy known (loading it if necessary), nullptr if there is
+     *         no such tile.
+     */
+    const Tile *findIndexed(uint64_t key) const;
+
+    /**
+     * Removes the tile, also from the indexes.
+     */
+    void eraseTile(uint64_t key);
+
+    /**
+     * Loads the tile if necessary and marks it as the most recently used.
+     *
+     * @return The tile or nullptr if there is no such tile.
+     */
+    Tile *access(uint64_t key) const;
+
+    /**
+     * Reads the tile from the tile file.
+     */
+    void load(uint64_t key, Tile &tile) const;
+
+    /**
+     * Writes the tile to the tile file, if it's dirty.
+     */
+    void writeBack(uint64_t key, Tile &tile) const;
+
+    /**
+     * Evicts the least recently used tiles until the loaded tiles fit into the budget.
+     *
+     * @param keep Tile which must stay loaded.
+     */
+    void enforceBudget(uint64_t keep) const;
+
+public:
+    static const size_t DEFAULT_MEMORY_BUDGET = (size_t) 256 << 20;
+
+    CellStore() = delete;
+    CellStore(const CellStore &) = delete;
+    CellStore(CellStore &&) = delete;
+
+    /**
+     * Initializes an in-memory store.
+     */
+    CellStore(const Sheet &sheet);
+
+    /**
+     * Makes the store out-of-core, backed by the tile file. Cells already in the file become
+     * the content of the store. Must be called on an empty store.
+     *
+     * @throws IOException
+     * @throws InvalidInputException
+     */
+    void open(const string &filename, size_t memoryBudget = DEFAULT_MEMORY_BUDGET);
+
+    /**
+     * @return Whether the store is backed by a tile file.
+     */
+    bool isOutOfCore() const;
+
+    /**
+     * @return Cell at the address or nullptr. Number literal cells are created anew on every
+     *         call.
+     *
+     * @throws IOException
+     * @throws InvalidInputException
+     */
+    shared_ptr<CellBase> find(const Address &addr) const;
+
+    /**
+     * Finds the cell at the address without creating objects of number literal cells.
+     *
+     * @param literal Set to the value of the number literal cell at the address, an empty value
+     *                if there is no such cell.
+     *
+     * @return Cell at the address if it is stored as an object, nullptr otherwise.
+     *
+     * @throws IOException
+     * @throws InvalidInputException
+     */
+    shared_ptr<CellBase> findObject(const Address &addr, Value &literal) const;
+
+    /**
+     * @return Cell at the address if it is stored as an object, nullptr otherwise, also if its
+     *         tile is not loaded. Never loads a tile.
+     */
+    shared_ptr<CellBase> findLoaded(const Address &addr) const;
+
+    /**
+     * Places the cell at its address, replacing the existing one.
+     */
+    void put(shared_ptr<CellBase> cell);
+
+    /**
+     * Removes the cell at the address, if there is any.
+     */
+    void erase(const Address &addr);
+
+    /**
+     * @return Number of cells.
+     */
+    size_t size() const;
+
+    /**
+     * @return Whether there is a cell at the address. Never loads a tile, unless its occupancy
+     *         is not known yet.
+     */
+    bool contains(const Address &addr) const;
+
+    /**
+     * Finds the nearest cell from the address (exclusive) in the direction that is non-empty,
+     * or empty.
+     *
+     * @param colStep Column direction: 1, -1, or 0 if rowStep is not.
+     * @param rowStep Row direction: 1, -1, or 0 if colStep is not.
+     * @param found Set to the address of the cell, if found.
+     *
+     * @return Whether there is such a cell before the edge of the sheet.
+     */
+    bool findCell(
+        const Address &from,
+        int colStep,
+        int rowStep,
+        bool nonEmpty,
+        Address &found) const;
+
+    /**
+     * Finds the smallest rectangle containing all cells. Takes the tiles at the edges only.
+     *
+     * @return Whether there are any cells; begin and end are set to the corners if so.
+     */
+    bool getUsedRange(Address &begin, Address &end) const;
+
+    /**
+     * Calls the function for every cell, tile by tile. In out-of-core mode, tiles are loaded
+     * one by one, so all cells can be visited within the memory budget.
+     */
+    void forEach(const function<void(const shared_ptr<CellBase> &)> &fn) const;
+
+    /**
+     * Like forEach(), but calls the second function with the addresses and values of number
+     * literal cells instead of creating their objects.
+     */
+    void forEach(const function<void(const shared_ptr<CellBase> &)> &fn,
+                 const function<void(const Address &, const Value &)> &literalFn) const;
+
+    /**
+     * Calls the function for every cell without creating objects of number literal cells:
+     * with the cell stored as an object and an empty value, or nullptr and the value of
+     * the number literal. Tiles of an in-memory store are split among the threads, so
+     * the function is called concurrently and must be thread-safe; out-of-core stores are
+     * scanned on the calling thread, within the memory budget. The function must not use
+     * the store.
+     *
+     * @param threads Number of threads, 0 for one per core.
+     */
+    void scan(
+        const function<void(const Address &, const CellBase *, const Value &)> &fn,
+        unsigned threads = 0) const;
+
+    /**
+     * Writes all dirty tiles to the tile file and commits them. Only in out-of-core mode.
+     *
+     * @throws IOException
+     */
+    void save();
+
+    /**
+     * @return Estimated memory taken by loaded tiles. Only in out-of-core mode.
+     */
+    size_t getLoadedBytes() const;
+
+    /**
+     * @return Memory taken by the number literal records of loaded tiles. Looks at every tile.
+     */
+    size_t getLiteralBytes() const;
+};
+
+#endif /* SPREADSHEET_CELL_STORE_H */
@@ -0,0 +1,113 @@
+#ifndef SPREADSHEET_CSV_H
+#define SPREADSHEET_CSV_H
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Address.h"
+
+using namespace std;
+
+class Sheet;
+
+/**
+ * Streaming import and export of delimiter-separated values (CSV, TSV).
+ *
+ * FORMAT (RFC 4180):
+ *     Rows are separated by \n, \r\n or \r. Fields are separated by the delimiter. A field may be
+ *     enclosed in double quotes, in which case it may contain delimiters, newlines and double
+ *     quotes written as "". Empty fields are empty cells.
+ *
+ * Input is read in large chunks. Delimiters, quotes and newlines are located 16 bytes at a time
+ * using SSE2 (if available), so most of the bytes are never looked at one by one.
+ */
+class Csv
+{
+    /**
+     * Number of rows the column types are inferred from.
+     */
+    static const size_t INFER_ROWS = 1000;
+
+    /**
+     * Number of cells passed to the sheet at once.
+     */
+    static const size_t BATCH_SIZE = 4096;
+
+    /**
+     * Size of chunks the input is read in.
+     */
+    static const size_t CHUNK_SIZE = 1 << 20;
+
+    /**
+     * Finds the first delimiter, double quotes, \r or \n in the given range.
+     *
+     * @return Pointer to the found character or end.
+     */
+    static const char *findSpecial(const char *begin, const char *end, char delimiter);
+
+    /**
+     * Parses one row starting at pos and stores its fields. Moves pos past the row.
+     *
+     * @param atEof Whether end is the end of input. If not, incomplete rows are not parsed.
+     *
+     * @return False if the row is not complete within the range.
+     */
+    static bool parseRow(
+        const char *&pos,
+        const char *end,
+        bool atEof,
+        char delimiter,
+        vector<string> &fields);
+
+    /**
+     * @return Whether the value is a decimal number: optional sign, digits with an optional
+     *         decimal point (at least one digit), optional exponent. No whitespace, hex floats,
+     *         infinities or NaNs, which strtod() would accept.
+     */
+    static bool isDecimal(const string &value);
+
+    /**
+     * @return Narrowest type name (int, double or string) the value can be converted to.
+     */
+    static const string &inferType(const string &value);
+
+    /**
+     * Writes the field, enclosing it in double quotes if necessary.
+     */
+    static void writeField(string &out, const string &field, char delimiter);
+
+public:
+    /**
+     * @return Delimiter according to the file extension: tab for .tsv, comma otherwise.
+     */
+    static char delimiterFor(const string &filename);
+
+    /**
+     * Reads the rows from the input stream into the sheet, the first field of the first row
+     * being placed at origin. Values starting with = are imported as text, not as formulas.
+     *
+     * @param inferTypes Whether to infer type of each column (int, double or string) from its
+     *                   first rows. Values not matching the type of their column are imported
+     *                   as strings. If false, all cells are strings.
+     *
+     * @return Number of rows read.
+     *
+     * @throws InvalidArgumentException Data out of the sheet's range.
+     */
+    static size_t read(
+        istream &is,
+        Sheet &sheet,
+        const Address &origin = Address(1, 1),
+        char delimiter = ',',
+        bool inferTypes = true);
+
+    /**
+     * Writes evaluated contents of all cells, starting with A1. Cells that fail to evaluate
+     * are written as #ERROR.
+     */
+    static void write(ostream &os, const Sheet &sheet, char delimiter = ',');
+};
+
+#endif /* SPREADSHEET_CSV_H */
@@ -0,0 +1,233 @@
+#ifndef SPREADSHEET_DEPENDENCY_GRAPH_H
+#define SPREADSHEET_DEPENDENCY_GRAPH_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Address.h"
+#include "AddressList.h"
+
+using namespace std;
+
+/**
+ * Graph of dependencies between cells. Edges go both ways: from a cell to its precedents (cells
+ * its formula refers to) and from a cell to its dependents (cells referring to it). Every edge
+ * is stored at most once.
+ *
+ * CELL IDS:
+ *     Every address taking part in the graph gets a dense integer ID. IDs are stable: an address
+ *     keeps its ID for the lifetime of the graph, no matter how the cell is edited.
+ *
+ * STRUCTURE:
+ *     Each direction is an adjacency array: the edges of a cell are a contiguous segment of one
+ *     array of IDs, located by the cell's ID, so traversal touches no pointers. Segments have
+ *     spare capacity; a segment that runs out of it is moved to the end of the array with double
+ *     the capacity. The space left behind is reclaimed by compaction once it exceeds the space
+ *     taken by the edges. Large batches of edges are built in one pass by counting sort.
+ */
+class DependencyGraph
+{
+public:
+    typedef uint32_t Id;
+
+private:
+    /**
+     * Edges of one direction.
+     */
+    class Adjacency
+    {
+        struct Segment
+        {
+            uint32_t begin = 0;
+            uint32_t count = 0;
+            uint32_t capacity = 0;
+        };
+
+        static const uint32_t MIN_CAPACITY = 2;
+
+        /**
+         * Minimal space of the array not taken by edges that triggers compaction.
+         */
+        static const size_t MIN_COMPACT = 4096;
+
+        /**
+         * Segments by cell ID.
+         */
+        vector<Segment> m_Segments;
+
+        vector<Id> m_Edges;
+
+        /**
+         * Number of edges.
+         */
+        size_t m_Size = 0;
+
+        Segment &segment(Id id);
+
+        /**
+         * Moves all segments to a new array, without any spare capacity.
+         */
+        void compact();
+
+    public:
+        /**
+         * @return Whether the edge was added (was not present).
+         */
+        bool add(Id from, Id to);
+
+        /**
+         * @return Whether the edge was removed (was present).
+         */
+        bool remove(Id from, Id to);
+
+        /**
+         * @return Edges from the ID as a [first, second) range.
+         */
+        pair<const Id *, const Id *> get(Id from) const;
+
+        /**
+         * Replaces all edges with the given ones, in any order, possibly with duplicates.
+         *
+         * @param ids Number of IDs, all edges are between them.
+         */
+        void build(const vector<pair<Id, Id>> &edges, size_t ids);
+
+        /**
+         * Replaces all edges with reversed edges of the other adjacency.
+         */
+        void transpose(const Adjacency &other, size_t ids);
+
+        /**
+         * Appends all edges.
+         */
+        void collect(vector<pair<Id, Id>> &edges) const;
+
+        size_t size() const;
+
+        /**
+         * @return Memory taken by the arrays.
+         */
+        size_t getBytes() const;
+    };
+
+    /**
+     * Open addressing hash table with linear probing mapping packed addresses (column in
+     * the upper half, row in the lower) to IDs. Entries are never removed.
+     */
+    class IdMap
+    {
+        /**
+         * Marks an empty slot. No packed address is zero.
+         */
+        static const uint64_t EMPTY = 0;
+
+        struct Slot
+        {
+            uint64_t key = EMPTY;
+            Id id = 0;
+        };
+
+        vector<Slot> m_Slots;
+        size_t m_Size = 0;
+
+        size_t slot(uint64_t key) const;
+
+        void grow();
+
+    public:
+        static uint64_t pack(const Address &addr);
+
+        /**
+         * @return Pointer to ID of the key, nullptr if there is none.
+         */
+        const Id *find(uint64_t key) const;
+
+        /**
+         * @return ID of the key, the given one if there was none.
+         */
+        Id insert(uint64_t key, Id id);
+
+        /**
+         * @return Memory taken by the table.
+         */
+        size_t getBytes() const;
+    };
+
+    IdMap m_Ids;
+
+    /**
+     * Addresses by ID.
+     */
+    vector<Address> m_Addresses;
+
+    /**
+     * cell -> cells its formula refers to
+     */
+    Adjacency m_Precedents;
+
+    /**
+     * cell -> cells referring to it
+     */
+    Adjacency m_Dependents;
+
+public:
+    /**
+     * @return ID of the address, assigning a new one if it has none.
+     */
+    Id getId(const Address &addr);
+
+    /**
+     * Finds ID of the address.
+     *
+     * @return False if the address has no ID.
+     */
+    bool findId(const Address &addr, Id &id) const;
+
+    const Address &getAddress(Id id) const;
+
+    /**
+     * Replaces precedents of the cell, updating dependents of the old and new precedents.
+     */
+    void setPrecedents(const Address &cell, const AddressList &precedents);
+
+    /**
+     * Adds all the (precedent, dependent) edges at once. Large batches are built into new
+     * adjacency arrays by counting sort.
+     */
+    void addAll(const vector<pair<Address, Address>> &edges);
+
+    /**
+     * @return IDs of cells referring to the cell as a [first, second) range. Valid until
+     *         the graph is modified.
+     */
+    pair<const Id *, const Id *> getDependents(Id id) const;
+
+    /**
+     * @return IDs of cells the cell's formula refers to as a [first, second) range. Valid until
+     *         the graph is modified.
+     */
+    pair<const Id *, const Id *> getPrecedents(Id id) const;
+
+    /**
+     * @return Addresses of cells referring to the cell.
+     */
+    vector<Address> getDependents(const Address &addr) const;
+
+    /**
+     * @return Number of edges.
+     */
+    size_t size() const;
+
+    /**
+     * @return Number of assigned IDs. All IDs are less than it.
+     */
+    size_t getIdCount() const;
+
+    /**
+     * @return Memory taken by the IDs and the edges of both directions.
+     */
+    size_t getBytes() const;
+};
+
+#endif /* SPREADSHEET_DEPENDENCY_GRAPH_H */
@@ -0,0 +1,108 @@
+#ifndef SPREADSHEET_HEADLESS_H
+#define SPREADSHEET_HEADLESS_H
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Sheet.h"
+
+using namespace std;
+
+/**
+ * Command-line mode without any terminal UI. Loads a sheet, applies edits, evaluates cells
+ * and prints their values to the output. Meant for scripts and pipelines.
+ *
+ * USAGE:
+ *     spreadsheet --batch [-m <MiB>] [<file>] [options]
+ *
+ *     <file> is read as CSV (or TSV) if it ends with .csv (or .tsv), opened as an out-of-core
+ *     sheet if it ends with .tiles, read as the sheet's JSON otherwise (replaying its journal,
+ *     if there is one). Without a file, the sheet is empty. -m sets the memory budget of
+ *     out-of-core sheets.
+ *
+ * OPTIONS (processed in the order given):
+ *     -e, --edit <edit>     applies one edit
+ *     -E, --edits <file>    applies edits from the file, one per line (- for standard input);
+ *                           empty lines and lines starting with # are skipped
+ *     -c, --cell <addr>     prints the value of the cell
+ *     -d, --dump            prints values of all non-empty cells in row-major order
+ *     --csv                 prints values of all cells as CSV
+ *     --stats               prints sizes and counters of the sheet so far as one line
+ *                           of JSON (see Stats)
+ *     -o, --output <file>   saves the sheet (as CSV, TSV or tile file according to the
+ *                           extension); saving an out-of-core sheet to its own tile file
+ *                           writes only the modified tiles
+ *
+ * EDITS:
+ *     <addr>=<content>      sets content of the cell (as typed in the UI, = starts a formula)
+ *     <addr>:<type>         changes type of the cell (int, double or string)
+ *
+ * OUTPUT:
+ *     One line per cell: <addr> TAB <type> TAB <value>. Cells that fail to evaluate have
+ *     value #ERROR.
+ *
+ * EXIT STATUS:
+ *     0 on success, 1 on error (described on the error output), 2 on wrong usage.
+ */
+class Headless
+{
+    /**
+     * Saves the sheet to the file according to its extension. A tile file is replaced, so it
+     * must not be the one backing the sheet.
+     *
+     * @param memoryBudget Memory budget of the written sheet, if it's saved as a tile file.
+     *
+     * @throws IOException
+     */
+    static void save(const Sheet &sheet, const string &filename, size_t memoryBudget);
+
+    /**
+     * Applies one edit.
+     *
+     * @throws InvalidArgumentException Malformed edit.
+     * @throws IncorrectFormulaSyntaxException
+     * @throws InvalidTypeException
+     */
+    static void applyEdit(Sheet &sheet, const string &edit);
+
+    /**
+     * Prints the evaluated cell as one line of output.
+     */
+    static void printCell(ostream &os, const CellBase &cell);
+
+    /**
+     * Prints all non-empty cells in row-major order.
+     */
+    static void dump(ostream &os, const Sheet &sheet);
+
+    static void printUsage(ostream &os);
+
+public:
+    /**
+     * Loads the sheet from the file according to its extension (CSV/TSV, tile file or JSON with
+     * its journal).
+     *
+     * @param memoryBudget Memory budget if the file is a tile file.
+     *
+     * @throws IOException
+     * @throws InvalidInputException
+     */
+    static shared_ptr<Sheet> load(
+        const string &filename,
+        size_t memoryBudget = CellStore::DEFAULT_MEMORY_BUDGET);
+
+    /**
+     * Runs the headless mode.
+     *
+     * @param args Command-line arguments following --batch.
+     * @param out Output for values.
+     * @param err Output for error messages.
+     *
+     * @return Exit status.
+     */
+    static int run(const vector<string> &args, ostream &out, ostream &err);
+};
+
+#endif /* SPREADSHEET_HEADLESS_H */
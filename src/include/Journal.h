@@ -0,0 +1,168 @@
+#ifndef SPREADSHEET_JOURNAL_H
+#define SPREADSHEET_JOURNAL_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Address.h"
+
+using namespace std;
+
+class Sheet;
+class SheetSnapshot;
+
+/**
+ * Append-only log of cell edits, stored next to a base sheet file as <base>.journal. Saving
+ * appends only the records of cells edited since the last save instead of rewriting the whole
+ * sheet. Loading deserializes the base file and replays the journal over it.
+ *
+ * FORMAT:
+ *     One record per line. Every record is a serialized cell (the same JSON object Cell::serialize
+ *     writes), holding the complete state of the cell after the edit. A removed cell is recorded
+ *     as an empty string cell. Records are therefore idempotent and replaying any prefix of the
+ *     journal twice yields the same sheet.
+ *
+ * COMPACTION:
+ *     Once the journal grows past the threshold, the cells are written into a new base file
+ *     on a background thread. The base is replaced atomically by rename and only then
+ *     the journal is cut to records appended after the compaction started. If the program is
+ *     interrupted in between, replaying the whole journal over the new base is still correct
+ *     thanks to the idempotency of records.
+ */
+class Journal
+{
+    /**
+     * Filename of the base sheet file.
+     */
+    const string m_BaseFilename;
+
+    /**
+     * Size of the journal (in bytes) which triggers compaction.
+     */
+    const size_t m_CompactThreshold;
+
+    /**
+     * Records of edits that have not been written to the journal file yet.
+     */
+    vector<string> m_Pending;
+
+    /**
+     * Current size of the journal file in bytes.
+     */
+    size_t m_Size = 0;
+
+    /**
+     * Guards the journal file and m_Size against the compaction thread.
+     */
+    mutex m_FileMutex;
+
+    thread m_Compactor;
+
+    /**
+     * Whether the compaction thread is currently running.
+     */
+    atomic<bool> m_Compacting;
+
+    /**
+     * Whether the last compaction failed. Reported by the next flush().
+     */
+    atomic<bool> m_CompactionFailed;
+
+    /**
+     * Takes a snapshot of the sheet and writes it into a new base file on a background
+     * thread. Afterwards removes the first journalOffset bytes (which are already contained
+     * in the new base) from the journal.
+     */
+    void compact(const Sheet &sheet, size_t journalOffset);
+
+    /**
+     * Writes the given snapshot into a new base file and cuts the journal. Runs on the compaction
+     * thread.
+     *
+     * @return False on I/O failure.
+     */
+    bool writeBase(const SheetSnapshot &snapshot, size_t journalOffset);
+
+public:
+    /**
+     * Default size of the journal (in bytes) which triggers compaction.
+     */
+    static const size_t DEFAULT_COMPACT_THRESHOLD = 4 * 1024 * 1024;
+
+    Journal() = delete;
+    Journal(const Journal &) = delete;
+    Journal(Journal &&) = delete;
+
+    /**
+     * Initializes the journal for the given base file. Does not touch any file.
+     */
+    Journal(const string &baseFilename, size_t compactThreshold = DEFAULT_COMPACT_THRESHOLD);
+
+    /**
+     * Waits for a running compaction to finish.
+     */
+    ~Journal();
+
+    /**
+     * @return Filename of the journal belonging to the given base file.
+     */
+    static string journalFilename(const string &baseFilename);
+
+    /**
+     * @return Filename of the base sheet file.
+     */
+    const string &getBaseFilename() const;
+
+    /**
+     * Remembers the state of a cell after an edit. Nothing is written until flush().
+     *
+     * @param type Type name of the cell.
+     * @param content Source content of the cell. Empty string cell means the cell was removed.
+     */
+    void record(const string &type, const Address &addr, const string &content);
+
+    /**
+     * @return Number of records not written yet.
+     */
+    size_t pendingCount() const;
+
+    /**
+     * Writes the sheet as a new base file and truncates the journal. Pending records are dropped
+     * as they are contained in the base.
+     *
+     * @throws IOException
+     */
+    void reset(const Sheet &sheet);
+
+    /**
+     * Appends all pending records to the journal file. Starts compaction in the background if
+     * the journal grew past the threshold.
+     *
+     * @param sheet The sheet the records belong to. Source of cells for compaction.
+     *
+     * @throws IOException If writing fails or if the last compaction failed.
+     */
+    void flush(const Sheet &sheet);
+
+    /**
+     * Applies all records of the journal file (if there is any) to the given sheet. Does not
+     * trigger any events.
+     *
+     * @param cancelled If given, checked for every record.
+     *
+     * @throws InvalidInputException
+     * @throws CancelledException Once the flag is set.
+     */
+    void replay(Sheet &sheet, const atomic<bool> *cancelled = nullptr);
+
+    /**
+     * Blocks until a running compaction finishes.
+     */
+    void waitForCompaction();
+};
+
+#endif /* SPREADSHEET_JOURNAL_H */
@@ -0,0 +1,202 @@
+#ifndef SPREADSHEET_POOL_H
+#define SPREADSHEET_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Memory for the small objects of one sheet: cells and formula nodes.
+ *
+ * SIZE CLASSES:
+ *     Objects are carved out of large chunks, rounded up to a multiple of GRANULARITY bytes.
+ *     Freed objects go to the free list of their size class and are reused by later objects of
+ *     the class. Objects larger than MAX_SIZE come from the heap.
+ *
+ * RELEASE:
+ *     The chunks are released all at once with the pool, instead of object by object. The pool
+ *     lives as long as the sheet and any cell allocated from it (see PoolAllocator). Once
+ *     the sheet is being destroyed, the pool is closed: freeing objects does nothing, as their
+ *     memory is about to be released with the chunks anyway.
+ *
+ * Chunks are aligned to their size and start with a pointer to their pool, so the pool of any
+ * object can be found by its address. Thread-safe: cells may be released by any thread dropping
+ * the last snapshot holding them.
+ */
+class Pool
+{
+    static const size_t CHUNK_SIZE = (size_t) 64 << 10;
+    static const size_t GRANULARITY = 16;
+
+    struct FreeObject
+    {
+        FreeObject *next;
+    };
+
+    mutex m_Mutex;
+
+    atomic<bool> m_Closed;
+
+    /**
+     * Free objects by size class.
+     */
+    vector<FreeObject *> m_Free;
+
+    /**
+     * Unused rest of the newest chunk.
+     */
+    char *m_Cursor = nullptr;
+    char *m_End = nullptr;
+
+    vector<void *> m_Chunks;
+
+    /**
+     * Number of objects allocated and not freed yet.
+     */
+    size_t m_Live = 0;
+
+    /**
+     * Number of objects allocated since the pool was created.
+     */
+    size_t m_Allocated = 0;
+
+    /**
+     * Number of formula nodes allocated by allocateNode() and not freed yet.
+     */
+    atomic<size_t> m_LiveNodes;
+
+    static size_t sizeClass(size_t size);
+
+    /**
+     * @return Pool of memory allocated by allocate() of any pool, not larger than MAX_SIZE.
+     */
+    static Pool *owner(void *ptr);
+
+    /**
+     * Allocates a new chunk and makes it the newest.
+     */
+    void grow();
+
+public:
+    static const size_t MAX_SIZE = 256;
+
+    Pool();
+    Pool(const Pool &) = delete;
+    Pool(Pool &&) = delete;
+
+    ~Pool();
+
+    /**
+     * @return Memory for an object of the size.
+     */
+    void *allocate(size_t size);
+
+    /**
+     * Frees memory allocated by allocate() of this pool.
+     *
+     * @param size Size given to allocate().
+     */
+    void deallocate(void *ptr, size_t size);
+
+    /**
+     * Makes deallocate() do nothing from now on. Objects can still be allocated.
+     */
+    void close();
+
+    /**
+     * Frees memory allocated by allocate() of any pool.
+     *
+     * @param size Size given to allocate().
+     */
+    static void release(void *ptr, size_t size);
+
+    /**
+     * Like allocate(), for a node of a parsed formula, counted by getNodeCount(). Nodes larger
+     * than MAX_SIZE come from the heap and are not counted.
+     */
+    void *allocateNode(size_t size);
+
+    /**
+     * Like release(), for memory allocated by allocateNode() of any pool.
+     */
+    static void releaseNode(void *ptr, size_t size);
+
+    /**
+     * @return Number of chunks taken from the heap.
+     */
+    size_t getChunkCount();
+
+    /**
+     * @return Number of objects allocated and not freed yet.
+     */
+    size_t getLiveCount();
+
+    /**
+     * @return Number of objects allocated since the pool was created.
+     */
+    size_t getAllocatedCount();
+
+    /**
+     * @return Number of formula nodes allocated by allocateNode() and not freed yet.
+     */
+    size_t getNodeCount() const;
+
+    /**
+     * @return Memory of the chunks taken from the heap. Objects larger than MAX_SIZE are not
+     *         included.
+     */
+    size_t getChunkBytes();
+};
+
+/**
+ * Standard allocator taking memory from a pool, keeping the pool alive while anything
+ * allocated by it exists (e.g. a cell made by allocate_shared() holds the allocator).
+ */
+template<typename T>
+class PoolAllocator
+{
+    template<typename U>
+    friend class PoolAllocator;
+
+    shared_ptr<Pool> m_Pool;
+
+public:
+    typedef T value_type;
+
+    explicit PoolAllocator(shared_ptr<Pool> pool)
+        : m_Pool(move(pool))
+    {}
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U> &other)
+        : m_Pool(other.m_Pool)
+    {}
+
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(m_Pool->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *ptr, size_t n)
+    {
+        m_Pool->deallocate(ptr, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U> &rhs) const
+    {
+        return m_Pool == rhs.m_Pool;
+    }
+
+    template<typename U>
+    bool operator!=(const PoolAllocator<U> &rhs) const
+    {
+        return m_Pool != rhs.m_Pool;
+    }
+};
+
+#endif /* SPREADSHEET_POOL_H */
@@ -0,0 +1,310 @@
+#ifndef SPREADSHEET_RECALCULATOR_H
+#define SPREADSHEET_RECALCULATOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Address.h"
+#include "Sheet.h"
+
+using namespace std;
+
+/**
+ * Evaluates changed cells of a sheet on a background thread, so that an interactive user of
+ * the sheet is not blocked by long recalculations.
+ *
+ * CONCURRENCY:
+ *     The sheet is guarded by a mutex shared with the worker thread. Anyone else must hold
+ *     the lock returned by lock() while using the sheet or calling any method of
+ *     the recalculator. The worker works in small steps and gives the lock up as soon as
+ *     someone asks for it. A sheet may have one recalculator at a time.
+ *
+ * SCHEDULING:
+ *     The recalculator subscribes to changes of the whole sheet; every edit restarts
+ *     the recalculation with the changed cells.
+ *
+ * PRIORITIES:
+ *     Cells scheduled within the viewport (see setViewport()) are evaluated before the others,
+ *     requested cells before all of them. A cell scheduled again while waiting moves forward,
+ *     it's never waiting twice. A cell is evaluated by walking its precedents that
+ *     are not evaluated yet depth-first, one precedent per step, and evaluating each once its
+ *     own precedents are. So a visible cell waits only for its own precedents, and every step
+ *     is short no matter how long the chains are. A walk going around a dependency loop is
+ *     noticed as it grows and its cell is evaluated at once instead. Edits and requests abandon
+ *     the walk in progress; cells evaluated so far keep their values.
+ *
+ *     Evaluated cells within the viewport are formatted on the worker thread and collected
+ *     until takeResults(). Cells out of the viewport are only evaluated, their values are kept
+ *     by the sheet.
+ */
+class Recalculator
+{
+    friend class __Test;
+
+public:
+    /**
+     * Evaluated cell, formatted for display.
+     */
+    struct Result
+    {
+        Address addr;
+        string text;
+    };
+
+    typedef function<string(const CellBase &)> Formatter;
+
+private:
+    /**
+     * Depth of the walk at which it's checked for loops first.
+     */
+    static const size_t LOOP_CHECK_DEPTH = 1024;
+
+    /**
+     * Cell being walked, see step().
+     */
+    struct Frame
+    {
+        Address addr;
+        shared_ptr<const CellBase> cell;
+
+        /**
+         * Index of the next dependency to visit.
+         */
+        size_t next;
+    };
+
+    /**
+     * Cell waiting for evaluation. Stale if the cell was scheduled again since, see m_Pending.
+     */
+    struct Entry
+    {
+        Address addr;
+        uint64_t seq;
+    };
+
+    shared_ptr<Sheet> m_Sheet;
+
+    /**
+     * Formats cells within the viewport. Called by the worker thread.
+     */
+    Formatter m_Format;
+
+    mutex m_Mutex;
+    condition_variable m_Cond;
+
+    thread m_Worker;
+
+    bool m_Stopping = false;
+
+    /**
+     * Number of threads waiting for lock(). The worker gives the lock up while non-zero.
+     */
+    atomic<int> m_Waiting;
+
+    /**
+     * Cells waiting for evaluation, in order: those scheduled within the viewport or
+     * requested, then the others. Moving a cell forward leaves its old entry behind, stale.
+     */
+    deque<Entry> m_Visible;
+    deque<Entry> m_Queue;
+
+    /**
+     * Addresses of cells waiting for evaluation -> seq of their entry that is not stale.
+     */
+    unordered_map<Address, uint64_t> m_Pending;
+
+    uint64_t m_Seq = 0;
+
+    /**
+     * Walk of the cell taken from the queues last, the cell at the bottom, the precedent being
+     * visited at the top.
+     */
+    vector<Frame> m_Walk;
+
+    /**
+     * Depth of m_Walk at which it's checked for loops next, see step().
+     */
+    size_t m_LoopCheckDepth;
+
+    vector<Result> m_Results;
+
+    /**
+     * Whether there are cells waiting or results not taken yet. Readable without the lock.
+     */
+    atomic<bool> m_Busy;
+
+    /**
+     * Cells taken from the queues and evaluated since the last restart().
+     */
+    atomic<size_t> m_Done;
+
+    /**
+     * Cells waiting after the last restart() and cells requested since then that were not
+     * waiting.
+     */
+    atomic<size_t> m_Total;
+
+    /**
+     * Start of the recalculation in progress, if m_Timing.
+     */
+    chrono::steady_clock::time_point m_Start;
+
+    bool m_Timing = false;
+
+    /**
+     * Duration of the last finished recalculation in microseconds, -1 if none yet.
+     */
+    long m_LastDuration = -1;
+
+    Address m_ViewportBegin = Address(1, 1);
+    Address m_ViewportEnd = Address(1, 1);
+
+    /**
+     * ID of the subscription to changes of the sheet.
+     */
+    uint32_t m_Subscription;
+
+    /**
+     * Evaluates queued cells until stopped. Runs on the worker thread.
+     */
+    void run();
+
+    /**
+     * Puts the cell to the front of m_Visible (if urgent or in the viewport) or m_Queue.
+     *
+     * @return Whether the cell was not waiting yet.
+     */
+    bool schedule(const Address &addr, bool urgent);
+
+    /**
+     * Takes the next waiting cell, skipping stale entries. There must be some.
+     */
+    Address takeNext();
+
+    /**
+     * Drops stale entries once they outnumber the others, so that a series of edits does not
+     * grow the queues.
+     */
+    void dropStale();
+
+    /**
+     * Takes the next cell from the queue, visits the next precedent of the cell on top
+     * of the walk, or evaluates that cell if it has no precedents left to visit.
+     */
+    void step();
+
+    /**
+     * Starts walking the cell.
+     */
+    void visit(const Address &addr, shared_ptr<const CellBase> cell);
+
+    /**
+     * Evaluates the cell and collects its result if it's in the viewport.
+     */
+    void evaluate(const Address &addr, const CellBase &cell);
+
+    /**
+     * @return Whether some cell is in m_Walk more than once.
+     */
+    bool isWalkLooping() const;
+
+    /**
+     * Evaluates the cell at the bottom of the walk at once, reports visible cells of the walk
+     * and drops the walk.
+     */
+    void finishWalk();
+
+    /**
+     * Returns the cell being walked to the front of the queue and drops the walk.
+     */
+    void abandonWalk();
+
+    bool isInViewport(const Address &addr) const;
+
+    void updateBusy();
+
+    /**
+     * Replaces the recalculation in progress: the given cells are evaluated first, followed
+     * by the cells not evaluated yet, those within the viewport before the others. Resets
+     * the progress. Called by the edits of the sheet.
+     *
+     * @param cells Changed cells, including those that need no evaluation.
+     */
+    void restart(const vector<Address> &cells);
+
+public:
+    Recalculator() = delete;
+    Recalculator(const Recalculator &) = delete;
+    Recalculator(Recalculator &&) = delete;
+
+    /**
+     * Subscribes to changes of the sheet and starts the worker thread. Cells changed before
+     * are not scheduled, see request().
+     *
+     * @param format Formats cells within the viewport, called by the worker thread. Must not
+     *               throw.
+     */
+    Recalculator(shared_ptr<Sheet> sheet, Formatter format);
+
+    /**
+     * Stops the worker thread after its current step, leaving the rest unevaluated, and
+     * unsubscribes. The lock must not be held by the caller.
+     */
+    ~Recalculator();
+
+    /**
+     * @return Lock of the sheet and the recalculator. The worker pauses while it's held.
+     */
+    unique_lock<mutex> lock();
+
+    /**
+     * Evaluates the cell (and its precedents) before all other cells waiting.
+     */
+    void request(const Address &addr);
+
+    /**
+     * Sets the rectangle of cells whose results are collected and which are evaluated first.
+     */
+    void setViewport(const Address &begin, const Address &end);
+
+    /**
+     * @return Results collected since the last call, in the order the cells were evaluated.
+     */
+    vector<Result> takeResults();
+
+    /**
+     * @return Whether cells are waiting for evaluation or there are results not taken yet.
+     *         Does not need the lock.
+     */
+    bool isBusy() const;
+
+    /**
+     * @return Number of cells evaluated since the last edit.
+     */
+    size_t getDone() const;
+
+    /**
+     * @return Number of cells scheduled since the last edit.
+     */
+    size_t getTotal() const;
+
+    /**
+     * @return Time from the last edit until all cells scheduled since then were evaluated, in
+     *         microseconds; -1 if no recalculation has finished yet.
+     */
+    long getLastDuration() const;
+};
+
+#endif /* SPREADSHEET_RECALCULATOR_H */
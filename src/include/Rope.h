@@ -0,0 +1,84 @@
+#ifndef SPREADSHEET_ROPE_H
+#define SPREADSHEET_ROPE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+/**
+ * Immutable string, either a leaf holding the characters or a concatenation of two ropes.
+ * Concatenating shares both parts instead of copying them, so a string built piece by piece,
+ * within a formula or along a chain of cells, takes time and memory linear in its length.
+ * The characters are put together only when the string is flattened for rendering or
+ * serialization.
+ *
+ * Ropes can be as deep as the chains of cells building them. Flattening and destruction walk
+ * them with an explicit stack, so the depth is limited only by memory.
+ */
+class Rope
+{
+    size_t m_Length;
+
+    /**
+     * Characters of a leaf, empty for a concatenation.
+     */
+    string m_Leaf;
+
+    /**
+     * Parts of a concatenation, null for a leaf. Moved out only by the destructor.
+     */
+    shared_ptr<const Rope> m_Left;
+    shared_ptr<const Rope> m_Right;
+
+public:
+    /**
+     * Concatenations shorter than this are copied into a leaf: cheaper than a node for short
+     * strings, and still linear overall.
+     */
+    static const size_t FLAT_LENGTH = 64;
+
+    Rope() = delete;
+    Rope(const Rope &) = delete;
+    Rope(Rope &&) = delete;
+
+    explicit Rope(const string &leaf);
+    explicit Rope(string &&leaf);
+
+    /**
+     * Initializes concatenation of the parts.
+     */
+    Rope(shared_ptr<const Rope> left, shared_ptr<const Rope> right);
+
+    ~Rope();
+
+    /**
+     * @return Concatenation of the ropes, sharing them unless the result is short.
+     */
+    static shared_ptr<const Rope> concat(
+        const shared_ptr<const Rope> &left,
+        const shared_ptr<const Rope> &right);
+
+    size_t length() const;
+
+    /**
+     * Appends the characters of the rope.
+     */
+    void appendTo(string &out) const;
+
+    /**
+     * @return The characters of the rope.
+     */
+    string flatten() const;
+
+    /**
+     * @return The characters of a leaf, without copying them. Nullptr if the rope is
+     *         a concatenation.
+     */
+    const string *leaf() const;
+
+    bool operator==(const Rope &rhs) const;
+};
+
+#endif /* SPREADSHEET_ROPE_H */
@@ -0,0 +1,98 @@
+#ifndef SPREADSHEET_SEARCH_H
+#define SPREADSHEET_SEARCH_H
+
+#include <cstddef>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "Address.h"
+#include "Sheet.h"
+#include "TrigramIndex.h"
+
+using namespace std;
+
+/**
+ * Search for a pattern (ECMAScript regular expression, case-sensitive) in the cells
+ * of a sheet. A cell matches if its source matches, or the cached value of its formula does.
+ * Formulas are never evaluated by the search: a formula waiting for recalculation matches
+ * only by its source.
+ *
+ * The pattern is compiled once. Patterns without special characters are looked up as plain
+ * text, which is much faster than the regular expression, and may be narrowed down by
+ * a TrigramIndex. Otherwise all cells are scanned by several threads at once.
+ */
+class Search
+{
+    regex m_Regex;
+
+    /**
+     * Whether the pattern has no special characters, so it's m_Text itself.
+     */
+    bool m_IsLiteral;
+
+    string m_Text;
+
+    /**
+     * Whether a number literal may match, false for plain text that no number is written with.
+     */
+    bool m_MatchesNumbers;
+
+    /**
+     * @return Whether the cell (or number literal, if cell is nullptr) matches.
+     */
+    bool matches(const CellBase *cell, const Value &literal) const;
+
+public:
+    Search() = delete;
+
+    /**
+     * Compiles the pattern.
+     *
+     * @throws InvalidArgumentException The pattern is empty or not a valid regular expression.
+     */
+    explicit Search(const string &pattern);
+
+    /**
+     * @return Whether the text contains a match of the pattern.
+     */
+    bool matches(const string &text) const;
+
+    /**
+     * @return Whether the cell matches.
+     */
+    bool matches(const CellBase &cell) const;
+
+    /**
+     * Finds all matching cells of the sheet. The sheet must not change meanwhile.
+     *
+     * @param index If given and the pattern is plain text, only its candidates are checked.
+     *
+     * @return Addresses of the matching cells, row by row.
+     */
+    vector<Address> findAll(const Sheet &sheet, TrigramIndex *index = nullptr) const;
+
+    /**
+     * @return The text with all matches replaced; $& and $1...$9 in the replacement stand for
+     *         the match and its groups.
+     */
+    string replace(const string &text, const string &replacement) const;
+
+    /**
+     * Replaces all matches in the sources of the cells (not in the values of formulas),
+     * keeping the types of the cells. All changed cells are placed into the sheet at once.
+     * Cells whose new source is not valid for their type are left alone.
+     *
+     * @param cells Addresses of the cells, e.g. the result of findAll().
+     * @param failed If given, set to the number of cells left alone.
+     *
+     * @return Number of changed cells.
+     */
+    size_t replaceAll(
+        Sheet &sheet,
+        const vector<Address> &cells,
+        const string &replacement,
+        size_t *failed = nullptr) const;
+};
+
+#endif /* SPREADSHEET_SEARCH_H */
@@ -0,0 +1,232 @@
+#ifndef SPREADSHEET_SERVER_H
+#define SPREADSHEET_SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Sheet.h"
+
+using namespace std;
+
+/**
+ * Serves cell queries and edits to other local processes over a Unix-domain socket.
+ *
+ * PROTOCOL:
+ *     Line-delimited, one request per line, commands are case-insensitive. Every response starts
+ *     with OK or ERR <message>. Values are escaped: backslash as \\, newline as \n, tab as \t
+ *     and carriage return as \r.
+ *
+ *     GET <addr>                 OK <type> TAB <value>
+ *     RANGE <addr> <addr>        OK <count>, followed by <count> lines
+ *                                <addr> TAB <type> TAB <value> of non-empty cells within
+ *                                the rectangle, in row-major order
+ *     SET <addr> <content>       OK once the edit is applied and visible to readers
+ *     TYPE <addr> <type>         OK once the type is changed and visible to readers
+ *     RECALC                     OK <version> once all formulas are evaluated again
+ *     QUIT                       closes the connection
+ *
+ * CONCURRENCY:
+ *     Requests longer than MAX_REQUEST_LENGTH close the connection with ERR request too long.
+ *
+ *     Every connection is served by its own thread. Readers never touch the sheet, they are
+ *     served from an immutable snapshot of evaluated values which is replaced atomically.
+ *     The sheet is only accessed by a single writer thread, which takes all edits queued
+ *     in the meantime as one batch, applies them, evaluates changed cells into a new snapshot
+ *     and publishes it. The snapshot is split into tiles that are shared between versions, so
+ *     publishing copies only tiles containing changed cells.
+ */
+class Server
+{
+    friend class __Test;
+
+    /**
+     * Evaluated cell as served to readers.
+     */
+    struct CellValue
+    {
+        string type;
+        string text;
+    };
+
+    /**
+     * Evaluated cells of a rectangular region of TILE_SIZE x TILE_SIZE cells.
+     */
+    typedef unordered_map<Address, CellValue> Tile;
+
+    /**
+     * Immutable evaluated content of the sheet.
+     */
+    struct Snapshot
+    {
+        uint64_t version = 0;
+
+        /**
+         * Tile key (see tileKey()) -> tile. Contains only non-empty tiles.
+         */
+        unordered_map<uint64_t, shared_ptr<const Tile>> tiles;
+    };
+
+    /**
+     * Edit waiting for the writer thread.
+     */
+    struct Edit
+    {
+        enum Kind
+        {
+            CONTENT, TYPE, RECALC
+        };
+
+        Kind kind;
+        string addr;
+        string arg;
+        promise<string> response;
+    };
+
+    static const int TILE_SIZE = 64;
+
+    static const size_t MAX_REQUEST_LENGTH = 1 << 20;
+
+    shared_ptr<Sheet> m_Sheet;
+
+    const string m_SocketPath;
+
+    int m_ListenFd = -1;
+
+    atomic<bool> m_Stopping;
+
+    /**
+     * Current snapshot. Accessed only through atomic_load/atomic_store.
+     */
+    shared_ptr<const Snapshot> m_Snapshot;
+
+    mutex m_QueueMutex;
+    condition_variable m_QueueCond;
+    vector<shared_ptr<Edit>> m_Queue;
+
+    thread m_Writer;
+
+    /**
+     * Guards m_Clients, m_ClientFds and m_Finished.
+     */
+    mutex m_ClientsMutex;
+    vector<thread> m_Clients;
+    vector<int> m_ClientFds;
+
+    /**
+     * Threads of closed connections, joined by run() on the next connection.
+     */
+    vector<thread::id> m_Finished;
+
+    /**
+     * Addresses of cells changed while applying the current batch.
+     */
+    vector<Address> m_Changed;
+
+    /**
+     * ID of the subscription to changes of the whole sheet, filling m_Changed.
+     */
+    uint32_t m_Subscription = 0;
+
+    static uint64_t tileKey(int col, int row);
+
+    /**
+     * Escapes backslashes, newlines, tabs and carriage returns.
+     */
+    static string escape(const string &text);
+
+    /**
+     * Evaluates the cell.
+     */
+    static CellValue evaluate(const CellBase &cell);
+
+    /**
+     * Joins the threads of closed connections. Must be called with m_ClientsMutex locked.
+     */
+    void reapClients();
+
+    /**
+     * Evaluates all cells into a new snapshot.
+     */
+    shared_ptr<const Snapshot> buildSnapshot(uint64_t version) const;
+
+    /**
+     * Creates a new snapshot from the current one, evaluating again only the changed cells.
+     */
+    shared_ptr<const Snapshot> updateSnapshot(const vector<Address> &changed) const;
+
+    /**
+     * Applies queued edits in batches and publishes snapshots. Runs on the writer thread.
+     */
+    void writerLoop();
+
+    /**
+     * Applies one edit to the sheet.
+     *
+     * @return Response line.
+     */
+    string apply(Edit &edit);
+
+    /**
+     * Queues the edit and waits until it is applied.
+     *
+     * @return Response line.
+     */
+    string submit(Edit::Kind kind, const string &addr, const string &arg);
+
+    /**
+     * Serves one connection until it is closed.
+     */
+    void serveClient(int fd);
+
+    /**
+     * Handles one request line.
+     *
+     * @param close Set to true if the connection should be closed.
+     *
+     * @return Response, including the trailing newline.
+     */
+    string handle(const string &line, bool &close);
+
+public:
+    Server() = delete;
+    Server(const Server &) = delete;
+    Server(Server &&) = delete;
+
+    /**
+     * Initializes the server. The sheet must not be used by anyone else while the server runs.
+     */
+    Server(shared_ptr<Sheet> sheet, const string &socketPath);
+
+    /**
+     * Stops the server.
+     */
+    ~Server();
+
+    /**
+     * Creates the socket (replacing an existing file) and starts the writer thread.
+     *
+     * @throws IOException
+     */
+    void listen();
+
+    /**
+     * Accepts connections until stop() is called.
+     */
+    void run();
+
+    /**
+     * Stops accepting connections, closes all connections and waits for all threads. Can be
+     * called from any thread.
+     */
+    void stop();
+};
+
+#endif /* SPREADSHEET_SERVER_H */
@@ -1,66 +1,97 @@
 #ifndef SPREADSHEET_SHEET_H
 #define SPREADSHEET_SHEET_H
 
+#include <atomic>
+#include <cstddef>
+#include <functional>
 #include <istream>
 #include <memory>
 #include <ostream>
 #include <string>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 #include "Address.h"
 #include "CellBase.h"
+#include "CellStore.h"
+#include "DependencyGraph.h"
+#include "Journal.h"
+#include "Pool.h"
 #include "Serializable.h"
+#include "SheetSnapshot.h"
+#include "Stats.h"
+#include "StringPool.h"
 #include "Type.h"
 #include "Utils.h"
+#include "Value.h"
 
+#include "exception/CancelledException.h"
 #include "exception/DependencyLoopException.h"
 #include "exception/InvalidTypeException.h"
 #include "exception/IncorrectFormulaSyntaxException.h"
 
 using namespace std;
 
-namespace std
-{
-    template<>
-    struct hash<Address>
-    {
-        size_t operator()(const Address &addr) const;
-    };
-}
-
 /**
  * Represents data structure for cells in a sheet. Manages writing to cells as well as distributing
  * content-changed events. Alone does not handle any user input or provide any user output.
  *
  * DEPENDENCIES:
  *     Every cell has a container of its dependencies (addresses it depends on). Sheet has a map
- *     of dependencies which maps the address to cells that depend on that address. The cell's
- *     container is redundant but provides faster iteration through cell's dependencies.
+ *     of dependencies which maps the address to addresses of cells that depend on that address.
+ *     The cell's container is redundant but provides faster iteration through cell's
+ *     dependencies.
+ *
+ * MEMORY:
+ *     Cells and their formulas are allocated from the sheet's Pool (see Cell::make()), so
+ *     loading allocates large chunks rather than objects one by one, and destroying the sheet
+ *     releases the chunks at once. Number literal cells have no objects at all, CellStore keeps
+ *     just their values; getCell() creates a new object for them on every call.
+ *
+ * OUT-OF-CORE:
+ *     A sheet created with a tile file keeps only recently used regions of cells in memory (see
+ *     CellStore). The dependencies are always kept in memory.
  */
 class Sheet : public Serializable
 {
     friend class __Test;
+    friend class Journal;
 
     /**
      * NOT IMPLEMENTED
      *
      * Indicates whether the format of a new cell should be automatically detected or not (in which
-     * case new cells are always Cell<string>).
+     * case new cells are always string cells).
      */
     /* bool m_AutoDetectCellType = false; */
 
+    /**
+     * Memory of the cells and their formulas. Declared before m_Cells, so that it's created
+     * before any cell.
+     */
+    shared_ptr<Pool> m_Pool;
+
+    /**
+     * Interned sources of the formulas of the cells.
+     */
+    shared_ptr<StringPool> m_Sources;
+
     /**
      * All cells in this spreadsheet, indexed by their addresses. Contains only non-empty cells.
      */
-    unordered_map<Address, shared_ptr<CellBase>> m_Cells;
+    CellStore m_Cells;
+
+    /**
+     * All dependencies across cells in this spreadsheet, both cell -> its precedents and
+     * cell -> its dependents.
+     */
+    DependencyGraph m_Dependencies;
 
     /**
-     * All dependencies across cells in this spreadsheet.
-     * Form: cell address -> cells that depend on that cell
+     * Generations of the cells by their IDs in m_Dependencies. A generation changes whenever
+     * the cell at the ID's address is replaced or removed, invalidating CellHandles to it.
      */
-    unordered_map<Address, unordered_set<shared_ptr<const CellBase>>> m_Dependencies;
+    mutable vector<uint32_t> m_Generations;
 
     /**
      * Event that is called whenever content of any cell is changed.
@@ -68,46 +99,284 @@ class Sheet : public Serializable
     function<void(const CellBase &)> m_CellContentChanged;
 
     /**
-     * Copies cell's dependencies from its inner container to m_Dependencies.
+     * Listener of changes within a rectangle of cells, see subscribe().
+     */
+    struct Subscription
+    {
+        uint32_t id;
+        Address begin;
+        Address end;
+        function<void(const vector<Address> &)> listener;
+    };
+
+    /**
+     * All subscriptions, in the order they were made.
+     */
+    vector<Subscription> m_Subscriptions;
+
+    uint32_t m_LastSubscriptionId = 0;
+
+    /**
+     * Journal recording all edits, if any.
+     */
+    shared_ptr<Journal> m_Journal;
+
+    /**
+     * Work done so far, counted by the cells and their formulas too.
+     */
+    mutable SheetCounters m_Counters;
+
+    /**
+     * Copies cell's dependencies from its inner container to m_Dependencies, replacing the ones
+     * stored for its address.
+     */
+    void createDependencies(const CellBase &cell);
+
+    /**
+     * Builds dependencies of all cells at once, much faster than createDependencies() per cell.
+     * Meant for a freshly loaded sheet.
+     *
+     * @param cancelled If given, checked for every cell.
+     *
+     * @throws CancelledException Once the flag is set.
+     */
+    void createAllDependencies(const atomic<bool> *cancelled = nullptr);
+
+    /**
+     * Deletes dependencies of the cell at the address from m_Dependencies.
+     */
+    void deleteDependencies(const Address &addr);
+
+    /**
+     * Visit marks of dependency graph IDs, see collectDependents().
      */
-    void createDependencies(shared_ptr<const CellBase> cell);
+    vector<uint32_t> m_VisitMarks;
 
     /**
-     * Deletes the cell's dependencies from m_Dependencies based on cell's inner dependencies
-     * container.
+     * Mark of IDs visited by the current traversal.
      */
-    void deleteDependencies(shared_ptr<const CellBase> cell);
+    uint32_t m_VisitEpoch = 0;
 
     /**
-     * Triggers the content-changed event for the specified cell and its dependents. Stops further
-     * propagation if finds already notified cell.
+     * Drops cached values of the cell's dependents and triggers the content-changed event for
+     * the cell and its dependents, each notified once. Then passes the addresses of those within
+     * each subscription's rectangle to its listener, in one batch.
      *
      * @param cell Cell, whose content changed.
-     * @param processedCells Cells that have already been notified and should not be notified again.
      */
-    void distributeContentChangedEvent(
-        shared_ptr<const CellBase> cell,
-        unordered_set<shared_ptr<const CellBase>> processedCells = unordered_set<shared_ptr<const CellBase>>());
+    void distributeContentChangedEvent(shared_ptr<const CellBase> cell);
+
+    /**
+     * distributeContentChangedEvent() for cells changed at once. Dependents shared by the cells
+     * are visited and notified once.
+     */
+    void distributeContentChangedEvent(const vector<shared_ptr<const CellBase>> &cells);
+
+    /**
+     * @return IDs of all direct and indirect dependents of the cells, without the cells
+     *         themselves, in topological order: every dependent comes after the cells it depends
+     *         on, unless they form a loop. Walks the graph with an explicit stack,
+     *         so the length of dependency chains is limited only by memory.
+     */
+    vector<DependencyGraph::Id> collectDependents(
+        const vector<shared_ptr<const CellBase>> &cells);
+
+    /**
+     * Places the cell into m_Cells, invalidating handles to the replaced cell.
+     */
+    void storeCell(shared_ptr<CellBase> cell);
+
+    /**
+     * Removes the cell at the address from m_Cells, invalidating handles to it.
+     */
+    void eraseCell(const Address &addr);
+
+    /**
+     * Records the cell's current state to the journal, if there is any attached.
+     */
+    void recordEdit(const CellBase &cell);
+
+    /**
+     * Places the cell at its address, replacing the existing one and updating dependencies.
+     * Removes the cell if it is an empty string cell. Does not trigger any events nor records
+     * to the journal.
+     *
+     * @param newDependencies If given, the cell's (precedent, dependent) pairs are appended to it
+     *                        instead of being added to m_Dependencies.
+     */
+    void putCell(
+        shared_ptr<CellBase> cell,
+        vector<pair<Address, Address>> *newDependencies = nullptr);
 
 public:
-    Sheet()
-    {}
+    /**
+     * Cell resolved by resolveCell() for repeated access without lookups. Valid while
+     * isValid() says so.
+     */
+    struct CellHandle
+    {
+        static const uint32_t NONE = UINT32_MAX;
+
+        /**
+         * ID of the cell's address in the dependency graph, NONE if the handle is not valid.
+         */
+        uint32_t slot = NONE;
+
+        uint32_t generation = 0;
+
+        /**
+         * The cell, nullptr if it is a number literal stored without an object or there is no
+         * cell at the address (it is empty).
+         */
+        const CellBase *cell = nullptr;
+
+        /**
+         * If the cell is nullptr: Value of the number literal, empty value for an empty cell.
+         */
+        Value value;
+    };
+
+    Sheet();
+
+    /**
+     * Initializes an out-of-core sheet backed by the tile file, creating the file if it doesn't
+     * exist. Cells already in the file are the content of the sheet. Every cell is read once to
+     * build the dependencies.
+     *
+     * @param memoryBudget Approximate memory the cells may take, in bytes.
+     * @param cancelled If given, checked for every cell read.
+     *
+     * @throws IOException
+     * @throws InvalidInputException
+     * @throws CancelledException Once the flag is set.
+     */
+    Sheet(const string &tileFilename,
+          size_t memoryBudget = CellStore::DEFAULT_MEMORY_BUDGET,
+          const atomic<bool> *cancelled = nullptr);
 
     Sheet(const Sheet &) = delete;
     Sheet(Sheet &&) = delete;
 
+    /**
+     * Closes the pools, so that the cells and their sources are not freed one by one.
+     */
+    ~Sheet();
+
+    /**
+     * @return Pool of the sheet's cells and formulas.
+     */
+    const shared_ptr<Pool> &getPool() const;
+
+    /**
+     * @return Pool of interned formula sources of the sheet's cells.
+     */
+    const shared_ptr<StringPool> &getSources() const;
+
     /**
      * Saves a function that will be called whenever content of any cell in the spreadsheet changes.
      */
     void attachCellContentChangedEvent(const function<void(const CellBase &)> &cellContentChanged);
 
+    /**
+     * Subscribes the listener to changes of cells within the rectangle (inclusive). Once per
+     * edit (or setCells()), the listener gets the addresses of the changed cells within
+     * the rectangle, the edited ones first, followed by their dependents in topological order
+     * (see collectDependents()); it's not called if there are none. Unlike the content-changed
+     * event, the changed cells out of all rectangles are never looked up, so a listener
+     * of a small area costs little even when an edit changes millions of cells.
+     *
+     * Listeners must not subscribe or unsubscribe while being called.
+     *
+     * @return ID of the subscription.
+     */
+    uint32_t subscribe(
+        const Address &begin,
+        const Address &end,
+        const function<void(const vector<Address> &)> &listener);
+
+    /**
+     * Moves the subscription to another rectangle, e.g. that of a scrolled viewport.
+     */
+    void setSubscriptionRange(uint32_t id, const Address &begin, const Address &end);
+
+    /**
+     * Cancels the subscription. Does nothing if there is no subscription with the ID.
+     */
+    void unsubscribe(uint32_t id);
+
+    /**
+     * Starts recording all edits (made by setCellContent() and setCellType()) to the given
+     * journal. Pass nullptr to stop recording.
+     */
+    void attachJournal(shared_ptr<Journal> journal);
+
+    /**
+     * @return Attached journal or nullptr.
+     */
+    shared_ptr<Journal> getJournal() const;
+
     /**
      * Locates cell at the specified address.
      *
-     * @return Cell, if found, empty Cell<string> otherwise.
+     * @return Cell, if found, empty string cell otherwise.
      */
     shared_ptr<const CellBase> getCell(const Address &addr) const;
 
+    /**
+     * @return Whether there is a non-empty cell at the address. Does not look the cell up.
+     */
+    bool hasCell(const Address &addr) const;
+
+    /**
+     * Finds the nearest cell from the address (exclusive) in the direction that is non-empty,
+     * or empty. Gaps and blocks of any size are skipped without looking up their cells, see
+     * CellStore::findCell().
+     *
+     * @param colStep Column direction: 1, -1, or 0 if rowStep is not.
+     * @param rowStep Row direction: 1, -1, or 0 if colStep is not.
+     * @param found Set to the address of the cell, if found.
+     *
+     * @return Whether there is such a cell before the edge of the sheet.
+     */
+    bool findCell(
+        const Address &from,
+        int colStep,
+        int rowStep,
+        bool nonEmpty,
+        Address &found) const;
+
+    /**
+     * Finds the smallest rectangle containing all non-empty cells.
+     *
+     * @return Whether there are any cells; begin and end are set to the corners if so.
+     */
+    bool getUsedRange(Address &begin, Address &end) const;
+
+    /**
+     * @return Cell at the specified address if its content is a formula, nullptr otherwise.
+     *         Unlike getCell(), creates no cell objects.
+     */
+    shared_ptr<const CellBase> getFormulaCell(const Address &addr) const;
+
+    /**
+     * Locates cell at the specified address and fills the handle for later access, with
+     * the cell or, if the cell has no object, with its value. Out-of-core sheets leave
+     * the handle invalid, as their cells may be evicted anytime.
+     *
+     * @return The cell, nullptr if it has no object. Keeps the cell alive while the handle
+     *         is used.
+     */
+    shared_ptr<const CellBase> resolveCell(const Address &addr, CellHandle &handle) const;
+
+    /**
+     * @return Whether the handle still refers to the cell at its address.
+     */
+    bool isValid(const CellHandle &handle) const
+    {
+        return handle.slot < m_Generations.size() &&
+            m_Generations[handle.slot] == handle.generation;
+    }
+
     /**
      * Assigns the specified text as content of the cell specified by its address. Updates its
      * dependencies. Triggers the content-changed event for this cell and all its dependents
@@ -118,6 +387,15 @@ public:
      */
     void setCellContent(const Address &addr, const string &text);
 
+    /**
+     * Places all the given cells into the sheet at once, replacing existing cells at their
+     * addresses. Meant for bulk input (imports), where the cells are created by the caller.
+     * Empty string cells remove the cells at their addresses. Dependencies are updated and
+     * content-changed events are triggered only after all the cells are placed. Addresses
+     * of the cells must be unique.
+     */
+    void setCells(const vector<shared_ptr<CellBase>> &cells);
+
     /**
      * Changes type of the cell specified by its address.
      *
@@ -128,6 +406,63 @@ public:
     template<typename T>
     void setCellType(const Address &addr);
 
+    /**
+     * Changes type of the cell specified by its address.
+     *
+     * @throws InvalidTypeException
+     */
+    void setCellType(const Address &addr, TypeTag type);
+
+    /**
+     * Takes an immutable snapshot of all cells. Cheap: copies only pointers to the cells. Keeps
+     * all the cells of an out-of-core sheet in memory while the snapshot exists.
+     */
+    shared_ptr<const SheetSnapshot> snapshot() const;
+
+    /**
+     * Calls the function for every cell, in no particular order. Out-of-core sheets stay within
+     * their memory budget.
+     */
+    void forEachCell(const function<void(const CellBase &)> &fn) const;
+
+    /**
+     * @return Counters of the work done by the sheet, incremented by its cells and formulas.
+     */
+    SheetCounters &getCounters() const
+    {
+        return m_Counters;
+    }
+
+    /**
+     * @return Current sizes and counters of the sheet. Looks at every tile (not loading any)
+     *         to add up the memory of number literals.
+     */
+    Stats getStats() const;
+
+    /**
+     * Calls the function for every cell, possibly from several threads at once, without
+     * creating objects of number literal cells, see CellStore::scan(). The function must not
+     * use the sheet.
+     *
+     * @param fn Called with the address, the cell or nullptr, and the value of the number
+     *           literal if the cell is nullptr.
+     */
+    void scanCells(
+        const function<void(const Address &, const CellBase *, const Value &)> &fn,
+        unsigned threads = 0) const;
+
+    /**
+     * @return Whether the sheet is backed by a tile file.
+     */
+    bool isOutOfCore() const;
+
+    /**
+     * Writes all modified cells of an out-of-core sheet to its tile file.
+     *
+     * @throws IOException
+     */
+    void saveTiles();
+
     /**
      * Serializes the address to given output stream in JSON as object where keys are addresses
      * and values are cells.
@@ -137,48 +472,82 @@ public:
     /**
      * Creates a new Sheet from given input stream in JSON.
      *
+     * @param loaded If given, called with each cell as soon as it's read, before
+     *               the dependencies are built (so formulas cannot be evaluated yet).
+     * @param cancelled If given, checked for every cell read and every cell the dependencies
+     *                  are built for.
+     *
      * @throws InvalidInputException
+     * @throws CancelledException Once the flag is set.
      */
-    static shared_ptr<Sheet> deserialize(istream &is);
+    static shared_ptr<Sheet> deserialize(
+        istream &is,
+        const function<void(const CellBase &)> &loaded = nullptr,
+        const atomic<bool> *cancelled = nullptr);
 };
 
-template<typename T>
-class Cell;
-
 namespace Formula
 {
     /**
-     * Abstract class for any function evaluating to a value of type T.
-     *
-     * @tparam T Type to which this function evaluates.
+     * Abstract class for any function evaluating to a Value. Functions are allocated from
+     * the pool of the sheet of their cell: new (pool) Add(...).
      */
-    template<typename T>
     class Function
     {
     public:
+        virtual ~Function() = default;
+
+        /**
+         * Counted by the pool, see Pool::getNodeCount().
+         */
+        static void *operator new(size_t size, Pool &pool)
+        {
+            return pool.allocateNode(size);
+        }
+
+        static void operator delete(void *ptr, size_t size)
+        {
+            Pool::releaseNode(ptr, size);
+        }
+
         /**
-         * Evaluates the function.
+         * Called if a constructor throws. The memory stays unused (and counted) until the pool
+         * is released.
+         */
+        static void operator delete(void *, Pool &)
+        {}
+
+        /**
+         * Evaluates the function. Errors are returned as error values, not thrown.
          *
          * @param sheet The Sheet this function works with.
          */
-        virtual T evaluate(const Sheet &sheet) = 0;
+        virtual Value evaluate(const Sheet &sheet) = 0;
+
+        /**
+         * Appends the function's source text to the string.
+         */
+        virtual void appendSource(string &out) const = 0;
 
         /**
          * Parses the function back to source text.
          */
-        virtual string toSource() const = 0;
+        string toSource() const
+        {
+            string out;
+            appendSource(out);
+
+            return out;
+        }
     };
 
     /**
-     * An abstract function that takes 1 argument of type T and evaluates to a value of type T.
-     *
-     * @tparam T Both type of argument and the return type.
+     * An abstract function that takes 1 argument.
      */
-    template<typename T>
-    class UnaryFunction : public Function<T>
+    class UnaryFunction : public Function
     {
     protected:
-        unique_ptr<Function<T>> m_Arg;
+        unique_ptr<Function> m_Arg;
 
     public:
         UnaryFunction() = delete;
@@ -188,31 +557,19 @@ namespace Formula
         /**
          * Initializes the argument.
          */
-        UnaryFunction(unique_ptr<Function<T>> arg)
+        UnaryFunction(unique_ptr<Function> arg)
             : m_Arg(move(arg))
         {}
-
-        /**
-         * Evaluates the function.
-         *
-         * @param sheet The Sheet this function works with.
-         */
-        virtual T evaluate(const Sheet &sheet)  = 0;
-
-        virtual string toSource() const = 0;
     };
 
     /**
-     * An abstract function that takes 2 arguments of type T and evaluates to a value of type T.
-     *
-     * @tparam T Both function arguments type and the return type.
+     * An abstract function that takes 2 arguments.
      */
-    template<typename T>
-    class BinaryFunction : public Function<T>
+    class BinaryFunction : public Function
     {
     protected:
-        unique_ptr<Function<T>> m_Arg1;
-        unique_ptr<Function<T>> m_Arg2;
+        unique_ptr<Function> m_Arg1;
+        unique_ptr<Function> m_Arg2;
 
     public:
         BinaryFunction() = delete;
@@ -222,78 +579,58 @@ namespace Formula
         /**
          * Initializes the arguments.
          */
-        BinaryFunction(unique_ptr<Function<T>> arg1, unique_ptr<Function<T>> arg2)
+        BinaryFunction(unique_ptr<Function> arg1, unique_ptr<Function> arg2)
             : m_Arg1(move(arg1)),
               m_Arg2(move(arg2))
         {}
-
-        /**
-         * Evaluates the function.
-         *
-         * @param sheet The Sheet this function works with.
-         */
-        virtual T evaluate(const Sheet &sheet)  = 0;
-
-        /**
-         * Parses the function back to source text.
-         */
-        virtual string toSource() const = 0;
     };
 
     /**
      * Represents a literal value in the form of a function which evaluates to the given value.
-     *
-     * @tparam T Type of the literal.
      */
-    template<typename T>
-    class Literal : public Function<T>
+    class Literal : public Function
     {
-        const T m_Value;
+        const Value m_Value;
 
     public:
         /**
          * Initializes the value.
          */
-        Literal(const T &value)
+        Literal(const Value &value)
             : m_Value(value)
         {}
 
-        /**
-         * Evaluates the literal.
-         *
-         * @param sheet The Sheet this function works with.
-         * @return The value this literal was initialized with.
-         */
-        T evaluate(const Sheet &sheet) override
+        Value evaluate(const Sheet &sheet) override
         {
             return m_Value;
         }
 
-        string toSource() const override
+        void appendSource(string &out) const override
         {
-            return Type<T>::toString(m_Value, true);
-        }
-
-        string toSource(bool isLiteral) const
-        {
-            return Type<T>::toString(m_Value, isLiteral);
+            out += m_Value.toString(true);
         }
     };
 
     /**
-     * A function which evaluates to the value of linked cell.
-     *
-     * @tparam T Type to which this link evaluates.
+     * Link to another cell. Evaluates to the linked cell's value converted to the type
+     * of the cell containing the link.
      */
-    template<typename T>
-    class Link : public Function<T>
+    class Link : public Function
     {
         /**
          * Address of the linked cell.
          */
         const Address m_Addr;
 
-        bool evaluating = false;
+        /**
+         * Type the linked value is converted to.
+         */
+        const TypeTag m_Type;
+
+        /**
+         * Linked cell resolved by the last evaluation.
+         */
+        Sheet::CellHandle m_Target;
 
     public:
         Link() = delete;
@@ -301,475 +638,285 @@ namespace Formula
         Link(Link &&) = delete;
 
         /**
-         * Initializes the address.
+         * Initializes the address and the type.
          */
-        Link(const Address &addr)
-            : m_Addr(addr)
+        Link(const Address &addr, TypeTag type)
+            : m_Addr(addr),
+              m_Type(type)
         {}
 
         /**
-         * Evaluates to the value of linked cell.
+         * Evaluates to the value of linked cell. The cell is looked up only if it was replaced
+         * since the last evaluation.
          *
          * @param sheet The Sheet this function works with.
          *
-         * @throws DependencyLoopException
-         * @throws InvalidTypeException If linked cell's value is not of type T.
+         * @return Loop error if the linked cell is being evaluated, type error if its value
+         *         doesn't convert to the type.
          */
-        T evaluate(const Sheet &sheet) override
-        {
-            if (evaluating) {
-                throw DependencyLoopException();
-            }
-
-            shared_ptr<const CellBase> linkedCellBase = sheet.getCell(m_Addr);
-
-            const Cell<T> *linkedCell = dynamic_cast<const Cell<T> *>(linkedCellBase.get());
-
-            if (linkedCell == nullptr) {
-                throw InvalidTypeException();
-            }
-
-            evaluating = true;
-            try {
-                T res = linkedCell->getContent();
-                evaluating = false;
-                return res;
-            } catch (...) {
-                evaluating = false;
-                throw;
-            }
-        }
+        Value evaluate(const Sheet &sheet) override;
 
-        string toSource() const override
+        void appendSource(string &out) const override
         {
-            return m_Addr;
+            out += (string) m_Addr;
         }
     };
 
     /**
-     * Function for addition.
-     *
-     * @tparam T Both function arguments type and the return type.
+     * Function for addition of numbers and concatenation of strings.
      */
-    template<typename T>
-    class Add : public BinaryFunction<T>
+    class Add : public BinaryFunction
     {
     public:
-        Add() = delete;
-        Add(const Add &) = delete;
-        Add(Add &&) = delete;
-
-        /**
-         * Initializes the arguments.
-         */
-        Add(unique_ptr<Function<T>> arg1, unique_ptr<Function<T>> arg2)
-            : BinaryFunction<T>(move(arg1), move(arg2))
-        {}
+        using BinaryFunction::BinaryFunction;
 
         /**
          * Evaluates the argument functions and returns their sum.
          *
          * @param sheet The Sheet this function works with.
          */
-        T evaluate(const Sheet &sheet) override
-        {
-            throw InvalidTypeException();
-        }
+        Value evaluate(const Sheet &sheet) override;
 
-        string toSource() const override
+        void appendSource(string &out) const override
         {
-            return this->m_Arg1->toSource() + "+" + this->m_Arg2->toSource();
+            m_Arg1->appendSource(out);
+            out += '+';
+            m_Arg2->appendSource(out);
         }
     };
 
     /**
      * Function for subtraction.
-     *
-     * @tparam T Both function arguments type and the return type.
      */
-    template<typename T>
-    class Sub : public BinaryFunction<T>
+    class Sub : public BinaryFunction
     {
     public:
-        Sub() = delete;
-        Sub(const Sub &) = delete;
-        Sub(Sub &&) = delete;
-
-        /**
-         * Initializes the arguments.
-         */
-        Sub(unique_ptr<Function<T>> minuend, unique_ptr<Function<T>> subtrahend)
-            : BinaryFunction<T>(move(minuend), move(subtrahend))
-        {}
+        using BinaryFunction::BinaryFunction;
 
         /**
          * Evaluates the argument functions and returns their difference.
          *
          * @param sheet The Sheet this function works with.
          */
-        T evaluate(const Sheet &sheet) override
-        {
-            throw InvalidTypeException();
-        }
+        Value evaluate(const Sheet &sheet) override;
 
-        string toSource() const override
+        void appendSource(string &out) const override
         {
-            return this->m_Arg1->toSource() + "-" + this->m_Arg2->toSource();
+            m_Arg1->appendSource(out);
+            out += '-';
+            m_Arg2->appendSource(out);
         }
     };
 
     /**
      * Function for multiplication.
-     *
-     * @tparam T Both function arguments type and the return type.
      */
-    template<typename T>
-    class Mul : public BinaryFunction<T>
+    class Mul : public BinaryFunction
     {
     public:
-        Mul() = delete;
-        Mul(const Mul &) = delete;
-        Mul(Mul &&) = delete;
-
-        /**
-         * Initializes the arguments.
-         */
-        Mul(unique_ptr<Function<T>> arg1, unique_ptr<Function<T>> arg2)
-            : BinaryFunction<T>(move(arg1), move(arg2))
-        {}
+        using BinaryFunction::BinaryFunction;
 
         /**
          * Evaluates the argument functions and returns their product.
          *
          * @param sheet The Sheet this function works with.
          */
-        T evaluate(const Sheet &sheet) override
-        {
-            throw InvalidTypeException();
-        }
+        Value evaluate(const Sheet &sheet) override;
 
-        string toSource() const override
+        void appendSource(string &out) const override
         {
-            return this->m_Arg1->toSource() + "*" + this->m_Arg2->toSource();
+            m_Arg1->appendSource(out);
+            out += '*';
+            m_Arg2->appendSource(out);
         }
     };
 
     /**
      * Function for division.
-     *
-     * @tparam T Both function arguments type and the return type.
      */
-    template<typename T>
-    class Div : public BinaryFunction<T>
+    class Div : public BinaryFunction
     {
     public:
-        Div() = delete;
-        Div(const Div &) = delete;
-        Div(Div &&) = delete;
-
-        /**
-         * Initializes the arguments.
-         */
-        Div(unique_ptr<Function<T>> dividend, unique_ptr<Function<T>> divisor)
-            : BinaryFunction<T>(move(dividend), move(divisor))
-        {}
+        using BinaryFunction::BinaryFunction;
 
         /**
          * Evaluates the argument functions and returns their quotient.
          *
          * @param sheet The Sheet this function works with.
+         * @return Division by zero error if dividing ints by zero.
          */
-        T evaluate(const Sheet &sheet) override
-        {
-            throw InvalidTypeException();
-        }
+        Value evaluate(const Sheet &sheet) override;
 
-        string toSource() const override
+        void appendSource(string &out) const override
         {
-            return this->m_Arg1->toSource() + "/" + this->m_Arg2->toSource();
+            m_Arg1->appendSource(out);
+            out += '/';
+            m_Arg2->appendSource(out);
         }
     };
 
     /**
      * Function for absolute value.
      */
-    template<typename T>
-    class Abs : public UnaryFunction<T>
+    class Abs : public UnaryFunction
     {
     public:
-        Abs() = delete;
-        Abs(const Abs &) = delete;
-        Abs(Abs &&) = delete;
-
-        /**
-         * Initializes the argument.
-         */
-        Abs(unique_ptr<Function<T>> arg)
-            : UnaryFunction<T>(move(arg))
-        {}
+        using UnaryFunction::UnaryFunction;
 
         /**
          * Evaluates the argument function and returns its absolute value.
          *
          * @param sheet The Sheet this function works with.
          */
-        T evaluate(const Sheet &sheet) override
-        {
-            throw InvalidTypeException();
-        }
+        Value evaluate(const Sheet &sheet) override;
 
-        string toSource() const override
+        void appendSource(string &out) const override
         {
-            return string("ABS(") + this->m_Arg->toSource() + ")";
+            out += "ABS(";
+            m_Arg->appendSource(out);
+            out += ')';
         }
     };
 
     /**
      * Sine function.
      */
-    template<typename T>
-    class Sin : public UnaryFunction<T>
+    class Sin : public UnaryFunction
     {
     public:
-        Sin() = delete;
-        Sin(const Sin &) = delete;
-        Sin(Sin &&) = delete;
-
-        /**
-         * Initializes the argument.
-         */
-        Sin(unique_ptr<Function<T>> arg)
-            : UnaryFunction<T>(move(arg))
-        {}
+        using UnaryFunction::UnaryFunction;
 
         /**
          * Evaluates the argument function and returns its sine value.
          *
          * @param sheet The Sheet this function works with.
-         * @return Rounded if T too small.
+         * @return Rounded if the argument is an int.
          */
-        T evaluate(const Sheet &sheet) override
-        {
-            throw InvalidTypeException();
-        }
+        Value evaluate(const Sheet &sheet) override;
 
-        string toSource() const override
+        void appendSource(string &out) const override
         {
-            return string("SIN(") + this->m_Arg->toSource() + ")";
+            out += "SIN(";
+            m_Arg->appendSource(out);
+            out += ')';
         }
     };
 
     /**
      * Cosine function.
      */
-    template<typename T>
-    class Cos : public UnaryFunction<T>
+    class Cos : public UnaryFunction
     {
     public:
-        Cos() = delete;
-        Cos(const Cos &) = delete;
-        Cos(Cos &&) = delete;
-
-        /**
-         * Initializes the argument.
-         */
-        Cos(unique_ptr<Function<T>> arg)
-            : UnaryFunction<T>(move(arg))
-        {}
+        using UnaryFunction::UnaryFunction;
 
         /**
          * Evaluates the argument function and returns its cosine value.
          *
          * @param sheet The Sheet this function works with.
-         * @return Rounded if T too small.
+         * @return Rounded if the argument is an int.
          */
-        T evaluate(const Sheet &sheet) override
-        {
-            throw InvalidTypeException();
-        }
+        Value evaluate(const Sheet &sheet) override;
 
-        string toSource() const override
+        void appendSource(string &out) const override
         {
-            return string("COS(") + this->m_Arg->toSource() + ")";
+            out += "COS(";
+            m_Arg->appendSource(out);
+            out += ')';
         }
     };
 
     /**
      * Tangent function.
      */
-    template<typename T>
-    class Tan : public UnaryFunction<T>
+    class Tan : public UnaryFunction
     {
     public:
-        Tan() = delete;
-        Tan(const Tan &) = delete;
-        Tan(Tan &&) = delete;
-
-        /**
-         * Initializes the argument.
-         */
-        Tan(unique_ptr<Function<T>> arg)
-            : UnaryFunction<T>(move(arg))
-        {}
+        using UnaryFunction::UnaryFunction;
 
         /**
          * Evaluates the argument function and returns its tangent value.
          *
          * @param sheet The Sheet this function works with.
-         * @return Rounded if T too small.
+         * @return Rounded if the argument is an int.
          */
-        T evaluate(const Sheet &sheet) override
-        {
-            throw InvalidTypeException();
-        }
+        Value evaluate(const Sheet &sheet) override;
 
-        string toSource() const override
+        void appendSource(string &out) const override
         {
-            return string("TAN(") + this->m_Arg->toSource() + ")";
+            out += "TAN(";
+            m_Arg->appendSource(out);
+            out += ')';
         }
     };
 
     class Parser
     {
         /**
-         * Determines whether the given text matches the syntax of a link.
+         * Determines whether source[begin, end) matches the syntax of a link.
          */
-        static bool isLink(const string &source);
+        static bool isLink(const string &source, size_t begin, size_t end);
 
         /**
-         * Determines whether the given text matches the syntax of a literal of type T.
+         * Parses source[begin, end) as a literal, if it matches the syntax of a literal of
+         * the type. Int literals are also double literals.
+         *
+         * @return Whether the text is a literal.
          *
          * @throws InvalidTypeException
          */
-        template<typename T>
-        static bool isLiteral(const string &source)
-        {
-            throw InvalidTypeException();
-        }
+        static bool parseLiteral(
+            const string &source,
+            size_t begin,
+            size_t end,
+            TypeTag type,
+            Value &value);
 
         /**
-         * Finds all logical sections in the given source text.
-         *
-         * Separators always include ^ and $.
+         * Finds the end of the operand starting at the position: the first operator, comma or
+         * whitespace outside of parentheses and string literals.
          *
          * EXAMPLES:
-         *     5+ABS(7)-ABS(1,ABS(2,3))
-         *     returns { "5", "+", "ABS(7)", "-", "ABS(1,ABS(2,3))" }
-         *
-         *     1.5,ABS(2,3)
-         *     returns { "1.5", ",", "ABS(2,3)" }
+         *     5+ABS(7)-ABS(1,ABS(2,3)) from 0 ends at 1
+         *     5+ABS(7)-ABS(1,ABS(2,3)) from 2 ends at 8
+         *     "1+2",ABS(9,8) from 0 ends at 5
          *
-         *     1+(2-3)
-         *     returns { "1", "+", "2-3" }
-         *
-         *     1,ABS(9,8),3
-         *     returns { "1", ",", "ABS(9,8)", ",", "3" }
+         * @throws IncorrectFormulaSyntaxException If parentheses or quotes are not balanced.
+         */
+        static size_t findOperandEnd(const string &source, size_t pos, size_t end);
+
+        /**
+         * Parses source[begin, end) as operands joined by operators, all of the same priority,
+         * processed from left to right. Works on positions in the source, so parsing copies no
+         * parts of it.
          *
-         *     1+"1+2","foo ABS(9,8)"
-         *     returns { "1", "+", "\"1+2\"", ",", "\"foo ABS(9,8)\"" }
+         * @param type Type of the cell the formula belongs to.
          *
          * @throws IncorrectFormulaSyntaxException
+         * @throws InvalidTypeException
          */
-        static vector<string> splitLogical(
+        static unique_ptr<Function> parseExpression(
             const string &source,
-            const string &separators = ",+-*/");
+            size_t begin,
+            size_t end,
+            TypeTag type,
+            AddressList &dependencies,
+            Pool &pool);
 
         /**
-         * Parses given formula sections to Functions structure. Fills given container with address
-         * dependencies of the formula.
-         *
-         * @tparam T Return type of parsed Function.
+         * Parses source[begin, end) as a single operand: literal, link, function or
+         * parenthesized expression.
          *
          * @throws IncorrectFormulaSyntaxException
          * @throws InvalidTypeException
          */
-        template<typename T>
-        static unique_ptr<Function<T>> parse(
-            const vector<string> &sections,
-            vector<Address> &dependencies)
-        {
-            if (sections.size() == 1) {
-                /* literal */
-                if (isLiteral<T>(sections[0])) {
-                    return make_unique<Literal<T>>(Type<T>::fromString(sections[0], true));
-                }
-
-                /* link */
-                if (isLink(sections[0])) {
-                    Address addr = sections[0];
-                    dependencies.push_back(addr);
-                    return make_unique<Link<T>>(addr);
-                }
-
-                /* nested expression */
-                const vector<string> newSections = splitLogical(sections[0]);
-                if (sections != newSections) {
-                    return parse<T>(newSections, dependencies);
-                }
-
-                /* function */
-                size_t parenthesesPos = sections[0].find('(');
-                if (parenthesesPos > 0 && parenthesesPos != string::npos &&
-                    sections[0][sections[0].length() - 1] == ')') {
-                    string identifier = Utils::toLower(sections[0].substr(0, parenthesesPos));
-
-                    vector<string> arguments = splitLogical(
-                        sections[0]
-                            .substr(
-                                parenthesesPos + 1,
-                                sections[0].length() - (parenthesesPos + 1) - 1),
-                        ",");
-
-                    if (identifier == "abs" && arguments.size() == 1) {
-                        return make_unique<Abs<T>>(
-                            parse<T>(splitLogical(arguments[0]), dependencies));
-                    }
-
-                    if (identifier == "sin" && arguments.size() == 1) {
-                        return make_unique<Sin<T>>(
-                            parse<T>(splitLogical(arguments[0]), dependencies));
-                    }
-
-                    if (identifier == "cos" && arguments.size() == 1) {
-                        return make_unique<Cos<T>>(
-                            parse<T>(splitLogical(arguments[0]), dependencies));
-                    }
-
-                    if (identifier == "tan" && arguments.size() == 1) {
-                        return make_unique<Tan<T>>(
-                            parse<T>(splitLogical(arguments[0]), dependencies));
-                    }
-                }
-            }
-
-            /* operations */
-            if (sections.size() >= 3 && sections[sections.size() - 2].length() == 1) {
-                char op = sections[sections.size() - 2][0];
-
-                vector<string> leftSections(sections.begin(), sections.end() - 2);
-
-                unique_ptr<Function<T>> arg1 = parse<T>(
-                    leftSections.size() > 1 ? leftSections : splitLogical(leftSections[0]),
-                    dependencies);
-
-                unique_ptr<Function<T>> arg2 = parse<T>(
-                    splitLogical(sections[sections.size() - 1]),
-                    dependencies);
-
-                switch (op) {
-                case '+':
-                    return make_unique<Add<T>>(move(arg1), move(arg2));
-                case '-':
-                    return make_unique<Sub<T>>(move(arg1), move(arg2));
-                case '*':
-                    return make_unique<Mul<T>>(move(arg1), move(arg2));
-                case '/':
-                    return make_unique<Div<T>>(move(arg1), move(arg2));
-                }
-            }
-
-            throw IncorrectFormulaSyntaxException();
-        }
+        static unique_ptr<Function> parseOperand(
+            const string &source,
+            size_t begin,
+            size_t end,
+            TypeTag type,
+            AddressList &dependencies,
+            Pool &pool);
 
     public:
         /**
@@ -813,32 +960,35 @@ namespace Formula
          *         <expr>/<expr>
          *
          * @note All operations have the same priority and are processed from left to right.
-         * @note Whitespaces are not allowed (except in string literals).
+         * @note Whitespaces are allowed only around operands and operators (and in string
+         *       literals).
+         * @note Literals must be of the cell's type, ints are allowed in double cells. Links
+         *       evaluate to the linked values converted to the cell's type.
          *
-         * @tparam T Return type of parsed Function.
+         * @param type Type of the cell the formula belongs to.
+         * @param pool Pool the functions are allocated from.
          *
          * @throws IncorrectFormulaSyntaxException
          * @throws InvalidTypeException
          */
-        template<typename T>
-        static unique_ptr<Function<T>> parseSource(
+        static unique_ptr<Function> parseSource(
             const string &source,
-            vector<Address> &dependencies)
-        {
-            return parse<T>(splitLogical(source), dependencies);
-        }
+            TypeTag type,
+            AddressList &dependencies,
+            Pool &pool);
     };
 }
 
 /**
- * Generic class representing one cell in the sheet specified by its address.
+ * One cell in the sheet specified by its address. The cell has a type (int, double or string)
+ * and its value is always of that type or an error.
  *
  * Immutable.
  *
- * Every content is worked with as a formula (Function). Even if it's general text or number,
- * it is parsed as a literal, which is a Function.
+ * Non-formula content is stored as the value itself. Formula content is parsed to a Function
+ * evaluated on access. The sheet stores number literal cells without their objects (see
+ * CellStore) and creates the objects only when they are asked for.
  */
-template<typename T>
 class Cell : public CellBase
 {
     /**
@@ -848,142 +998,139 @@ class Cell : public CellBase
 
     /**
      * If the cell's content is a formula: Parsed formula.
-     * If the cell's content is not a formula: Literal evaluating to static content.
      */
-    unique_ptr<Formula::Function<T>> m_Formula;
+    unique_ptr<Formula::Function> m_Formula;
+
+    /**
+     * Canonical source of the content, nullptr for strings, whose source is their value.
+     * Sources of formulas are interned in the sheet's StringPool, as formulas repeat a lot.
+     */
+    shared_ptr<const string> m_Source;
+
+    enum class State : uint8_t
+    {
+        INVALID,
+        EVALUATING,
+        VALID
+    };
+
+    /**
+     * If the cell's content is a formula: Whether m_Value holds its current value.
+     */
+    mutable State m_State = State::INVALID;
+
+    /**
+     * If the cell's content is not a formula: The content.
+     *
+     * If the cell's content is a formula: Value of the last evaluation, kept until the sheet
+     * invalidates it because a precedent changed.
+     */
+    mutable Value m_Value;
+
+    /**
+     * Evaluates the formula, evaluating the formulas of its not yet evaluated precedents first.
+     * Precedents are scheduled on an explicit stack rather than by recursion, so the length
+     * of dependency chains is limited only by memory. A precedent that is being evaluated
+     * already closes a dependency loop and evaluates to a loop error.
+     */
+    void evaluate() const;
+
+    /**
+     * Initializes the source of the literal from its value.
+     */
+    void initLiteralSource();
 
 public:
     Cell() = delete;
-    Cell(const Cell<T> &) = delete;
-    Cell(Cell<T> &&) = delete;
+    Cell(const Cell &) = delete;
+    Cell(Cell &&) = delete;
 
     /**
-     * Initializes sheet, address and content, parsing its formula and creating dependencies.
+     * Initializes sheet, address, type and content, parsing its formula and creating
+     * dependencies.
      *
      * @throws IncorrectFormulaSyntaxException
      * @throws InvalidTypeException
      */
-    Cell(const Sheet &sheet, const Address &addr, const string &content)
-        : CellBase(sheet, addr)
-    {
-        if (content.length() > 0 && content[0] == '=') {
-            m_IsFormula = true;
-            m_Formula = Formula::Parser::parseSource<T>(content.substr(1), m_Dependencies);
-        } else {
-            m_IsFormula = false;
-            m_Formula = make_unique<Formula::Literal<T>>(Type<T>::fromString(content));
-        }
-    }
+    Cell(const Sheet &sheet, const Address &addr, TypeTag type, const string &content);
 
     /**
-     * Initializes sheet and address. Content is the type's default value.
+     * Initializes sheet, address and type. Content is the type's default value.
      */
-    Cell(const Sheet &sheet, const Address &addr)
-        : CellBase(sheet, addr)
-    {
-        m_IsFormula = false;
-        m_Formula = make_unique<Formula::Literal<T>>(Type<T>::defaultValue);
-    }
+    Cell(const Sheet &sheet, const Address &addr, TypeTag type);
 
-    string getType() const override
-    {
-        return Type<T>::name;
-    }
+    /**
+     * Initializes sheet and address, the content is the number literal. Of the number's type.
+     */
+    Cell(const Sheet &sheet, const Address &addr, const Value &number);
 
     /**
-     * @return Content of the cell, evaluated.
-     *
-     * @throws InvalidTypeException If there is a Link in the formula and it doesn't evaluate
-     *                              to type T.
+     * Creates a cell in the pool of the sheet, passing the arguments to a constructor.
      */
-    T getContent() const
-    {
-        return m_Formula->evaluate(m_Sheet);
-    }
+    template<typename... Args>
+    static shared_ptr<Cell> make(const Sheet &sheet, Args &&... args);
+
+    string getType() const override;
+
+    /**
+     * @return Whether the content of the cell is a formula.
+     */
+    bool isFormula() const;
+
+    /**
+     * @return Content of the cell, evaluated. Of the cell's type or an error. Formulas are
+     *         evaluated only if they were not since the last invalidate().
+     */
+    Value getValue() const override;
+
+    /**
+     * @return Whether getValue() returns without evaluating anything: the content is not
+     *         a formula or its value is still valid.
+     */
+    bool isEvaluated() const;
+
+    /**
+     * Drops the value of the formula, so that the next getValue() evaluates it again. Called by
+     * the sheet for all dependents of a changed cell.
+     */
+    void invalidate() const;
 
     /**
      * @return Evaluated cell's content converted to string.
      *
      * @throws InvalidTypeException If there is a Link in the formula and it doesn't evaluate
-     *                              to type T.
+     *                              to the cell's type.
+     * @throws DependencyLoopException
+     * @throws ArithmeticException
      */
-    string getContentText() const override
-    {
-        return Type<T>::toString(getContent());
-    }
+    string getContentText() const override;
 
     /**
      * @return Cell's content's source. This is either source of the formula or literal converted
-     *         to string.
+     *         to string. Kept by the cell rather than generated on every call.
      */
-    string getContentSource() const override
-    {
-        if (m_IsFormula) {
-            /* formula */
-            return string("=") + m_Formula->toSource();
-        }
-
-        /* literal - pass isLiteral(false) to indicate that we want pure value (i.e. not a string
-         * surrounded by double quotes) */
-        return static_cast<Formula::Literal<T> *>(m_Formula.get())->toSource(false);
-    }
+    const string &getContentSource() const override;
 
     /**
      * Serializes the cell to given output stream in JSON as object with cell type and its source
      * content.
      */
-    void serialize(ostream &os) const override
-    {
-        os << "{";
-        os << "\"type\":\"" << Utils::escapeString(Type<T>::name) << "\",";
-        os << "\"addr\":";
-        m_Addr.serialize(os);
-        os << ",";
-        os << "\"content\":\"" << Utils::escapeString(getContentSource()) << "\"";
-        os << "}";
-
-        os.flush();
-    }
+    void serialize(ostream &os) const override;
 
-    shared_ptr<CellBase> create(const string &content) override
-    {
-        return make_shared<Cell<T>>(m_Sheet, m_Addr, content);
-    }
+    shared_ptr<CellBase> create(const string &content) override;
 };
 
+template<typename... Args>
+shared_ptr<Cell> Cell::make(const Sheet &sheet, Args &&... args)
+{
+    return allocate_shared<Cell>(PoolAllocator<Cell>(sheet.getPool()), sheet,
+                                 forward<Args>(args)...);
+}
+
 template<typename T>
 void Sheet::setCellType(const Address &addr)
 {
-    unordered_map<Address, shared_ptr<CellBase>>::iterator it = m_Cells.find(addr);
-
-    shared_ptr<CellBase> cell;
-
-    /* cell doesn't exist yet */
-    if (it == m_Cells.end()) {
-        /* don't create empty string cell */
-        if (is_same<T, string>::value) {
-            return;
-        }
-
-        cell = make_shared<Cell<T>>(*this, addr);
-        m_Cells[addr] = cell;
-    } else if (is_same<T, string>::value && it->second->getContentSource().empty()) {
-        cell = it->second;
-        deleteDependencies(cell);
-        m_Cells.erase(it);
-    } else {
-        // todo: don't recreate cell if the type doesn't change
-
-        cell = make_shared<Cell<T>>(*this, addr, it->second->getContentSource());
-
-        deleteDependencies(it->second);
-        m_Cells[addr] = cell;
-        createDependencies(cell);
-    }
-
-    /* if T is string and cell's content is empty, it is now removed from m_Cells, but "cell" still
-     * holds the last reference, so we can use it to trigger the content-changed event */
-    distributeContentChangedEvent(cell);
+    setCellType(addr, Type<T>::tag);
 }
 
 #endif /* SPREADSHEET_SHEET_H */
@@ -0,0 +1,94 @@
+#ifndef SPREADSHEET_SHEET_SNAPSHOT_H
+#define SPREADSHEET_SHEET_SNAPSHOT_H
+
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "CellBase.h"
+#include "Serializable.h"
+
+using namespace std;
+
+/**
+ * Immutable view of all cells of a sheet at one moment. Since cells themselves are immutable,
+ * taking a snapshot only copies the pointers to them and the snapshot stays consistent no matter
+ * what happens to the sheet afterwards. Can therefore be serialized on another thread while
+ * the sheet is being edited.
+ *
+ * Number literals are copied as records of their addresses and values, the way the sheet
+ * keeps them (see CellStore), rather than made into cell objects.
+ */
+class SheetSnapshot : public Serializable
+{
+public:
+    /**
+     * Int or double cell without a formula.
+     */
+    struct Literal
+    {
+        Address addr;
+
+        /**
+         * The value, exact for ints too.
+         */
+        double number;
+
+        bool isInt;
+
+        Value getValue() const;
+
+        /**
+         * @return Type name of the cell.
+         */
+        const string &getType() const;
+    };
+
+private:
+    /**
+     * Non-empty cells of the sheet other than number literals.
+     */
+    const vector<shared_ptr<const CellBase>> m_Cells;
+
+    const vector<Literal> m_Literals;
+
+public:
+    SheetSnapshot() = delete;
+    SheetSnapshot(const SheetSnapshot &) = delete;
+    SheetSnapshot(SheetSnapshot &&) = delete;
+
+    /**
+     * Initializes the cells.
+     */
+    SheetSnapshot(vector<shared_ptr<const CellBase>> cells, vector<Literal> literals);
+
+    /**
+     * @return Non-empty cells of the sheet other than number literals, in no particular order.
+     */
+    const vector<shared_ptr<const CellBase>> &getCells() const;
+
+    /**
+     * @return Number literals of the sheet, in no particular order.
+     */
+    const vector<Literal> &getLiterals() const;
+
+    /**
+     * Calls the function for all non-empty cells of the sheet, sorted by row and then by
+     * column, with either the cell object or the number literal, the other is nullptr.
+     */
+    void forEachRowMajor(const function<void(const CellBase *, const Literal *)> &fn) const;
+
+    /**
+     * @return Number of cells in the snapshot.
+     */
+    size_t size() const;
+
+    /**
+     * Serializes the snapshot to given output stream in the same format as Sheet::serialize().
+     */
+    void serialize(ostream &os) const override;
+};
+
+#endif /* SPREADSHEET_SHEET_SNAPSHOT_H */
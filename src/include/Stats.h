@@ -0,0 +1,122 @@
+#ifndef SPREADSHEET_STATS_H
+#define SPREADSHEET_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+
+#include "Serializable.h"
+
+using namespace std;
+
+/**
+ * Counters of the work done by a sheet since it was created, see Sheet::getCounters().
+ * Incremented on every evaluation, so an increment is a relaxed load and store rather than
+ * a locked read-modify-write: as cheap as a plain variable, and still well-defined when
+ * the cells of a sheet are read by several threads at once (see Sheet::scanCells()), at
+ * the cost of losing increments of racing threads.
+ */
+struct SheetCounters
+{
+    /**
+     * Formulas evaluated.
+     */
+    atomic<size_t> evaluations;
+
+    /**
+     * Values of formulas asked for while valid (hits) or not (misses, followed by evaluation).
+     */
+    atomic<size_t> valueHits;
+    atomic<size_t> valueMisses;
+
+    /**
+     * Links of formulas to their cells followed through a valid handle (hits) or looked up
+     * in the sheet (misses).
+     */
+    atomic<size_t> linkHits;
+    atomic<size_t> linkMisses;
+
+    /**
+     * Edits whose changed cells had dependents, which were invalidated to be evaluated again.
+     */
+    atomic<size_t> recalcs;
+
+    /**
+     * Time the last of those edits took to find and invalidate the dependents, -1 if none yet.
+     */
+    atomic<long> lastInvalidationMicros;
+
+    SheetCounters();
+
+    static void increment(atomic<size_t> &counter)
+    {
+        counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+};
+
+/**
+ * Sizes and counters of a sheet at one moment (see Sheet::getStats()), along with those
+ * of the UI working with it. Serialized as a JSON object; durations that are not known are
+ * null.
+ */
+struct Stats : public Serializable
+{
+    size_t cells = 0;
+
+    /**
+     * Nodes of the parsed formulas of the sheet in memory.
+     */
+    size_t formulaNodes = 0;
+
+    size_t dependencyEdges = 0;
+
+    /**
+     * Distinct interned sources of formulas.
+     */
+    size_t internedStrings = 0;
+
+    /**
+     * Chunks of the sheet's Pool: cell objects, formulas, interned sources and tables.
+     */
+    size_t poolBytes = 0;
+
+    /**
+     * Number literal records (see CellStore).
+     */
+    size_t literalBytes = 0;
+
+    size_t dependencyBytes = 0;
+
+    /**
+     * Estimate of the loaded tiles of an out-of-core sheet, 0 for in-memory sheets.
+     */
+    size_t loadedTileBytes = 0;
+
+    size_t evaluations = 0;
+    size_t valueHits = 0;
+    size_t valueMisses = 0;
+    size_t linkHits = 0;
+    size_t linkMisses = 0;
+    size_t recalcs = 0;
+
+    /**
+     * Time the last edit with dependents took to invalidate them, not including their
+     * evaluation.
+     */
+    long lastInvalidationMicros = -1;
+
+    /**
+     * Time the background recalculation of the UI took to evaluate the cells changed by
+     * the last edit.
+     */
+    long lastEvaluationMicros = -1;
+
+    /**
+     * Time the UI took to handle the last input event and draw the frame.
+     */
+    long lastRepaintMicros = -1;
+
+    void serialize(ostream &os) const override;
+};
+
+#endif /* SPREADSHEET_STATS_H */
@@ -0,0 +1,108 @@
+#ifndef SPREADSHEET_STRING_POOL_H
+#define SPREADSHEET_STRING_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "Pool.h"
+
+using namespace std;
+
+/**
+ * Interned strings: equal strings interned by the same pool share one copy, e.g. sources
+ * of formulas repeated across a sheet. A string is dropped from the pool when its last
+ * reference is released. The strings and the table are allocated from a Pool; like the Pool,
+ * the string pool is closed when its sheet is being destroyed, so that the strings are not
+ * dropped from the table one by one.
+ *
+ * Must be created by make_shared(), the strings keep their pool alive. Thread-safe: strings
+ * may be released by any thread dropping the last cell holding them.
+ */
+class StringPool : public enable_shared_from_this<StringPool>
+{
+    struct Hash
+    {
+        size_t operator()(const string *str) const
+        {
+            return hash<string>()(*str);
+        }
+    };
+
+    struct Equal
+    {
+        bool operator()(const string *lhs, const string *rhs) const
+        {
+            return *lhs == *rhs;
+        }
+    };
+
+    /**
+     * Interned string, in one block with its reference counts. Drops itself from the pool when
+     * destroyed.
+     */
+    struct Entry
+    {
+        shared_ptr<StringPool> pool;
+        string str;
+
+        Entry(shared_ptr<StringPool> pool, string &&str);
+        ~Entry();
+    };
+
+    typedef unordered_map<
+        const string *,
+        weak_ptr<const string>,
+        Hash,
+        Equal,
+        PoolAllocator<pair<const string *const, weak_ptr<const string>>>> StringMap;
+
+    shared_ptr<Pool> m_Pool;
+
+    mutex m_Mutex;
+
+    atomic<bool> m_Closed;
+
+    /**
+     * The interned strings, by their content.
+     */
+    StringMap m_Strings;
+
+    /**
+     * Drops the string from the table. Called when its last reference is released.
+     */
+    void release(const string *str);
+
+public:
+    StringPool() = delete;
+    StringPool(const StringPool &) = delete;
+    StringPool(StringPool &&) = delete;
+
+    /**
+     * @param pool Memory of the strings and the table.
+     */
+    explicit StringPool(shared_ptr<Pool> pool);
+
+    /**
+     * @return The interned string equal to the given one, interned now if there was none
+     *         (by moving the given string).
+     */
+    shared_ptr<const string> intern(string str);
+
+    /**
+     * Makes releasing strings leave the table alone from now on. No strings may be interned
+     * after that.
+     */
+    void close();
+
+    /**
+     * @return Number of distinct strings in the pool.
+     */
+    size_t size();
+};
+
+#endif /* SPREADSHEET_STRING_POOL_H */
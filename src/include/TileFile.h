@@ -0,0 +1,138 @@
+#ifndef SPREADSHEET_TILE_FILE_H
+#define SPREADSHEET_TILE_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/**
+ * File storing serialized tiles of a sheet (see CellStore), each addressed by its tile key.
+ *
+ * FORMAT:
+ *     8 bytes magic SSTILES1, 8 bytes offset of the index, then tiles and the index anywhere
+ *     after that. The index is the number of tiles followed by key, offset, length and number
+ *     of cells of every tile. All numbers are 64-bit in native byte order.
+ *
+ * CONSISTENCY:
+ *     Tiles are never overwritten in place while the saved index refers to them. Rewritten tiles
+ *     go to free space and the space of their previous versions is reused only after the next
+ *     saveIndex(). Writing the index offset to the header is therefore the only commit point and
+ *     the file always holds the state of the last save, no matter when the program stops.
+ */
+class TileFile
+{
+public:
+    /**
+     * Location of a tile within the file.
+     */
+    struct Extent
+    {
+        uint64_t offset;
+        uint64_t length;
+        uint64_t cells;
+    };
+
+private:
+    static const char MAGIC[8];
+
+    static const uint64_t HEADER_SIZE = 16;
+
+    int m_Fd = -1;
+
+    /**
+     * End of the used part of the file.
+     */
+    uint64_t m_End = HEADER_SIZE;
+
+    /**
+     * Current locations of tiles.
+     */
+    unordered_map<uint64_t, Extent> m_Index;
+
+    /**
+     * Index as of the last save.
+     */
+    unordered_map<uint64_t, Extent> m_SavedIndex;
+
+    /**
+     * Location of the saved index.
+     */
+    Extent m_SavedIndexExtent = {0, 0, 0};
+
+    /**
+     * Space that can be reused (offset, length).
+     */
+    vector<pair<uint64_t, uint64_t>> m_Free;
+
+    /**
+     * Space not referenced by the current index, but still referenced by the saved one.
+     */
+    vector<pair<uint64_t, uint64_t>> m_PendingFree;
+
+    /**
+     * Releases the extent, immediately if it's not referenced by the saved index.
+     */
+    void release(uint64_t key, const Extent &extent);
+
+    /**
+     * @return Offset of free space of the given length.
+     */
+    uint64_t allocate(uint64_t length);
+
+    void writeAt(uint64_t offset, const void *data, size_t length);
+
+    void readAt(uint64_t offset, void *data, size_t length) const;
+
+public:
+    TileFile() = delete;
+    TileFile(const TileFile &) = delete;
+    TileFile(TileFile &&) = delete;
+
+    /**
+     * Opens the file, creating an empty one if it doesn't exist.
+     *
+     * @throws IOException
+     * @throws InvalidInputException Not a tile file.
+     */
+    TileFile(const string &filename);
+
+    ~TileFile();
+
+    /**
+     * @return Locations of all tiles, by tile key.
+     */
+    const unordered_map<uint64_t, Extent> &getIndex() const;
+
+    /**
+     * @return Serialized tile or empty string if there is no such tile.
+     *
+     * @throws IOException
+     */
+    string read(uint64_t key) const;
+
+    /**
+     * Stores the serialized tile, replacing its previous version.
+     *
+     * @param cells Number of cells in the tile.
+     *
+     * @throws IOException
+     */
+    void write(uint64_t key, const string &data, uint64_t cells);
+
+    /**
+     * Removes the tile.
+     */
+    void remove(uint64_t key);
+
+    /**
+     * Writes the index and commits it in the header.
+     *
+     * @throws IOException
+     */
+    void saveIndex();
+};
+
+#endif /* SPREADSHEET_TILE_FILE_H */
@@ -0,0 +1,114 @@
+#ifndef SPREADSHEET_TRIGRAM_INDEX_H
+#define SPREADSHEET_TRIGRAM_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Address.h"
+#include "Sheet.h"
+
+using namespace std;
+
+/**
+ * Index of the sources of all cells of a sheet by their trigrams (substrings of three bytes),
+ * so that repeated searches for a literal text look only at the cells containing all
+ * the trigrams of the text instead of scanning the whole sheet.
+ *
+ * Values of formulas change with their precedents and are not indexed: formula cells are
+ * always candidates. Cells changed since the index was built are candidates too, until
+ * there are so many of them that the index is rebuilt. Candidates are a superset of
+ * the matches, the caller checks them.
+ *
+ * The index subscribes to changes of the whole sheet, so it must be used and destroyed
+ * by whoever may edit the sheet (e.g. under the lock of its Recalculator).
+ */
+class TrigramIndex
+{
+    /**
+     * Number of changed cells (relative to the indexed ones) at which the index is rebuilt.
+     */
+    static const size_t REBUILD_RATIO = 8;
+
+    shared_ptr<Sheet> m_Sheet;
+
+    uint32_t m_Subscription;
+
+    /**
+     * Addresses of the cells containing the trigram, packed by packAddress() and sorted.
+     */
+    unordered_map<uint32_t, vector<uint64_t>> m_Postings;
+
+    /**
+     * Formula cells, packed by packAddress().
+     */
+    vector<uint64_t> m_Formulas;
+
+    /**
+     * Cells changed since the index was built.
+     */
+    unordered_set<Address> m_Changed;
+
+    /**
+     * Number of cells indexed by the last build().
+     */
+    size_t m_Indexed = 0;
+
+    /**
+     * @return The address as one number, ordered row by row.
+     */
+    static uint64_t packAddress(const Address &addr);
+
+    static Address unpackAddress(uint64_t packed);
+
+    /**
+     * Calls the function for every distinct trigram of the text.
+     */
+    template<typename Function>
+    static void forEachTrigram(const string &text, Function fn);
+
+public:
+    TrigramIndex() = delete;
+    TrigramIndex(const TrigramIndex &) = delete;
+    TrigramIndex(TrigramIndex &&) = delete;
+
+    /**
+     * Subscribes to changes of the sheet and indexes all its cells.
+     */
+    explicit TrigramIndex(shared_ptr<Sheet> sheet);
+
+    /**
+     * Unsubscribes from the sheet.
+     */
+    ~TrigramIndex();
+
+    /**
+     * Indexes all cells of the sheet anew, forgetting the changed cells.
+     */
+    void build();
+
+    /**
+     * @return Whether candidates() can narrow the search for the text down, i.e. it has
+     *         at least one trigram.
+     */
+    static bool canFilter(const string &text);
+
+    /**
+     * Rebuilds the index first if too many cells have changed since it was built.
+     *
+     * @return Addresses of all cells whose source may contain the text or which are formulas
+     *         or changed since, row by row. The text must pass canFilter().
+     */
+    vector<Address> candidates(const string &text);
+
+    /**
+     * @return Number of distinct trigrams.
+     */
+    size_t size() const;
+};
+
+#endif /* SPREADSHEET_TRIGRAM_INDEX_H */
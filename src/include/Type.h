@@ -7,6 +7,16 @@
 
 using namespace std;
 
+/**
+ * Tag identifying a cell type at run time without RTTI.
+ */
+enum class TypeTag
+{
+    INT,
+    DOUBLE,
+    STRING
+};
+
 /**
  * Provides additional features to type T.
  */
@@ -19,6 +29,11 @@ public:
      */
     static const string name;
 
+    /**
+     * Tag of type T.
+     */
+    static const TypeTag tag;
+
     /**
      * Default value of type T.
      */
@@ -51,4 +66,33 @@ public:
     }
 };
 
+/**
+ * @return Name of the type with the tag.
+ */
+const string &typeName(TypeTag tag);
+
+/**
+ * @return Tag of the type with the name.
+ *
+ * @throws InvalidTypeException Unknown type name.
+ */
+TypeTag typeTag(const string &name);
+
+/* specializations defined in Type.cpp */
+template<> const string Type<int>::name;
+template<> const string Type<double>::name;
+template<> const string Type<string>::name;
+template<> const TypeTag Type<int>::tag;
+template<> const TypeTag Type<double>::tag;
+template<> const TypeTag Type<string>::tag;
+template<> const int Type<int>::defaultValue;
+template<> const double Type<double>::defaultValue;
+template<> const string Type<string>::defaultValue;
+template<> string Type<int>::toString(const int &val, bool isLiteral);
+template<> string Type<double>::toString(const double &val, bool isLiteral);
+template<> string Type<string>::toString(const string &val, bool isLiteral);
+template<> int Type<int>::fromString(const string &val, bool isLiteral);
+template<> double Type<double>::fromString(const string &val, bool isLiteral);
+template<> string Type<string>::fromString(const string &val, bool isLiteral);
+
 #endif /* SPREADSHEET_TYPE_H */
@@ -1,12 +1,24 @@
 #ifndef SPREADSHEET_UI_H
 #define SPREADSHEET_UI_H
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <form.h>
 #include <ncurses.h>
 
+#include "Recalculator.h"
 #include "Sheet.h"
+#include "TrigramIndex.h"
 
 /* thus we can't use magenta anywhere */
 #define COLOR_GREY COLOR_MAGENTA
@@ -22,15 +34,54 @@ using namespace std;
  * It is never granted that the cursor will stay at its location. Anytime it is to be used,
  * we should set its location first, explicitly.
  *
- * No draw*() method calls refresh(). Needs to be called explicitly.
+ * No method but flushFrame() calls refresh(). Everything is drawn into the ncurses virtual
+ * screen and sent to the terminal as one frame per input event.
+ *
+ * Changed formulas are evaluated by a Recalculator in the background. Until their new values
+ * arrive, cells keep showing their previous text greyed out, and the top-left corner shows
+ * the progress. The sheet is locked while an input event is handled; an edit made during
+ * a recalculation restarts it with the newly changed cells first. The UI subscribes only to
+ * changes within the viewport, so an edit with many dependents costs it no more than
+ * the visible ones.
+ *
+ * A file given on the command line is loaded in the background while the UI is already
+ * running: cells of the initial viewport are shown as soon as they're read, the loaded sheet
+ * replaces the empty one once complete. Input is ignored until then. The time to the first
+ * cells and to the loaded sheet are reported.
  *
  * COMMANDS:
- *     write <filename> - saves the sheet to the file
+ *     write <filename> - saves the sheet to the file; the sheet is serialized from a snapshot
+ *                        in the background and the result is reported once done
+ *     write - saves modified cells of an out-of-core sheet to its tile file
  *     w - alias for write
  *
- *     load <filename> - loads the sheet from the file
+ *     load <filename> - loads the sheet from the file (replaying its journal, if there is one);
+ *                       files ending with .tiles are opened as out-of-core sheets
  *     l - alias for load
  *
+ *     import <filename> - reads CSV (or TSV if the file ends with .tsv) into the sheet, starting
+ *                         at the active cell; types of columns are inferred
+ *
+ *     export <filename> - writes evaluated cells as CSV (or TSV if the file ends with .tsv)
+ *
+ *     journal on|off - turns journaled saving on or off; when on, write appends only the edits
+ *                      made since the last write to <filename>.journal
+ *     j - alias for journal
+ *
+ *     find <pattern> - finds cells whose source or value matches the regular expression and
+ *                      moves to the first one from the active cell on; n and N move to the next
+ *                      and previous one
+ *     f - alias for find
+ *
+ *     replace <pattern> <replacement> - replaces matches of the regular expression (up to
+ *                                       the first space) in the sources of all cells
+ *
+ *     index - indexes the sources of all cells, so that finding plain text looks only
+ *             at the cells containing it
+ *
+ *     stats - shows sizes and counters of the sheet, the recalculation and the drawing over
+ *             the viewport, updated with every frame until the next key
+ *
  *     quit - ends the UI
  *     q - alias for quit
  */
@@ -51,6 +102,19 @@ class UI
         ACTIVE, INACTIVE
     };
 
+    /**
+     * Text of a cell as printed in the viewport.
+     */
+    struct DisplayText
+    {
+        string text;
+
+        /**
+         * Whether the cell is waiting for recalculation, so the text may be out of date.
+         */
+        bool stale = false;
+    };
+
     /* color-pair constants */
     const short BLACK_BLACK = 16;
     const short WHITE_BLACK = 17;
@@ -99,6 +163,11 @@ class UI
      */
     WorkingMode m_Mode;
 
+    /**
+     * Whether sheets are saved through a journal.
+     */
+    bool m_JournalMode = false;
+
     FORM *m_PromptForm;
     FIELD *m_PromptField[2];
 
@@ -107,13 +176,119 @@ class UI
      */
     shared_ptr<Sheet> m_Sheet;
 
+    /**
+     * Texts of the cells in the viewport as printed, by absolute address. Updated by
+     * content-changed events; cells scrolled out of the viewport are dropped, so that scrolling
+     * fetches and formats only the newly exposed cells.
+     */
+    unordered_map<Address, DisplayText> m_DisplayCache;
+
+    /**
+     * Cell width the cached texts are formatted for.
+     */
+    int m_DisplayCacheWidth = 0;
+
+    /**
+     * Evaluates changed cells of the sheet while run() is running.
+     */
+    unique_ptr<Recalculator> m_Recalc;
+
+    /**
+     * ID of the subscription to changes of the cells in the viewport.
+     */
+    uint32_t m_Subscription = 0;
+
+    /**
+     * Save running in the background, if any.
+     */
+    future<void> m_PendingSave;
+
+    /**
+     * File to be loaded in the background by the next run(), see init(const string &).
+     */
+    string m_LoadFilename;
+
+    /**
+     * Load running in the background, if any.
+     */
+    future<shared_ptr<Sheet>> m_PendingLoad;
+
+    /**
+     * Cells of the viewport read by the pending load and not printed yet, formatted by
+     * the loading thread. Guarded by m_LoadPreviewMutex.
+     */
+    vector<pair<Address, DisplayText>> m_LoadPreview;
+    mutex m_LoadPreviewMutex;
+
+    /**
+     * Viewport the pending load collects cells of, as packed by packAddress(). Follows
+     * the viewport of the UI, see checkPendingLoad().
+     */
+    atomic<uint64_t> m_LoadViewportBegin;
+    atomic<uint64_t> m_LoadViewportEnd;
+
+    /**
+     * Set when the UI goes away, so that the pending load ends without reading the rest.
+     */
+    atomic<bool> m_LoadCancelled;
+
+    chrono::steady_clock::time_point m_LoadStart;
+
+    /**
+     * Milliseconds from the start of the load to printing its first cells, -1 if none yet.
+     */
+    long m_LoadFirstPaint = -1;
+
+    /**
+     * Milliseconds from the start of the load to the first frame taking input, -1 if none yet.
+     */
+    long m_LoadInteractive = -1;
+
+    /**
+     * Message to be printed by the next run(), once it has drawn the loaded sheet.
+     */
+    string m_LoadReport;
+
+    /**
+     * Cells found by the last find, row by row.
+     */
+    vector<Address> m_SearchResults;
+
+    /**
+     * Position of the current match in m_SearchResults.
+     */
+    size_t m_SearchPos = 0;
+
+    /**
+     * Index of the sources of the cells, once built by the index command.
+     */
+    unique_ptr<TrigramIndex> m_SearchIndex;
+
+    /**
+     * Whether the stats panel is shown over the viewport.
+     */
+    bool m_StatsShown = false;
+
+    /**
+     * When the UI got the input event being handled, if m_FrameTimed.
+     */
+    chrono::steady_clock::time_point m_FrameStart;
+
+    bool m_FrameTimed = false;
+
+    /**
+     * Microseconds from getting the last input event to sending its frame, -1 if none yet.
+     */
+    long m_LastRepaint = -1;
+
     /**
      * Initializes ncurses and colors.
      */
     UI();
 
     /**
-     * Initializes members, loads a sheet from file, and starts the UI.
+     * Initializes members with an empty sheet and lets the next run() load the sheet from
+     * the file in the background.
      */
     void init(const string &filename);
 
@@ -139,15 +314,85 @@ class UI
     void moveActiveCell(Address addr);
 
     /**
-     * Prints contents of all cells in the viewport.
+     * Moves the active cell in the direction: within a block of non-empty cells to its last
+     * cell, otherwise to the first cell of the next block, or to the edge of the sheet if there
+     * is none.
+     *
+     * @param colStep Column direction: 1, -1, or 0 if rowStep is not.
+     * @param rowStep Row direction: 1, -1, or 0 if colStep is not.
+     */
+    void jump(int colStep, int rowStep);
+
+    /**
+     * Moves the active cell to the match at the position in m_SearchResults and reports
+     * the position.
+     */
+    void showSearchResult(size_t pos);
+
+    /**
+     * Scrolls the rows of the viewport (including the vertical header) by the given number of
+     * rows, which has already been applied to the viewport shift. Only the newly exposed rows
+     * are drawn; ncurses sends the rest to the terminal as scrolling.
+     *
+     * @param rows Positive to scroll the content up; less than the number of rows in viewport.
+     */
+    void scrollRows(int rows);
+
+    /**
+     * Prints contents of all cells in the viewport. Only cells missing from the display cache
+     * are fetched from the sheet.
      */
     void printAllCells();
 
     /**
-     * Prints the content of given cell at its address (according to current viewport). Trims
-     * if necessary. Does nothing if the cell's address is out of viewport.
+     * Prints contents of the cells of the given absolute rows in the viewport, using
+     * the display cache. Moves the subscription to changes along with the viewport.
+     */
+    void printCells(int firstRow, int lastRow);
+
+    /**
+     * Prints the contents of given changed cells within the viewport at their addresses
+     * and caches the printed texts. Trims if necessary. Cells that need to be evaluated are
+     * marked stale and left to the recalculation.
+     */
+    void printChangedCells(const vector<Address> &changed);
+
+    /**
+     * Prints cells evaluated by the recalculation since the last call and its progress.
+     */
+    void printRecalculatedCells();
+
+    /**
+     * @param addr Absolute address.
+     */
+    bool isInViewport(const Address &addr) const;
+
+    /**
+     * @return Content of the cell trimmed or padded to the cell width.
+     */
+    string formatCell(const CellBase &cell) const;
+
+    /**
+     * Prints the formatted text at the cell's place in the viewport, greyed out if it's stale.
+     *
+     * @param addr Absolute address, must be in the viewport.
+     */
+    void printCellText(const Address &addr, const DisplayText &display);
+
+    /**
+     * Prints progress of the recalculation into the top-left corner, if it's running.
+     */
+    void drawProgress();
+
+    /**
+     * Draws the panel with the current stats over the top-left part of the viewport.
      */
-    void printCell(const CellBase &cell);
+    void drawStats();
+
+    /**
+     * Redraws the part of the viewport covered by the stats panel.
+     */
+    void hideStats();
 
     /**
      * Creates the form and the field for prompt. Does not call refresh().
@@ -164,6 +409,70 @@ class UI
      */
     void updatePrompt();
 
+    /**
+     * Sends everything drawn since the last frame to the terminal at once and places
+     * the cursor into the prompt, if it is being edited.
+     */
+    void flushFrame();
+
+    /**
+     * Starts serializing a snapshot of the sheet to the file in the background and removes
+     * the journal of the file. Waits for the previous save to finish first.
+     */
+    void saveInBackground(const string &filename);
+
+    /**
+     * Reports the result of the background save if it has finished and the UI is in browse mode.
+     *
+     * @param wait Whether to block until the save finishes.
+     */
+    void checkPendingSave(bool wait = false);
+
+    /**
+     * Loads the sheet from the file: an out-of-core sheet if it ends with .tiles, JSON
+     * (replaying its journal, if there is one) otherwise.
+     *
+     * @param journalMode Whether to attach a journal even if the file has none yet.
+     * @param loaded Called with each cell of a JSON file as soon as it's read, see
+     *               Sheet::deserialize().
+     * @param cancelled If given, checked throughout reading the file, building
+     *                  the dependencies and replaying the journal.
+     *
+     * @throws IOException
+     * @throws InvalidInputException
+     * @throws CancelledException Once the flag is set.
+     */
+    static shared_ptr<Sheet> loadSheet(
+        const string &filename,
+        bool journalMode,
+        const function<void(const CellBase &)> &loaded = nullptr,
+        const atomic<bool> *cancelled = nullptr);
+
+    /**
+     * Starts loading the sheet from the file in the background, collecting the cells read
+     * within the current viewport.
+     */
+    void loadInBackground(const string &filename);
+
+    /**
+     * Makes the pending load collect cells of the current viewport.
+     */
+    void updateLoadViewport();
+
+    /**
+     * @return Whether the key works while a load is pending: moving around the cells read so
+     *         far and commands (of which only quit does, see run()).
+     */
+    bool worksWhileLoading(int c) const;
+
+    /**
+     * Prints cells read by the background load so far. Once the load is finished, replaces
+     * the sheet with the loaded one, keeping the position in it, or reports the failure.
+     *
+     * @return Whether the sheet has been replaced, so that the UI needs to be re-run.
+     */
+    bool checkPendingLoad();
+
     /**
      * Executes the function and displays an error if it throws an Exception.
      */
@@ -189,6 +498,14 @@ class UI
      */
     void drawGrid();
 
+    /**
+     * Draws grid lines and the header label of a single row (the same as drawHeadersGrid(),
+     * drawGrid() and drawHeaderLabels() draw for it).
+     *
+     * @param row Row relative to viewport.
+     */
+    void drawGridRow(int row);
+
     /**
      * Draws horizontal and vertical header labels according to current viewport shift.
      */
@@ -232,9 +549,9 @@ public:
     UI(UI &&) = delete;
 
     /**
-     * Starts the UI.
+     * Starts the UI, opening the file in the background if given.
      */
-    static void start();
+    static void start(const string &filename = "");
 
     /**
      * Terminates ncurses.
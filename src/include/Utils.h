@@ -2,6 +2,7 @@
 #define SPREADSHEET_UTILS_H
 
 #include <istream>
+#include <ostream>
 #include <string>
 
 using namespace std;
@@ -44,6 +45,12 @@ public:
      */
     static string escapeString(const string &str);
 
+    /**
+     * Writes given string escaped to be a JSON string to the stream, without building
+     * the escaped string.
+     */
+    static void writeEscaped(ostream &os, const string &str);
+
     /**
      * Decodes given JSON string.
      *
@@ -0,0 +1,280 @@
+#ifndef SPREADSHEET_VALUE_H
+#define SPREADSHEET_VALUE_H
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+
+#include "Rope.h"
+#include "Type.h"
+
+using namespace std;
+
+/**
+ * Value of a cell or of any part of a formula: empty, int, double, string or error. Formulas
+ * evaluate to values of any kind, errors (type mismatch, dependency loop, division by zero) are
+ * values too, so evaluation throws no exceptions.
+ *
+ * Numbers are stored inline. Strings are immutable ropes shared between copies, so neither
+ * copying a value nor concatenating strings copies characters.
+ */
+class Value
+{
+public:
+    enum class Kind : uint8_t
+    {
+        EMPTY,
+        INT,
+        DOUBLE,
+        STRING,
+        ERROR
+    };
+
+    enum class Error : uint8_t
+    {
+        TYPE,
+        LOOP,
+        DIV_ZERO
+    };
+
+private:
+    Kind m_Kind;
+
+    union
+    {
+        int m_Int;
+        double m_Double;
+        Error m_Error;
+        shared_ptr<const Rope> m_String;
+    };
+
+    void copyFrom(const Value &other);
+
+    /**
+     * convert() for values not already of the type.
+     */
+    Value convertOther(TypeTag type) const;
+
+    void destroy();
+
+public:
+    /**
+     * Initializes an empty value.
+     */
+    Value();
+
+    Value(int val);
+    Value(double val);
+    Value(const string &val);
+    Value(string &&val);
+    Value(shared_ptr<const Rope> val);
+
+    Value(const Value &other);
+    Value(Value &&other);
+
+    Value &operator=(const Value &other);
+    Value &operator=(Value &&other);
+
+    ~Value();
+
+    static Value error(Error error);
+
+    /**
+     * Converts given string to a value of the type, the way cells store their non-formula content.
+     *
+     * @param isLiteral Whether the given string should be treated as literal (i.e. strip
+     *                  surrounding double quotes if the type is string)
+     *
+     * @throws InvalidTypeException
+     */
+    static Value fromString(const string &val, TypeTag type, bool isLiteral = false);
+
+    Kind getKind() const;
+
+    bool isError() const;
+
+    /**
+     * @return Whether the value is an int or a double.
+     */
+    bool isNumber() const;
+
+    int getInt() const;
+    double getDouble() const;
+
+    /**
+     * @return The string, flattened.
+     */
+    string getString() const;
+
+    const shared_ptr<const Rope> &getRope() const;
+    Error getError() const;
+
+    /**
+     * @return Number converted to double.
+     */
+    double toDouble() const;
+
+    /**
+     * Converts the value to the type. Ints convert to doubles and empty values to empty strings,
+     * errors stay errors, anything else is a type error.
+     */
+    Value convert(TypeTag type) const;
+
+    /**
+     * Converts the value to string. Errors convert to "#ERROR".
+     *
+     * @param isLiteral Whether the value should be treated as literal (i.e. surround string with
+     *                  double quotes)
+     */
+    string toString(bool isLiteral = false) const;
+
+    /**
+     * Throws the exception corresponding to the error, if the value is an error.
+     *
+     * @throws InvalidTypeException
+     * @throws DependencyLoopException
+     * @throws ArithmeticException
+     */
+    void throwIfError() const;
+
+    bool operator==(const Value &rhs) const;
+    bool operator!=(const Value &rhs) const;
+};
+
+/* hot in evaluation, so defined inline */
+
+inline Value::Value()
+    : m_Kind(Kind::EMPTY),
+      m_Int(0)
+{}
+
+inline Value::Value(int val)
+    : m_Kind(Kind::INT),
+      m_Int(val)
+{}
+
+inline Value::Value(double val)
+    : m_Kind(Kind::DOUBLE),
+      m_Double(val)
+{}
+
+inline Value::Value(const Value &other)
+    : m_Kind(Kind::EMPTY)
+{
+    copyFrom(other);
+}
+
+inline Value::Value(Value &&other)
+    : m_Kind(other.m_Kind)
+{
+    if (m_Kind == Kind::STRING) {
+        new (&m_String) shared_ptr<const Rope>(move(other.m_String));
+    } else {
+        m_Double = other.m_Double;
+    }
+}
+
+inline Value &Value::operator=(const Value &other)
+{
+    if (this != &other) {
+        destroy();
+        copyFrom(other);
+    }
+
+    return *this;
+}
+
+inline Value &Value::operator=(Value &&other)
+{
+    if (this != &other) {
+        destroy();
+        m_Kind = other.m_Kind;
+
+        if (m_Kind == Kind::STRING) {
+            new (&m_String) shared_ptr<const Rope>(move(other.m_String));
+        } else {
+            m_Double = other.m_Double;
+        }
+    }
+
+    return *this;
+}
+
+inline Value::~Value()
+{
+    destroy();
+}
+
+inline void Value::copyFrom(const Value &other)
+{
+    m_Kind = other.m_Kind;
+
+    if (m_Kind == Kind::STRING) {
+        new (&m_String) shared_ptr<const Rope>(other.m_String);
+    } else {
+        /* the widest of the trivial members */
+        m_Double = other.m_Double;
+    }
+}
+
+inline void Value::destroy()
+{
+    if (m_Kind == Kind::STRING) {
+        m_String.~shared_ptr<const Rope>();
+        m_Kind = Kind::EMPTY;
+    }
+}
+
+inline Value::Kind Value::getKind() const
+{
+    return m_Kind;
+}
+
+inline bool Value::isError() const
+{
+    return m_Kind == Kind::ERROR;
+}
+
+inline bool Value::isNumber() const
+{
+    return m_Kind == Kind::INT || m_Kind == Kind::DOUBLE;
+}
+
+inline int Value::getInt() const
+{
+    return m_Int;
+}
+
+inline double Value::getDouble() const
+{
+    return m_Double;
+}
+
+inline const shared_ptr<const Rope> &Value::getRope() const
+{
+    return m_String;
+}
+
+inline Value::Error Value::getError() const
+{
+    return m_Error;
+}
+
+inline double Value::toDouble() const
+{
+    return m_Kind == Kind::INT ? m_Int : m_Double;
+}
+
+inline Value Value::convert(TypeTag type) const
+{
+    if ((m_Kind == Kind::INT && type == TypeTag::INT) ||
+        (m_Kind == Kind::DOUBLE && type == TypeTag::DOUBLE) ||
+        (m_Kind == Kind::STRING && type == TypeTag::STRING)) {
+        return *this;
+    }
+
+    return convertOther(type);
+}
+
+#endif /* SPREADSHEET_VALUE_H */
@@ -0,0 +1,10 @@
+#ifndef SPREADSHEET_ARITHMETIC_EXCEPTION_H
+#define SPREADSHEET_ARITHMETIC_EXCEPTION_H
+
+#include "Exception.h"
+
+class ArithmeticException : public Exception
+{
+};
+
+#endif /* SPREADSHEET_ARITHMETIC_EXCEPTION_H */
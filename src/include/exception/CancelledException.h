@@ -0,0 +1,10 @@
+#ifndef SPREADSHEET_CANCELLED_EXCEPTION_H
+#define SPREADSHEET_CANCELLED_EXCEPTION_H
+
+#include "Exception.h"
+
+class CancelledException : public Exception
+{
+};
+
+#endif /* SPREADSHEET_CANCELLED_EXCEPTION_H */
@@ -0,0 +1,285 @@
+/**
+ * Load generator for the server mode (spreadsheet --serve). Opens concurrent connections,
+ * sends a mix of reads, range reads and edits and reports throughput and latency percentiles.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Address.h"
+
+using namespace std;
+
+struct Options
+{
+    string socketPath;
+    int clients = 8;
+    int requests = 10000;
+    int writePercent = 10;
+    int rangePercent = 0;
+    int cols = 10;
+    int rows = 1000;
+};
+
+/**
+ * Latencies of one kind of request, in microseconds.
+ */
+struct Latencies
+{
+    vector<double> read, range, write;
+};
+
+/**
+ * Connection with a line-buffered reader.
+ */
+class Connection
+{
+    int m_Fd = -1;
+    string m_Buffer;
+
+public:
+    bool open(const string &path)
+    {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        m_Fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        return m_Fd >= 0 && connect(m_Fd, (sockaddr *) &addr, sizeof(addr)) == 0;
+    }
+
+    ~Connection()
+    {
+        if (m_Fd >= 0) {
+            close(m_Fd);
+        }
+    }
+
+    bool send(const string &line)
+    {
+        for (size_t sent = 0; sent < line.length();) {
+            ssize_t written = ::send(m_Fd, line.data() + sent, line.length() - sent, MSG_NOSIGNAL);
+            if (written <= 0) {
+                return false;
+            }
+
+            sent += written;
+        }
+
+        return true;
+    }
+
+    bool readLine(string &line)
+    {
+        char chunk[4096];
+
+        size_t end;
+        while ((end = m_Buffer.find('\n')) == string::npos) {
+            ssize_t length = recv(m_Fd, chunk, sizeof(chunk), 0);
+            if (length <= 0) {
+                return false;
+            }
+
+            m_Buffer.append(chunk, length);
+        }
+
+        line = m_Buffer.substr(0, end);
+        m_Buffer.erase(0, end + 1);
+
+        return true;
+    }
+};
+
+static void usage()
+{
+    cerr << "usage: spreadsheet-loadgen <socket> [options]\n"
+         << "  -c <clients>      concurrent connections (default 8)\n"
+         << "  -n <requests>     requests per connection (default 10000)\n"
+         << "  -w <percent>      edits (default 10)\n"
+         << "  -r <percent>      10x10 range reads (default 0)\n"
+         << "  --cols <n>        columns of the area used (default 10)\n"
+         << "  --rows <n>        rows of the area used (default 1000)\n";
+}
+
+/**
+ * Sends requests over one connection, recording latencies.
+ *
+ * @return False on connection failure or error response.
+ */
+static bool runClient(const Options &options, unsigned seed, Latencies &latencies)
+{
+    Connection conn;
+    if (!conn.open(options.socketPath)) {
+        return false;
+    }
+
+    mt19937 random(seed);
+    uniform_int_distribution<int> percent(0, 99);
+    uniform_int_distribution<int> col(1, options.cols);
+    uniform_int_distribution<int> row(1, options.rows);
+
+    string response;
+
+    for (int i = 0; i < options.requests; ++i) {
+        int kind = percent(random);
+        Address addr(col(random), row(random));
+
+        string request;
+        vector<double> *target;
+
+        if (kind < options.writePercent) {
+            request = "SET " + (string) addr + " " + to_string(random() % 1000) + "\n";
+            target = &latencies.write;
+        } else if (kind < options.writePercent + options.rangePercent) {
+            request = "RANGE " + (string) addr + " " +
+                (string) Address(addr.col() + 9, addr.row() + 9) + "\n";
+            target = &latencies.range;
+        } else {
+            request = "GET " + (string) addr + "\n";
+            target = &latencies.read;
+        }
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        if (!conn.send(request) || !conn.readLine(response) || response.compare(0, 2, "OK") != 0) {
+            return false;
+        }
+
+        /* range responses continue with one line per cell */
+        if (target == &latencies.range) {
+            for (long lines = atol(response.c_str() + 3); lines > 0; --lines) {
+                if (!conn.readLine(response)) {
+                    return false;
+                }
+            }
+        }
+
+        target->push_back(
+            chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+    }
+
+    conn.send("QUIT\n");
+    conn.readLine(response);
+
+    return true;
+}
+
+static void report(const string &name, vector<double> &latencies)
+{
+    if (latencies.empty()) {
+        return;
+    }
+
+    sort(latencies.begin(), latencies.end());
+
+    auto percentile = [&](double p) {
+        return latencies[min(latencies.size() - 1, (size_t) (p * latencies.size()))];
+    };
+
+    printf("%-6s %9zu requests   p50 %8.1f us   p90 %8.1f us   p99 %8.1f us   max %8.1f us\n",
+        name.c_str(), latencies.size(), percentile(0.5), percentile(0.9), percentile(0.99),
+        latencies.back());
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+
+    if (argc < 2 || argv[1][0] == '-') {
+        usage();
+        return 2;
+    }
+
+    options.socketPath = argv[1];
+
+    for (int i = 2; i < argc; ++i) {
+        string opt = argv[i];
+
+        if (i + 1 >= argc) {
+            usage();
+            return 2;
+        }
+
+        int value = atoi(argv[++i]);
+
+        if (opt == "-c") {
+            options.clients = value;
+        } else if (opt == "-n") {
+            options.requests = value;
+        } else if (opt == "-w") {
+            options.writePercent = value;
+        } else if (opt == "-r") {
+            options.rangePercent = value;
+        } else if (opt == "--cols") {
+            options.cols = value;
+        } else if (opt == "--rows") {
+            options.rows = value;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    if (options.clients < 1 || options.requests < 0 || options.cols < 1 || options.rows < 1) {
+        usage();
+        return 2;
+    }
+
+    vector<Latencies> latencies(options.clients);
+    vector<thread> clients;
+    atomic<int> failed(0);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for (int i = 0; i < options.clients; ++i) {
+        clients.emplace_back([&, i]() {
+            if (!runClient(options, i + 1, latencies[i])) {
+                ++failed;
+            }
+        });
+    }
+
+    for (thread &client : clients) {
+        client.join();
+    }
+
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (failed > 0) {
+        cerr << "error: " << failed << " connection(s) failed" << endl;
+        return 1;
+    }
+
+    Latencies all;
+    for (Latencies &client : latencies) {
+        all.read.insert(all.read.end(), client.read.begin(), client.read.end());
+        all.range.insert(all.range.end(), client.range.begin(), client.range.end());
+        all.write.insert(all.write.end(), client.write.begin(), client.write.end());
+    }
+
+    size_t total = all.read.size() + all.range.size() + all.write.size();
+
+    printf("%d clients, %zu requests in %.3f s: %.0f requests/s\n",
+        options.clients, total, elapsed, total / elapsed);
+
+    report("GET", all.read);
+    report("RANGE", all.range);
+    report("SET", all.write);
+
+    return 0;
+}
@@ -1,8 +1,80 @@
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+
+#include "Headless.h"
+#include "Server.h"
 #include "UI.h"
 
-int main()
+#include "exception/IOException.h"
+
+/**
+ * Serves the sheet (loaded from the file, if given) on the socket until SIGINT or SIGTERM.
+ */
+static int serve(const vector<string> &args)
 {
-    UI::start();
+    if (args.empty() || args.size() > 2) {
+        cerr << "usage: spreadsheet --serve <socket> [<file>]" << endl;
+        return 2;
+    }
+
+    /* signals are handled by a dedicated thread, so that the server can be stopped cleanly */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    shared_ptr<Sheet> sheet;
+
+    try {
+        sheet = args.size() > 1 ? Headless::load(args[1]) : make_shared<Sheet>();
+    } catch (const exception &ex) {
+        cerr << "error: cannot load " << args[1] << endl;
+        return 1;
+    }
+
+    Server server(sheet, args[0]);
+
+    try {
+        server.listen();
+    } catch (const IOException &ex) {
+        cerr << "error: cannot listen on " << args[0] << endl;
+        return 1;
+    }
+
+    thread signalHandler([&server, &signals]() {
+        int signal;
+        sigwait(&signals, &signal);
+        server.stop();
+    });
+
+    server.run();
+
+    /* in case run() has failed on its own */
+    pthread_kill(signalHandler.native_handle(), SIGTERM);
+    signalHandler.join();
+
+    server.stop();
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && (string(argv[1]) == "--batch" || string(argv[1]) == "-b")) {
+        return Headless::run(vector<string>(argv + 2, argv + argc), cout, cerr);
+    }
+
+    if (argc > 1 && string(argv[1]) == "--serve") {
+        return serve(vector<string>(argv + 2, argv + argc));
+    }
+
+    UI::start(argc > 1 ? argv[1] : "");
 
     return 0;
 }
@@ -1,10 +1,26 @@
 #include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <sstream>
+#include <thread>
 
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Csv.h"
+#include "DependencyGraph.h"
+#include "Headless.h"
+#include "Recalculator.h"
+#include "Search.h"
+#include "Server.h"
 #include "Sheet.h"
 
+#include "exception/ArithmeticException.h"
 #include "exception/InvalidArgumentException.h"
 #include "exception/InvalidInputException.h"
 
@@ -82,6 +98,10 @@ public:
             Utils::escapeString("=\"foo\"+\" and \\\"bar\\\"\"")
                 == "=\\\"foo\\\"+\\\" and \\\\\\\"bar\\\\\\\"\\\"");
 
+        ostringstream escaped;
+        Utils::writeEscaped(escaped, "a \"b\" \\");
+        assert(escaped.str() == Utils::escapeString("a \"b\" \\"));
+
         assert(
             Utils::unescapeString(
                 "this is a \\\"large\\\" string with \\\\ backslash")
@@ -95,76 +115,355 @@ public:
 
     static void test_formula()
     {
-        vector<Address> deps;
+        Pool pool;
+        AddressList deps;
 
         /* literal */
-        auto l0 = Formula::Parser::parseSource<int>("123", deps);
+        auto l0 = Formula::Parser::parseSource("123", TypeTag::INT, deps, pool);
         assert(
-            dynamic_cast<const Formula::Literal<int> *>(l0.get()) != nullptr &&
+            dynamic_cast<const Formula::Literal *>(l0.get()) != nullptr &&
+                l0->evaluate(Sheet()) == Value(123) &&
                 deps.size() == 0
         );
 
-        auto l1 = Formula::Parser::parseSource<double>("123.456", deps);
+        auto l1 = Formula::Parser::parseSource("123.456", TypeTag::DOUBLE, deps, pool);
         assert(
-            dynamic_cast<const Formula::Literal<double> *>(l1.get()) != nullptr &&
+            dynamic_cast<const Formula::Literal *>(l1.get()) != nullptr &&
+                l1->evaluate(Sheet()) == Value(123.456) &&
                 deps.size() == 0
         );
 
-        auto l2 = Formula::Parser::parseSource<string>("\"some \\\"string\\\"\"", deps);
+        auto l2 = Formula::Parser::parseSource("\"some \\\"string\\\"\"", TypeTag::STRING, deps, pool);
         assert(
-            dynamic_cast<const Formula::Literal<string> *>(l2.get()) != nullptr &&
+            dynamic_cast<const Formula::Literal *>(l2.get()) != nullptr &&
                 deps.size() == 0 &&
-                l2->evaluate(Sheet()) == "some \"string\""
+                l2->evaluate(Sheet()) == Value("some \"string\"")
         );
 
+        /* int literals are double literals too */
+        auto l3 = Formula::Parser::parseSource("7", TypeTag::DOUBLE, deps, pool);
+        assert(l3->evaluate(Sheet()) == Value(7.0));
+
         assert(Utils::throws<IncorrectFormulaSyntaxException>([]() {
-            vector<Address> deps_;
-            Formula::Parser::parseSource<int>("nonsense", deps_);
+            AddressList deps_;
+            Pool pool_;
+            Formula::Parser::parseSource("nonsense", TypeTag::INT, deps_, pool_);
+        }));
+
+        assert(Utils::throws<IncorrectFormulaSyntaxException>([]() {
+            AddressList deps_;
+            Pool pool_;
+            Formula::Parser::parseSource("1.5", TypeTag::INT, deps_, pool_);
         }));
 
         /* link */
-        auto link0 = Formula::Parser::parseSource<int>("ABC123", deps);
+        auto link0 = Formula::Parser::parseSource("ABC123", TypeTag::INT, deps, pool);
         assert(
-            dynamic_cast<const Formula::Link<int> *>(link0.get()) != nullptr &&
+            dynamic_cast<const Formula::Link *>(link0.get()) != nullptr &&
                 deps.size() == 1 && deps[0] == Address("ABC123")
         );
         deps.clear();
 
+        assert(Utils::throws<IncorrectFormulaSyntaxException>([]() {
+            AddressList deps_;
+            Pool pool_;
+            Formula::Parser::parseSource("A0", TypeTag::INT, deps_, pool_);
+        }));
+
         /* operations and functions */
-        auto o0 = Formula::Parser::parseSource<double>(
-            "1+2-4*6/3*(1)*(6-2)*abs(abs(1-2)-abs(3-5))+0.1-abs(0-.2)+0.1*57/57", deps);
-        assert(o0->evaluate(Sheet()) == -8 && deps.size() == 0);
+        auto o0 = Formula::Parser::parseSource(
+            "1+2-4*6/3*(1)*(6-2)*abs(abs(1-2)-abs(3-5))+0.1-abs(0-.2)+0.1*57/57",
+            TypeTag::DOUBLE,
+            deps,
+            pool);
+        assert(o0->evaluate(Sheet()).getDouble() == -8 && deps.size() == 0);
 
-        auto o1 = Formula::Parser::parseSource<string>("\"Hello\"+\" \"+\"World!\"", deps);
-        assert(o1->evaluate(Sheet()) == "Hello World!" && deps.size() == 0);
+        auto o1 = Formula::Parser::parseSource(
+            "\"Hello\"+\" \"+\"World!\"", TypeTag::STRING, deps, pool);
+        assert(o1->evaluate(Sheet()) == Value("Hello World!") && deps.size() == 0);
 
         assert(Utils::throws<IncorrectFormulaSyntaxException>([]() {
-            vector<Address> deps_;
-            Formula::Parser::parseSource<int>("1+2+(3+4+(5+6)", deps_);
+            AddressList deps_;
+            Pool pool_;
+            Formula::Parser::parseSource("1+2+(3+4+(5+6)", TypeTag::INT, deps_, pool_);
         }));
 
         /* parentheses */
-        auto p0 = Formula::Parser::parseSource<int>("((1+(2)))+(3+(4+(5+((6)))))", deps);
-        assert(p0->evaluate(Sheet()) == 21);
+        auto p0 = Formula::Parser::parseSource("((1+(2)))+(3+(4+(5+((6)))))", TypeTag::INT, deps, pool);
+        assert(p0->evaluate(Sheet()) == Value(21));
+        auto p1 = Formula::Parser::parseSource("(\"a)\"+\"(b\")+\"c\"", TypeTag::STRING, deps, pool);
+        assert(p1->evaluate(Sheet()) == Value("a)(bc"));
+
+        assert(Utils::throws<IncorrectFormulaSyntaxException>([]() {
+            AddressList deps_;
+            Pool pool_;
+            Formula::Parser::parseSource("(1+2))+(3", TypeTag::INT, deps_, pool_);
+        }));
+
+        assert(Utils::throws<IncorrectFormulaSyntaxException>([]() {
+            AddressList deps_;
+            Pool pool_;
+            Formula::Parser::parseSource("abs(1,2)", TypeTag::INT, deps_, pool_);
+        }));
+
+        /* whitespace around operands */
+        auto w0 = Formula::Parser::parseSource(" 1 + abs( 0-2 ) *3 ", TypeTag::INT, deps, pool);
+        assert(w0->evaluate(Sheet()) == Value(9));
+        auto w1 = Formula::Parser::parseSource("\" a \" + \"b\"", TypeTag::STRING, deps, pool);
+        assert(w1->evaluate(Sheet()) == Value(" a b"));
 
         /* parsing back to source */
-        auto ts0 = Formula::Parser::parseSource<int>("AbS(5)+sIn(cos(6))", deps);
+        auto ts0 = Formula::Parser::parseSource("AbS(5)+sIn(cos(6))", TypeTag::INT, deps, pool);
         assert(ts0->toSource() == "ABS(5)+SIN(COS(6))");
 
         /* abs */
-        auto f0 = Formula::Parser::parseSource<int>("abs(7-9)", deps);
-        assert(f0->evaluate(Sheet()) == 2);
-        auto f1 = Formula::Parser::parseSource<double>("abs(7.5-9)", deps);
-        assert(f1->evaluate(Sheet()) == 1.5);
+        auto f0 = Formula::Parser::parseSource("abs(7-9)", TypeTag::INT, deps, pool);
+        assert(f0->evaluate(Sheet()) == Value(2));
+        auto f1 = Formula::Parser::parseSource("abs(7.5-9)", TypeTag::DOUBLE, deps, pool);
+        assert(f1->evaluate(Sheet()) == Value(1.5));
 
-        /* sin */
-        Formula::Parser::parseSource<double>("sin(1.234)", deps);
+        /* sin, rounded for ints */
+        auto f2 = Formula::Parser::parseSource("sin(2)", TypeTag::INT, deps, pool);
+        assert(f2->evaluate(Sheet()) == Value(1));
+        auto f3 = Formula::Parser::parseSource("sin(2)", TypeTag::DOUBLE, deps, pool);
+        assert(f3->evaluate(Sheet()) == Value(sin(2.0)));
 
         /* cos */
-        Formula::Parser::parseSource<double>("cos(1.234)", deps);
+        Formula::Parser::parseSource("cos(1.234)", TypeTag::DOUBLE, deps, pool);
 
         /* tan */
-        Formula::Parser::parseSource<double>("tan(1.234)", deps);
+        Formula::Parser::parseSource("tan(1.234)", TypeTag::DOUBLE, deps, pool);
+
+        /* errors are values */
+        auto e0 = Formula::Parser::parseSource("1/(2-2)+3", TypeTag::INT, deps, pool);
+        assert(e0->evaluate(Sheet()) == Value::error(Value::Error::DIV_ZERO));
+        auto e1 = Formula::Parser::parseSource("1.0/0", TypeTag::DOUBLE, deps, pool);
+        assert(isinf(e1->evaluate(Sheet()).getDouble()));
+    }
+
+    static void test_value()
+    {
+        Value empty;
+        assert(empty.getKind() == Value::Kind::EMPTY);
+        assert(empty.toString() == "");
+
+        Value s0("foo");
+        Value s1 = s0;
+        assert(s1.getKind() == Value::Kind::STRING && s1 == Value("foo"));
+        assert(s1.getRope() == s0.getRope());
+        s1 = Value(5);
+        assert(s1.getInt() == 5 && s0.getString() == "foo");
+
+        /* concatenation shares the parts, short results are copied */
+        shared_ptr<const Rope> r0 = make_shared<Rope>(string(Rope::FLAT_LENGTH, 'a'));
+        shared_ptr<const Rope> r1 = Rope::concat(r0, make_shared<Rope>("b"));
+        assert(r1->length() == Rope::FLAT_LENGTH + 1);
+        assert(r1->flatten() == string(Rope::FLAT_LENGTH, 'a') + "b");
+        assert(Rope::concat(r0, make_shared<Rope>("")) == r0);
+        assert(Value(Rope::concat(make_shared<Rope>("fo"), make_shared<Rope>("o"))) == s0);
+        assert(Value(r1) == Value(r1->flatten()));
+
+        /* deep ropes are flattened and destroyed without recursion */
+        {
+            const size_t depth = 200000;
+
+            shared_ptr<const Rope> deep = r0;
+            for (size_t i = 0; i < depth; ++i) {
+                deep = Rope::concat(deep, make_shared<Rope>("x"));
+            }
+
+            string flat = deep->flatten();
+            assert(flat.length() == Rope::FLAT_LENGTH + depth);
+            assert(flat.substr(flat.length() - 3) == "xxx");
+        }
+
+        /* conversions */
+        assert(Value(5).convert(TypeTag::DOUBLE) == Value(5.0));
+        assert(Value(5.5).convert(TypeTag::INT) == Value::error(Value::Error::TYPE));
+        assert(Value(5).convert(TypeTag::STRING) == Value::error(Value::Error::TYPE));
+        assert(empty.convert(TypeTag::STRING) == Value(""));
+        assert(empty.convert(TypeTag::INT) == Value::error(Value::Error::TYPE));
+        assert(Value::error(Value::Error::LOOP).convert(TypeTag::INT).getError() == Value::Error::LOOP);
+
+        assert(Value::fromString("12", TypeTag::INT) == Value(12));
+        assert(Value::fromString(" ", TypeTag::DOUBLE) == Value(0.0));
+        assert(Value::fromString("\"a\\\"b\"", TypeTag::STRING, true) == Value("a\"b"));
+        assert(Value("a\"b").toString(true) == "\"a\\\"b\"");
+        assert(Value(1.5).toString() == "1.500000");
+
+        assert(Utils::throws<InvalidTypeException>([]() {
+            Value::fromString("x", TypeTag::INT);
+        }));
+        assert(Utils::throws<DependencyLoopException>([]() {
+            Value::error(Value::Error::LOOP).throwIfError();
+        }));
+        assert(Utils::throws<ArithmeticException>([]() {
+            Value::error(Value::Error::DIV_ZERO).throwIfError();
+        }));
+    }
+
+    static void test_pool()
+    {
+        Pool pool;
+
+        /* freed objects are reused by their size class */
+        void *p0 = pool.allocate(24);
+        void *p1 = pool.allocate(40);
+        assert(p0 != p1);
+        pool.deallocate(p0, 24);
+        assert(pool.allocate(32) == p0);
+        Pool::release(p1, 40);
+        assert(pool.allocate(48) == p1);
+        assert(pool.getLiveCount() == 2 && pool.getAllocatedCount() == 4);
+
+        /* large objects come from the heap */
+        void *large = pool.allocate(Pool::MAX_SIZE + 1);
+        Pool::release(large, Pool::MAX_SIZE + 1);
+        assert(pool.getChunkCount() == 1);
+
+        /* a sheet's cells and formulas come from its pool, which outlives the sheet while any
+         * of its cells exist */
+        shared_ptr<const CellBase> cell;
+        {
+            Sheet s0;
+            s0.setCellContent("A1", "=\"foo\"+\"bar\"");
+            assert(s0.getPool()->getLiveCount() > 3);
+
+            cell = s0.getCell("A1");
+            s0.setCellContent("A1", "");
+        }
+        assert(cell->getContentSource() == "=\"foo\"+\"bar\"");
+
+        /* equal strings are interned once, while referenced */
+        shared_ptr<StringPool> strings = make_shared<StringPool>(make_shared<Pool>());
+        shared_ptr<const string> str0 = strings->intern("=A1+1");
+        shared_ptr<const string> str1 = strings->intern(string("=A1+") + "1");
+        assert(str0 == str1 && strings->size() == 1);
+        assert(strings->intern("=A1+2") != str0);
+        assert(strings->size() == 1);
+        str0.reset();
+        assert(strings->size() == 1);
+        str1.reset();
+        assert(strings->size() == 0);
+
+        /* cells keep canonical sources of their formulas, shared by equal formulas */
+        Sheet s1;
+        s1.setCellContent("A1", "=abs( \"x\" )");
+        s1.setCellContent("A2", "=ABS(\"x\")");
+        assert(s1.getCell("A1")->getContentSource() == "=ABS(\"x\")");
+        assert(&s1.getCell("A1")->getContentSource() == &s1.getCell("A2")->getContentSource());
+        assert(s1.getSources()->size() == 1);
+        s1.setCellContent("A1", "plain");
+        s1.setCellContent("A2", "");
+        assert(s1.getSources()->size() == 0);
+    }
+
+    static void test_dependency_graph()
+    {
+        /* address lists outgrow their inline storage */
+        AddressList l0 = {"A1", "B2"};
+        AddressList l1 = l0;
+        l1.push_back("C3");
+        l1.push_back("D4");
+        l1.push_back("E5");
+        assert(l0.size() == 2 && l1.size() == 5 && l1[4] == Address("E5"));
+        AddressList l2 = move(l1);
+        assert(l2.size() == 5 && l2[0] == Address("A1") && l1.empty());
+        l1 = l2;
+        assert(l1 == l2 && l1 != l0);
+        l1 = l0;
+        assert(l1 == l0);
+
+        auto sorted = [](vector<Address> addrs) {
+            sort(addrs.begin(), addrs.end());
+            return addrs;
+        };
+
+        auto precedents = [](const DependencyGraph &graph, const Address &addr) {
+            vector<Address> addrs;
+            DependencyGraph::Id id;
+
+            if (graph.findId(addr, id)) {
+                pair<const DependencyGraph::Id *, const DependencyGraph::Id *> range =
+                    graph.getPrecedents(id);
+
+                for (const DependencyGraph::Id *it = range.first; it != range.second; ++it) {
+                    addrs.push_back(graph.getAddress(*it));
+                }
+            }
+
+            sort(addrs.begin(), addrs.end());
+            return addrs;
+        };
+
+        DependencyGraph d0;
+        DependencyGraph::Id id;
+        assert(d0.size() == 0);
+        assert(d0.getDependents("A1").empty());
+        assert(!d0.findId("A1", id));
+
+        d0.setPrecedents("B1", {"A1", "A2", "A1"});
+        d0.setPrecedents("B2", {"A1"});
+        assert(d0.size() == 3);
+        assert(sorted(d0.getDependents("A1")) == vector<Address>({"B1", "B2"}));
+        assert(d0.getDependents("A2") == vector<Address>({"B1"}));
+        assert(precedents(d0, "B1") == vector<Address>({"A1", "A2"}));
+
+        /* IDs are dense and stable */
+        DependencyGraph::Id b1 = d0.getId("B1");
+        assert(b1 < 4);
+        assert(d0.getAddress(b1) == "B1");
+
+        d0.setPrecedents("B1", {"A2"});
+        assert(d0.getDependents("A1") == vector<Address>({"B2"}));
+        assert(precedents(d0, "B1") == vector<Address>({"A2"}));
+        d0.setPrecedents("B1", {});
+        d0.setPrecedents("B2", {});
+        assert(d0.getDependents("A1").empty());
+        assert(precedents(d0, "B1").empty());
+        assert(d0.size() == 0);
+        assert(d0.getId("B1") == b1);
+
+        /* bulk build, with duplicates */
+        vector<pair<Address, Address>> pairs;
+        for (int row = 1; row <= 10000; ++row) {
+            pairs.emplace_back(Address(1, row), Address(2, row));
+            pairs.emplace_back(Address(1, row), Address(3, row));
+            pairs.emplace_back(Address(1, row % 10 + 1), Address(4, row));
+        }
+        pairs.emplace_back(Address(1, 1), Address(2, 1));
+
+        DependencyGraph d1;
+        d1.addAll(pairs);
+        assert(d1.size() == 30000);
+        assert(sorted(d1.getDependents("A20")) == vector<Address>({"B20", "C20"}));
+        assert(d1.getDependents("A5").size() == 1002);
+        assert(precedents(d1, "D15") == vector<Address>({"A6"}));
+
+        /* editing the bulk-built graph */
+        d1.setPrecedents("B20", {});
+        assert(d1.getDependents("A20") == vector<Address>({"C20"}));
+        d1.setPrecedents("B20", {"A20"});
+        d1.setPrecedents("Z1", {"A20"});
+        assert(sorted(d1.getDependents("A20")) == vector<Address>({"B20", "C20", "Z1"}));
+        assert(d1.size() == 30001);
+
+        /* many edits compact the adjacency arrays */
+        for (int row = 1; row <= 10000; ++row) {
+            d1.setPrecedents(Address(3, row), {});
+            d1.setPrecedents(Address(6, row), {Address(5, row)});
+        }
+        assert(d1.size() == 30001);
+        assert(sorted(d1.getDependents("A20")) == vector<Address>({"B20", "Z1"}));
+        assert(d1.getDependents("E9999") == vector<Address>({"F9999"}));
+
+        /* small batches are added one by one, large ones rebuild everything */
+        d1.addAll({{"A20", "G1"}, {"A20", "B20"}});
+        assert(d1.size() == 30002);
+        d1.addAll(pairs);
+        assert(d1.size() == 40002);
+        assert(sorted(d1.getDependents("A20")) == vector<Address>({"B20", "C20", "G1", "Z1"}));
+        assert(precedents(d1, "F9999") == vector<Address>({"E9999"}));
     }
 
     static void test_sheet()
@@ -177,8 +476,8 @@ public:
         });
 
         /* empty cell */
-        assert(dynamic_cast<const Cell<string> *>(s0.getCell("A1").get()) != nullptr);
-        assert(dynamic_cast<const Cell<string> *>(s0.getCell("A1").get())->getContent() == "");
+        assert(s0.getCell("A1")->getTag() == TypeTag::STRING);
+        assert(s0.getCell("A1")->getValue() == Value(""));
         assert(s0.getCell("A1").get()->getContentText() == "");
         assert(s0.getCell("A1").get()->getContentSource() == "");
         assert(s0.getCell("A1").get()->getAddr() == "A1");
@@ -189,8 +488,8 @@ public:
 
         /* text cell */
         s0.setCellContent("A1", "foo");
-        assert(dynamic_cast<const Cell<string> *>(s0.getCell("A1").get()) != nullptr);
-        assert(dynamic_cast<const Cell<string> *>(c) != nullptr);
+        assert(s0.getCell("A1")->getTag() == TypeTag::STRING);
+        assert(c->getTag() == TypeTag::STRING);
         assert(s0.getCell("A1")->getAddr() == c->getAddr());
         assert(s0.getCell("A1")->getDependencies() == c->getDependencies());
         assert(s0.getCell("A1")->getContentText() == c->getContentText());
@@ -265,6 +564,133 @@ public:
         s0.setCellContent("D1", "=D2");
         assert(s0.getCell("D1")->getContentText() == "");
 
+        /* resolved link targets follow replaced and removed cells */
+        s0.setCellContent("D2", "5");
+        assert(s0.getCell("D1")->getContentText() == "5");
+
+        Sheet::CellHandle handle;
+        s0.resolveCell("D2", handle);
+        assert(s0.isValid(handle));
+        assert(handle.cell == s0.getCell("D2").get());
+
+        s0.setCellType<int>("D2");
+        assert(!s0.isValid(handle));
+
+        bool thrown = false;
+        try {
+            s0.getCell("D1")->getContentText();
+        } catch (const InvalidTypeException &ex) {
+            thrown = true;
+        }
+        assert(thrown);
+
+        s0.setCellType<string>("D2");
+        s0.setCellContent("D2", "");
+        assert(s0.getCell("D1")->getContentText() == "");
+
+        /* double formulas read int cells, int formulas don't read double cells */
+        s0.setCellType<double>("E1");
+        s0.setCellContent("E1", "=C1/4+0.5");
+        assert(s0.getCell("E1")->getValue() == Value(1.0));
+        s0.setCellType<int>("E2");
+        s0.setCellContent("E2", "=E1");
+        assert(s0.getCell("E2")->getValue() == Value::error(Value::Error::TYPE));
+
+        /* division by zero */
+        s0.setCellType<int>("E3");
+        s0.setCellContent("E3", "=C1/(C1-C1)");
+        thrown = false;
+        try {
+            s0.getCell("E3")->getContentText();
+        } catch (const ArithmeticException &ex) {
+            thrown = true;
+        }
+        assert(thrown);
+
+        /* long chains are evaluated and propagated without recursion */
+        {
+            const int length = 100000;
+
+            Sheet s2;
+            vector<shared_ptr<CellBase>> chain;
+            chain.push_back(make_shared<Cell>(s2, Address(1, 1), TypeTag::INT, "1"));
+            for (int row = 2; row <= length; ++row) {
+                chain.push_back(make_shared<Cell>(s2, Address(1, row), TypeTag::INT,
+                                                  "=A" + to_string(row - 1) + "+1"));
+            }
+            s2.setCells(chain);
+            assert(s2.getCell(Address(1, length))->getValue() == Value(length));
+
+            s2.setCellType<int>("B1");
+            s2.setCellType<int>("C1");
+
+            int notified = 0;
+            s2.attachCellContentChangedEvent([&notified](const CellBase &) {
+                ++notified;
+            });
+            s2.setCellContent("A1", "=B1");
+            assert(notified == length);
+            assert(s2.getCell(Address(1, length))->getValue() == Value(length - 1));
+
+            /* each dependent is notified once, however many paths lead to it */
+            s2.setCellContent("C1", "=B1+A1");
+            notified = 0;
+            s2.setCellContent("B1", "1");
+            assert(notified == length + 2);
+            assert(s2.getCell("C1")->getValue() == Value(2));
+
+            /* a loop anywhere in the chain, and its removal */
+            s2.setCellContent("A1", "=A50000");
+            assert(s2.getCell(Address(1, length))->getValue() ==
+                   Value::error(Value::Error::LOOP));
+            s2.setCellContent("A1", "5");
+            assert(s2.getCell(Address(1, length))->getValue() == Value(length + 4));
+        }
+
+        /* subscriptions get batches of changes within their rectangles */
+        {
+            Sheet s3;
+            s3.setCellType<int>("A1");
+            for (int row = 2; row <= 10; ++row) {
+                s3.setCellType<int>(Address(1, row));
+                s3.setCellContent(Address(1, row), "=A" + to_string(row - 1) + "+1");
+            }
+            s3.setCellType<int>("B5");
+            s3.setCellContent("B5", "=A5");
+
+            vector<vector<Address>> top, column, all;
+            uint32_t topId = s3.subscribe("A1", "B3", [&top](const vector<Address> &changed) {
+                top.push_back(changed);
+            });
+            uint32_t columnId =
+                s3.subscribe("B1", "B100", [&column](const vector<Address> &changed) {
+                    column.push_back(changed);
+                });
+            s3.subscribe(
+                Address(1, 1),
+                Address(Address::MAX_COL, Address::MAX_ROW),
+                [&all](const vector<Address> &changed) { all.push_back(changed); });
+
+            s3.setCellContent("A1", "1");
+            assert(top.size() == 1 && top[0] == vector<Address>({"A1", "A2", "A3"}));
+            assert(column.size() == 1 && column[0] == vector<Address>({"B5"}));
+            assert(all.size() == 1 && all[0].size() == 11 && all[0][0] == "A1");
+            assert(s3.getCell("B5")->getValue() == Value(5));
+
+            /* nothing changed within the rectangle, no batch */
+            s3.setCellContent("A8", "0");
+            assert(top.size() == 1);
+            assert(column.size() == 1);
+            assert(all.size() == 2 && all[1] == vector<Address>({"A8", "A9", "A10"}));
+
+            s3.setSubscriptionRange(topId, "A9", "A9");
+            s3.unsubscribe(columnId);
+            s3.setCellContent("A8", "2");
+            assert(top.size() == 2 && top[1] == vector<Address>({"A9"}));
+            assert(column.size() == 1);
+            assert(all.size() == 3);
+        }
+
         /* serialization */
         ostringstream oss;
         Sheet s1;
@@ -302,12 +728,874 @@ public:
         istringstream iss;
         iss.str(
             "[{\"type\":\"string\",\"addr\":\"A1\",\"content\":\"some \\\"escaped\\\" string with \\\\ backslash\"},{\"type\":\"int\",\"addr\":\"A2\",\"content\":\"5\"},{\"type\":\"double\",\"addr\":\"A3\",\"content\":\"=5.75+0.25\"},{\"type\":\"string\",\"addr\":\"A4\",\"content\":\"=\\\"foo\\\"+\\\" and \\\\\\\"bar\\\\\\\"\\\"\"}]");
-        Sheet s3 = Sheet::deserialize(iss);
-        assert(s3.m_Cells.size() == 4);
-        assert(s3.getCell("A1")->getContentText() == "some \"escaped\" string with \\ backslash");
-        assert(s3.getCell("A2")->getContentText() == "5");
-        assert(s3.getCell("A3")->getContentText() == "6.000000");
-        assert(s3.getCell("A4")->getContentText() == "foo and \"bar\"");
+        shared_ptr<Sheet> s3 = Sheet::deserialize(iss);
+        assert(s3->m_Cells.size() == 4);
+        assert(s3->getCell("A1")->getContentText() == "some \"escaped\" string with \\ backslash");
+        assert(s3->getCell("A2")->getContentText() == "5");
+        assert(s3->getCell("A3")->getContentText() == "6.000000");
+        assert(s3->getCell("A4")->getContentText() == "foo and \"bar\"");
+
+        /* snapshot is not affected by later edits */
+        Sheet s4;
+        s4.setCellContent("A1", "foo");
+        shared_ptr<const SheetSnapshot> snap = s4.snapshot();
+        s4.setCellContent("A1", "bar");
+        s4.setCellContent("A2", "baz");
+        oss.str("");
+        oss.clear();
+        snap->serialize(oss);
+        assert(snap->size() == 1);
+        assert(oss.str() == "[{\"type\":\"string\",\"addr\":\"A1\",\"content\":\"foo\"}]");
+
+        /* number literals are copied without creating cell objects */
+        s4.setCellType<int>("B2");
+        s4.setCellContent("B2", "7");
+        s4.setCellType<double>("A3");
+        s4.setCellContent("A3", "2.5");
+        size_t allocated = s4.getPool()->getAllocatedCount();
+        snap = s4.snapshot();
+        assert(s4.getPool()->getAllocatedCount() == allocated);
+        assert(snap->size() == 4 && snap->getLiterals().size() == 2);
+        vector<string> rowMajor;
+        snap->forEachRowMajor([&rowMajor](const CellBase *cell,
+                                          const SheetSnapshot::Literal *literal) {
+            rowMajor.push_back(cell != nullptr ? (string) cell->getAddr()
+                                               : (string) literal->addr + "=" +
+                                                     literal->getValue().toString(false));
+        });
+        assert((rowMajor == vector<string>{"A1", "A2", "B2=7", "A3=2.500000"}));
+        oss.str("");
+        oss.clear();
+        snap->serialize(oss);
+        istringstream copy(oss.str());
+        shared_ptr<Sheet> s6 = Sheet::deserialize(copy);
+        assert(s6->m_Cells.size() == 4);
+        assert(s6->getCell("B2")->getType() == "int" && s6->getCell("B2")->getContentText() == "7");
+        assert(s6->getCell("A3")->getType() == "double");
+
+        /* counters */
+        Sheet s5;
+        s5.setCellType<int>("A1");
+        s5.setCellContent("A1", "1");
+        s5.setCellType<int>("A2");
+        s5.setCellContent("A2", "=A1+1");
+        s5.setCellType<int>("A3");
+        s5.setCellContent("A3", "=A2*A2");
+
+        Stats stats = s5.getStats();
+        assert(stats.cells == 3 && stats.dependencyEdges == 2 && stats.internedStrings == 2);
+        assert(stats.formulaNodes == 6 && stats.poolBytes > 0 && stats.literalBytes > 0);
+        assert(stats.dependencyBytes > 0 && stats.loadedTileBytes == 0);
+        /* none of the edited cells had dependents yet */
+        assert(stats.evaluations == 0 && stats.recalcs == 0 && stats.lastInvalidationMicros == -1);
+
+        assert(s5.getCell("A3")->getContentText() == "4");
+        stats = s5.getStats();
+        /* precedents are evaluated along with the cell asked for, their values are hits */
+        assert(stats.evaluations == 2 && stats.valueMisses == 1 && stats.valueHits == 2);
+        assert(stats.linkMisses == 3 && stats.linkHits == 0);
+
+        s5.setCellContent("A1", "2");
+        assert(s5.getCell("A3")->getContentText() == "9");
+        assert(s5.getCell("A3")->getContentText() == "9");
+        stats = s5.getStats();
+        assert(stats.evaluations == 4 && stats.valueMisses == 2 && stats.valueHits == 5);
+        assert(stats.linkMisses == 4 && stats.linkHits == 2 && stats.recalcs == 1);
+        assert(stats.lastInvalidationMicros >= 0);
+
+        /* formula nodes are counted per sheet */
+        {
+            Sheet s6;
+            s6.setCellContent("A1", "=\"foo\"+\"bar\"");
+            assert(s6.getStats().formulaNodes == 3 && s5.getStats().formulaNodes == 6);
+            s6.setCellContent("A1", "");
+            assert(s6.getStats().formulaNodes == 0);
+        }
+        assert(s5.getStats().formulaNodes == 6);
+    }
+
+    static void test_csv()
+    {
+        /* quoting, empty fields, CRLF, type inference */
+        Sheet s0;
+        istringstream iss(
+            "1,2.5,foo\r\n"
+            "2,3,\"with, comma and \"\"quotes\"\"\"\r\n"
+            ",,\"multi\nline\"\n"
+            "=A1,,\"0123456789abcdef0123456789abcdef\"");
+        assert(Csv::read(iss, s0) == 4);
+        assert(s0.getCell("A1")->getType() == "string");
+        assert(s0.getCell("A2")->getType() == "string");
+        assert(s0.getCell("B1")->getType() == "double");
+        assert(s0.getCell("B2")->getContentText() == "3.000000");
+        assert(s0.getCell("C2")->getContentText() == "with, comma and \"quotes\"");
+        assert(s0.getCell("C3")->getContentText() == "multi\nline");
+        assert(s0.getCell("A3")->getContentSource() == "");
+        assert(s0.getCell("A4")->getContentText() == "=A1");
+        assert(s0.getCell("C4")->getContentText() == "0123456789abcdef0123456789abcdef");
+
+        /* only decimal numbers are numbers, not what else strtod() reads */
+        Sheet sNumbers;
+        istringstream issNumbers("0x10,-0x1p3,nan,-inf,+INF,1e,1e+,.,-,1.2.3,12abc,"
+                                 "1.5,-.5,+5.,1e5,2.5E-3,99999999999,+42\n");
+        assert(Csv::read(issNumbers, sNumbers) == 1);
+        for (const char *addr : {"A1", "B1", "C1", "D1", "E1", "F1", "G1", "H1", "I1", "J1",
+                                 "K1"}) {
+            assert(sNumbers.getCell(addr)->getType() == "string");
+        }
+        assert(sNumbers.getCell("A1")->getContentText() == "0x10");
+        assert(sNumbers.getCell("C1")->getContentText() == "nan");
+        for (const char *addr : {"L1", "M1", "N1", "O1", "P1", "Q1"}) {
+            assert(sNumbers.getCell(addr)->getType() == "double");
+        }
+        assert(sNumbers.getCell("O1")->getValue() == Value(1e5));
+        assert(sNumbers.getCell("R1")->getType() == "int");
+
+        /* a column of numbers with hex or nan among them is a column of strings */
+        Sheet sMixed;
+        istringstream issMixed("1.5,2\nnan,0x10\n");
+        assert(Csv::read(issMixed, sMixed) == 2);
+        assert(sMixed.getCell("A1")->getType() == "string");
+        assert(sMixed.getCell("B1")->getType() == "string");
+        assert(sMixed.getCell("B2")->getContentText() == "0x10");
+
+        /* int column, TSV, origin */
+        Sheet s1;
+        istringstream iss1("5\tfoo\n-7\tbar\n");
+        assert(Csv::read(iss1, s1, Address("B2"), Csv::delimiterFor("data.TSV")) == 2);
+        assert(s1.getCell("B3")->getType() == "int");
+        assert(s1.getCell("B3")->getContentText() == "-7");
+        assert(s1.getCell("C2")->getContentText() == "foo");
+
+        /* export writes evaluated values */
+        s1.setCellType<int>("D3");
+        s1.setCellContent("D3", "=B2+B3");
+        ostringstream oss;
+        Csv::write(oss, s1);
+        assert(oss.str() == "\n,5,foo\n,-7,bar,-2\n");
+
+        ostringstream oss1;
+        Csv::write(oss1, s0);
+        istringstream iss2(oss1.str());
+        Sheet s2;
+        Csv::read(iss2, s2, Address(1, 1), ',', false);
+        assert(s2.getCell("C2")->getContentText() == "with, comma and \"quotes\"");
+        assert(s2.getCell("C3")->getContentText() == "multi\nline");
+        assert(s2.getCell("B2")->getContentText() == "3.000000");
+    }
+
+    static void test_headless()
+    {
+        string file = "/tmp/spreadsheet_test_headless.csv";
+        ostringstream out, err;
+
+        /* edits, single cells and dump */
+        assert(Headless::run(
+            { "-e", "A1:int", "-e", "A1=5", "-e", "A2:int", "-e", "A2==A1*2", "-e", "B1=foo",
+              "-c", "A2", "-o", file },
+            out,
+            err) == 0);
+        assert(out.str() == "A2\tint\t10\n");
+
+        out.str("");
+        assert(Headless::run({ file, "-e", "A1=7", "-d" }, out, err) == 0);
+        assert(out.str() == "A1\tint\t7\nB1\tstring\tfoo\nA2\tint\t10\n");
+
+        /* errors */
+        assert(Headless::run({ "-e", "A1" }, out, err) == 1);
+        assert(Headless::run({ "-e", "A1:int", "-e", "A1==1+" }, out, err) == 1);
+        assert(Headless::run({ "/nonexistent/file" }, out, err) == 1);
+        assert(Headless::run({ "--unknown" }, out, err) == 2);
+        assert(Headless::run({ "-c" }, out, err) == 2);
+
+        /* stats as JSON */
+        out.str("");
+        assert(Headless::run({ "-e", "A1:int", "-e", "A1==2+3", "-c", "A1", "--stats" }, out,
+                             err) == 0);
+        assert(out.str().find("A1\tint\t5\n{\"cells\":1,") == 0);
+        assert(out.str().find("\"evaluations\":1,") != string::npos);
+        assert(out.str().find("\"lastRepaintMicros\":null}\n") != string::npos);
+
+        remove(file.c_str());
+    }
+
+    static void test_journal()
+    {
+        string base = "/tmp/spreadsheet_test_journal.json";
+        remove(base.c_str());
+        remove(Journal::journalFilename(base).c_str());
+
+        /* edits are appended to the journal and replayed on load */
+        Sheet s0;
+        shared_ptr<Journal> j0 = make_shared<Journal>(base);
+        j0->reset(s0);
+        s0.attachJournal(j0);
+
+        s0.setCellContent("A1", "foo");
+        s0.setCellType<int>("A2");
+        s0.setCellContent("A2", "5");
+        s0.setCellType<int>("A3");
+        s0.setCellContent("A3", "=A2+1");
+        assert(j0->pendingCount() == 5);
+        j0->flush(s0);
+        assert(j0->pendingCount() == 0);
+
+        s0.setCellContent("A1", "");
+        s0.setCellContent("A2", "6");
+        j0->flush(s0);
+
+        ifstream f0(base);
+        shared_ptr<Sheet> s1 = Sheet::deserialize(f0);
+        assert(s1->m_Cells.size() == 0);
+        Journal j1(base);
+        j1.replay(*s1);
+        assert(s1->m_Cells.size() == 2);
+        assert(s1->getCell("A1")->getContentSource() == "");
+        assert(s1->getCell("A3")->getType() == "int");
+        assert(s1->getCell("A3")->getContentText() == "7");
+
+        /* incomplete trailing record is ignored */
+        ofstream(Journal::journalFilename(base), ios::app) << "{\"type\":\"int\",\"ad";
+        ifstream f1(base);
+        shared_ptr<Sheet> s2 = Sheet::deserialize(f1);
+        Journal j2(base);
+        j2.replay(*s2);
+        assert(s2->getCell("A3")->getContentText() == "7");
+
+        /* every step of a load ends early once cancelled */
+        atomic<bool> cancelled(true);
+        int thrown = 0;
+        try {
+            j2.replay(*s2, &cancelled);
+        } catch (const CancelledException &ex) {
+            ++thrown;
+        }
+        try {
+            s2->createAllDependencies(&cancelled);
+        } catch (const CancelledException &ex) {
+            ++thrown;
+        }
+        istringstream iss("[{\"type\":\"int\",\"addr\":\"A1\",\"content\":\"1\"}]");
+        try {
+            Sheet::deserialize(iss, nullptr, &cancelled);
+        } catch (const CancelledException &ex) {
+            ++thrown;
+        }
+        assert(thrown == 3);
+
+        /* compaction moves the journal into the base */
+        Sheet s3;
+        shared_ptr<Journal> j3 = make_shared<Journal>(base, 1);
+        j3->reset(s3);
+        s3.attachJournal(j3);
+        s3.setCellContent("B1", "bar");
+        j3->flush(s3);
+        j3->waitForCompaction();
+
+        ifstream f2(Journal::journalFilename(base));
+        assert(f2.peek() == EOF);
+
+        ifstream f3(base);
+        shared_ptr<Sheet> s4 = Sheet::deserialize(f3);
+        assert(s4->getCell("B1")->getContentText() == "bar");
+
+        remove(base.c_str());
+        remove(Journal::journalFilename(base).c_str());
+    }
+
+    static void test_server()
+    {
+        const string path = "/tmp/spreadsheet_test.sock";
+
+        shared_ptr<Sheet> sheet = make_shared<Sheet>();
+        sheet->setCellType<int>("A1");
+        sheet->setCellContent("A1", "5");
+
+        Server server(sheet, path);
+        server.listen();
+        thread acceptor(&Server::run, &server);
+
+        auto connectClient = [&]() {
+            sockaddr_un addr = sockaddr_un();
+            addr.sun_family = AF_UNIX;
+            path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            assert(connect(fd, (sockaddr *) &addr, sizeof(addr)) == 0);
+            return fd;
+        };
+
+        /* sends the requests and reads the given number of response lines */
+        auto exchange = [](int fd, const string &requests, size_t lines) {
+            assert(send(fd, requests.data(), requests.length(), 0) == (ssize_t) requests.length());
+
+            string response;
+            char c;
+            while (lines > 0 && recv(fd, &c, 1, 0) == 1) {
+                response += c;
+                if (c == '\n') {
+                    --lines;
+                }
+            }
+
+            return response;
+        };
+
+        int fd = connectClient();
+
+        assert(exchange(fd, "GET A1\n", 1) == "OK int\t5\n");
+        assert(exchange(fd, "get b7\n", 1) == "OK string\t\n");
+        assert(exchange(fd, "GET 7\n", 1) == "ERR invalid address\n");
+        assert(exchange(fd, "NOPE\n", 1) == "ERR unknown command\n");
+
+        /* edits are visible to the next request, dependents are evaluated again */
+        assert(exchange(fd, "TYPE B1 int\nSET B1 =A1*2\nGET B1\n", 3) == "OK\nOK\nOK int\t10\n");
+        assert(exchange(fd, "SET A1 7\nGET B1\n", 2) == "OK\nOK int\t14\n");
+        assert(exchange(fd, "SET C1 =A1+\n", 1) == "ERR incorrect formula syntax\n");
+        assert(exchange(fd, "TYPE C1 float\n", 1) == "ERR unknown type\n");
+        assert(exchange(fd, "SET A2 a\\b\n", 1) == "OK\n");
+
+        assert(exchange(fd, "RANGE A1 B2\n", 4) ==
+            "OK 3\nA1\tint\t7\nB1\tint\t14\nA2\tstring\ta\\\\b\n");
+
+        /* deleted cells disappear */
+        assert(exchange(fd, "SET A2 \nRANGE B2 A1\n", 4) == "OK\nOK 2\nA1\tint\t7\nB1\tint\t14\n");
+
+        /* RECALC evaluates the formulas again and reports the version it has published */
+        size_t evaluations = sheet->getCounters().evaluations;
+        string recalc = exchange(fd, "RECALC\n", 1);
+        assert(recalc.compare(0, 3, "OK ") == 0 && stoi(recalc.substr(3)) > 0);
+        assert(sheet->getCounters().evaluations == evaluations + 1);
+
+        /* concurrent readers and writers */
+        vector<thread> clients;
+        for (int i = 0; i < 8; ++i) {
+            clients.emplace_back([&, i]() {
+                int clientFd = connectClient();
+
+                for (int j = 0; j < 50; ++j) {
+                    string addr = (string) Address(i + 1, j + 10);
+                    assert(exchange(clientFd, "SET " + addr + " x\n", 1) == "OK\n");
+                    assert(exchange(clientFd, "GET " + addr + "\n", 1) == "OK string\tx\n");
+                    assert(exchange(clientFd, "GET B1\n", 1) == "OK int\t14\n");
+                }
+
+                close(clientFd);
+            });
+        }
+
+        for (thread &client : clients) {
+            client.join();
+        }
+
+        assert(exchange(fd, "RANGE A10 H59\n", 401).compare(0, 7, "OK 400\n") == 0);
+
+        /* threads of closed connections are joined as new ones come */
+        bool reaped = false;
+        for (int i = 0; i < 100 && !reaped; ++i) {
+            int clientFd = connectClient();
+            assert(exchange(clientFd, "GET A1\n", 1) == "OK int\t7\n");
+            close(clientFd);
+
+            lock_guard<mutex> lock(server.m_ClientsMutex);
+            reaped = server.m_Clients.size() <= 2;
+        }
+        assert(reaped);
+
+        /* a request without an end is cut off */
+        {
+            int clientFd = connectClient();
+            string chunk(4096, 'x');
+            for (size_t sent = 0; sent <= Server::MAX_REQUEST_LENGTH; sent += chunk.length()) {
+                if (send(clientFd, chunk.data(), chunk.length(), MSG_NOSIGNAL) <= 0) {
+                    break;
+                }
+            }
+
+            string response;
+            char c;
+            while (recv(clientFd, &c, 1, 0) == 1) {
+                response += c;
+            }
+            assert(response == "ERR request too long\n");
+            close(clientFd);
+        }
+        assert(exchange(fd, "QUIT\n", 1) == "OK\n");
+        close(fd);
+
+        server.stop();
+        acceptor.join();
+
+        assert(sheet->getCell("H59")->getContentText() == "x");
+        assert(access(path.c_str(), F_OK) != 0);
+    }
+    static void test_cell_store()
+    {
+        const string path = "/tmp/spreadsheet_test.tiles";
+        remove(path.c_str());
+
+        const size_t budget = 256 << 10;
+
+        {
+            /* number literals are stored as records rather than objects */
+            Sheet s0;
+            for (int row : {3, 1, 2}) {
+                s0.setCellType<int>(Address(1, row));
+                s0.setCellContent(Address(1, row), "-" + to_string(row));
+            }
+            s0.setCellType<double>("B300");
+            s0.setCellContent("B300", "2.5");
+            s0.setCellType<int>("C2");
+            s0.setCellContent("C2", "=A1*2");
+
+            Value literal;
+            for (int row = 1; row <= 3; ++row) {
+                assert(!s0.m_Cells.findObject(Address(1, row), literal) && literal == Value(-row));
+            }
+            assert(!s0.m_Cells.findObject("B300", literal) && literal == Value(2.5));
+            assert(s0.m_Cells.findObject("C2", literal) && literal.getKind() == Value::Kind::EMPTY);
+            assert(s0.getCell("B300")->getAddr() == Address("B300"));
+            assert(s0.getCell("B300")->getType() == "double");
+            assert(s0.getCell("B300")->getValue() == Value(2.5));
+            assert(s0.getCell("C2")->getContentText() == "-2");
+
+            /* records become objects and back */
+            s0.setCellContent("A1", "=5");
+            assert(s0.m_Cells.findObject("A1", literal));
+            assert(s0.getCell("C2")->getContentText() == "10");
+            s0.setCellContent("A1", "6");
+            assert(!s0.m_Cells.findObject("A1", literal) && literal == Value(6));
+            assert(s0.getCell("C2")->getContentText() == "12");
+            s0.setCellType<string>("A1");
+            assert(s0.m_Cells.findObject("A1", literal));
+            s0.setCellContent("A1", "");
+            assert(s0.m_Cells.size() == 4);
+
+            ostringstream oss;
+            s0.serialize(oss);
+            istringstream iss(oss.str());
+            shared_ptr<Sheet> s1 = Sheet::deserialize(iss);
+            assert(s1->m_Cells.size() == 4);
+            assert(s1->getCell("A3")->getContentText() == "-3");
+            assert(s1->getCell("B300")->getValue() == Value(2.5));
+        }
+
+        {
+            /* occupancy: gaps and blocks are skipped without looking up cells */
+            Sheet s0;
+            Address found(1, 1), begin(1, 1), end(1, 1);
+            assert(!s0.getUsedRange(begin, end));
+            assert(!s0.findCell("A1", 0, 1, true, found));
+            assert(s0.findCell("A1", 0, 1, false, found) && found == "A2");
+
+            for (int row = 1; row <= 1000; ++row) {
+                s0.setCellContent(Address(3, row), "x");
+            }
+            s0.setCellContent(Address(3, 2000000000), "far");
+            s0.setCellContent(Address(100000, 5), "right");
+
+            assert(s0.hasCell("C1000") && !s0.hasCell("C1001"));
+            assert(s0.findCell("C1", 0, 1, false, found) && found == "C1001");
+            assert(s0.findCell("C1000", 0, 1, true, found) && found == Address(3, 2000000000));
+            assert(s0.findCell(Address(3, 2000000000), 0, -1, true, found) && found == "C1000");
+            assert(!s0.findCell(Address(3, 2000000000), 0, 1, true, found));
+            assert(s0.findCell(Address(3, 2000000000), 0, 1, false, found) &&
+                   found == Address(3, 2000000001));
+            assert(!s0.findCell(Address(3, Address::MAX_ROW), 0, 1, false, found));
+            assert(s0.findCell("A5", 1, 0, true, found) && found == "C5");
+            assert(s0.findCell("C5", 1, 0, true, found) && found == Address(100000, 5));
+            assert(s0.findCell(Address(100000, 5), -1, 0, true, found) && found == "C5");
+            assert(!s0.findCell("B5", -1, 0, true, found));
+
+            assert(s0.getUsedRange(begin, end));
+            assert(begin == "C1" && end == Address(100000, 2000000000));
+
+            /* removed cells leave the index */
+            s0.setCellContent(Address(3, 2000000000), "");
+            s0.setCellContent(Address(100000, 5), "");
+            s0.setCellContent("C500", "");
+            assert(s0.getUsedRange(begin, end) && end == "C1000");
+            assert(s0.findCell("C1", 0, 1, false, found) && found == "C500");
+            assert(!s0.findCell("C1000", 0, 1, true, found));
+        }
+
+        {
+            Sheet s0(path, budget);
+            assert(s0.isOutOfCore());
+
+            /* 2000 rows in 4 columns = 32 tiles, way over budget */
+            for (int row = 1; row <= 2000; ++row) {
+                s0.setCellType<int>(Address(1, row));
+                s0.setCellContent(Address(1, row), to_string(row));
+
+                s0.setCellType<int>(Address(20, row));
+                s0.setCellContent(Address(20, row), "=A" + to_string(row) + "*2");
+
+                s0.setCellContent(Address(40, row), "text " + to_string(row));
+                s0.setCellType<int>(Address(60, row));
+                s0.setCellContent(Address(60, row), "=T" + to_string(2001 - row));
+            }
+
+            assert(s0.m_Cells.size() == 8000);
+            assert(s0.m_Cells.getLoadedBytes() <= budget);
+
+            /* evaluation crosses evicted tiles */
+            assert(s0.getCell("T1")->getContentText() == "2");
+            assert(s0.getCell(Address(60, 1))->getContentText() == "4000");
+            assert(s0.getCell(Address(40, 1234))->getContentText() == "text 1234");
+            assert(s0.m_Cells.getLoadedBytes() <= budget);
+
+            /* events reach dependents in evicted tiles */
+            vector<Address> changed;
+            s0.attachCellContentChangedEvent([&](const CellBase &cell) {
+                changed.push_back(cell.getAddr());
+            });
+            s0.setCellContent("A2000", "5");
+            assert(changed.size() == 3);
+            assert(s0.getCell(Address(60, 1))->getContentText() == "10");
+            s0.attachCellContentChangedEvent(nullptr);
+
+            /* removing cells */
+            s0.setCellContent(Address(40, 1), "");
+            assert(s0.m_Cells.size() == 7999);
+
+            /* loops are still detected when their cells are in different tiles */
+            s0.setCellType<int>("B1");
+            s0.setCellContent("A1500", "=B1");
+            s0.setCellContent("B1", "=A1500");
+            bool thrown = false;
+            try {
+                s0.getCell("B1")->getContentText();
+            } catch (const DependencyLoopException &ex) {
+                thrown = true;
+            }
+            assert(thrown);
+            s0.setCellContent("B1", "0");
+
+            s0.saveTiles();
+
+            /* not saved */
+            s0.setCellContent("A1", "999");
+        }
+
+        {
+            Sheet s1(path, budget);
+            assert(s1.m_Cells.size() == 8000);
+            assert(s1.getCell("A1")->getContentText() == "1");
+            assert(s1.getCell(Address(60, 1))->getContentText() == "10");
+            assert(s1.getCell(Address(40, 1))->getContentSource() == "");
+            assert(s1.getCell("A1500")->getContentSource() == "=B1");
+
+            /* dependencies are rebuilt on open */
+            s1.setCellContent("A1", "21");
+            assert(s1.getCell(Address(60, 2000))->getContentText() == "42");
+
+            /* so is the occupancy of all tiles */
+            Address found(1, 1), begin(1, 1), end(1, 1);
+            assert(s1.findCell("B1", 1, 0, true, found) && found == "T1");
+            assert(s1.findCell(Address(40, 2000), 0, -1, false, found) && found == Address(40, 1));
+            assert(s1.getUsedRange(begin, end) && begin == "A1" && end == Address(60, 2000));
+
+            /* full serialization visits all tiles within the budget */
+            ostringstream oss;
+            s1.serialize(oss);
+            istringstream iss(oss.str());
+            assert(Sheet::deserialize(iss)->m_Cells.size() == 8000);
+            assert(s1.m_Cells.getLoadedBytes() <= budget);
+        }
+
+        {
+            /* saved in place even when named by another path, not removed and rewritten */
+            struct stat before, after;
+            assert(stat(path.c_str(), &before) == 0);
+            ostringstream out, err;
+            assert(Headless::run({ path, "-e", "A2=5", "-o", "/tmp/./spreadsheet_test.tiles" },
+                                 out, err) == 0);
+            assert(stat(path.c_str(), &after) == 0 && after.st_ino == before.st_ino);
+            Sheet s1(path, budget);
+            assert(s1.m_Cells.size() == 8000);
+            assert(s1.getCell("A2")->getContentText() == "5");
+
+            /* opening ends early once cancelled */
+            atomic<bool> cancelled(true);
+            bool thrown = false;
+            try {
+                Sheet s2(path, budget, &cancelled);
+            } catch (const CancelledException &ex) {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+
+        {
+            ofstream garbage(path);
+            garbage << "not a tile file";
+        }
+        bool thrown = false;
+        try {
+            Sheet s2(path);
+        } catch (const InvalidInputException &ex) {
+            thrown = true;
+        }
+        assert(thrown);
+
+        remove(path.c_str());
+    }
+
+    static void test_recalculator()
+    {
+        shared_ptr<Sheet> sheet = make_shared<Sheet>();
+
+        /* chain A1 <- A2 <- ... <- A2000 */
+        sheet->setCellType<int>("A1");
+        sheet->setCellContent("A1", "1");
+        for (int row = 2; row <= 2000; ++row) {
+            sheet->setCellType<int>(Address(1, row));
+            sheet->setCellContent(Address(1, row), "=A" + to_string(row - 1) + "+1");
+        }
+
+        vector<Address> changed;
+        sheet->attachCellContentChangedEvent([&changed](const CellBase &cell) {
+            changed.push_back(cell.getAddr());
+        });
+
+        /* edits schedule the changed cells themselves */
+        {
+            Recalculator recalc(sheet, [](const CellBase &cell) {
+                try {
+                    return cell.getContentText();
+                } catch (const DependencyLoopException &ex) {
+                    return string("loop");
+                }
+            });
+
+            /* waits for the recalculation, collecting its results */
+            auto finish = [&recalc]() {
+                vector<Recalculator::Result> results;
+
+                while (true) {
+                    unique_lock<mutex> lock = recalc.lock();
+
+                    for (const Recalculator::Result &result : recalc.takeResults()) {
+                        results.push_back(result);
+                    }
+
+                    if (!recalc.isBusy()) {
+                        return results;
+                    }
+
+                    lock.unlock();
+                    this_thread::sleep_for(chrono::milliseconds(1));
+                }
+            };
+
+            {
+                unique_lock<mutex> lock = recalc.lock();
+
+                recalc.setViewport("A1990", "B2000");
+                sheet->setCellContent("A1", "5");
+
+                /* dependents are notified in topological order */
+                assert(changed.size() == 2000);
+                for (int row = 1; row <= 2000; ++row) {
+                    assert(changed[row - 1] == Address(1, row));
+                }
+
+                sheet->attachCellContentChangedEvent(nullptr);
+            }
+
+            /* only cells in the viewport are reported, all are evaluated */
+            vector<Recalculator::Result> results = finish();
+            assert(results.size() == 11);
+            assert(results.back().addr == "A2000");
+            assert(results.back().text == "2004");
+            assert(recalc.getDone() == 2000);
+            assert(recalc.getTotal() == 2000);
+            assert(recalc.getLastDuration() >= 0);
+            assert(static_cast<const Cell &>(*sheet->getCell("A1000")).isEvaluated());
+
+            /* cells changed again while waiting move forward, they are not scheduled twice */
+            {
+                unique_lock<mutex> lock = recalc.lock();
+
+                sheet->setCellContent("A1", "6");
+                sheet->setCellContent("A1", "5");
+                assert(recalc.getTotal() == 2000);
+                assert(recalc.m_Pending.size() == 2000);
+                recalc.request("A1500");
+                assert(recalc.getTotal() == 2000);
+            }
+
+            results = finish();
+            assert(results.back().text == "2004");
+            assert(recalc.getDone() == 2000);
+            assert(recalc.m_Visible.empty() && recalc.m_Queue.empty());
+
+            /* an edit restarts the recalculation in progress, requested cells go first */
+            {
+                unique_lock<mutex> lock = recalc.lock();
+
+                sheet->setCellContent("A1", "7");
+                sheet->setCellType<int>("B2000");
+                sheet->setCellContent("B2000", "=A2000*2");
+                sheet->setCellContent("A1", "1");
+                recalc.request("B1995");
+            }
+
+            results = finish();
+            assert(results.front().addr == "B1995");
+            assert(results.back().addr == "A2000" || results.back().addr == "B2000");
+            assert(sheet->getCell("B2000")->getContentText() == "4000");
+
+            /* visible cells and their precedents are evaluated before the rest */
+            {
+                unique_lock<mutex> lock = recalc.lock();
+
+                for (int row = 1; row <= 100; ++row) {
+                    sheet->setCellType<int>(Address(3, row));
+                    sheet->setCellContent(Address(3, row), "=A" + to_string(row) + "*3");
+                }
+
+                sheet->setCellType<int>("D1");
+                sheet->setCellContent("D1", "=C50+A1");
+
+                recalc.setViewport("D1", "D1");
+                sheet->setCellContent("A1", "3");
+            }
+
+            while (true) {
+                unique_lock<mutex> lock = recalc.lock();
+
+                results = recalc.takeResults();
+                /* D1 may be scheduled again by its own edit earlier */
+                if (!results.empty()) {
+                    for (const Recalculator::Result &result : results) {
+                        assert(result.addr == "D1");
+                        assert(result.text == "159");
+                    }
+                    break;
+                }
+            }
+
+            finish();
+            assert(static_cast<const Cell &>(*sheet->getCell("A2000")).isEvaluated());
+            assert(sheet->getCell("C100")->getContentText() == "306");
+
+            /* walks around loops end */
+            {
+                unique_lock<mutex> lock = recalc.lock();
+
+                recalc.setViewport("E1", "E2");
+
+                sheet->setCellType<int>("E1");
+                sheet->setCellType<int>("E2");
+                sheet->setCellContent("E1", "=E2+A1");
+                sheet->setCellContent("E2", "=E1");
+            }
+
+            results = finish();
+            assert(!results.empty());
+            for (const Recalculator::Result &result : results) {
+                assert(result.text == "loop");
+            }
+        }
+
+        /* destroying the recalculator leaves the rest unevaluated */
+        {
+            Recalculator stopped(sheet, [](const CellBase &cell) {
+                return cell.getContentText();
+            });
+
+            unique_lock<mutex> lock = stopped.lock();
+            sheet->setCellContent("A1", "2");
+        }
+
+        assert(sheet->getCell("A2000")->getContentText() == "2001");
+    }
+
+    static void test_search()
+    {
+        assert(Utils::throws<InvalidArgumentException>([]() { Search(""); }));
+        assert(Utils::throws<InvalidArgumentException>([]() { Search("a(b"); }));
+
+        shared_ptr<Sheet> sheet = make_shared<Sheet>();
+
+        /* strings, number literals (stored as records), formulas and their values */
+        for (int row = 1; row <= 2000; ++row) {
+            sheet->setCellContent(Address(1, row), "row " + to_string(row));
+            sheet->setCellType<int>(Address(2, row));
+            sheet->setCellContent(Address(2, row), to_string(row * 10));
+        }
+        sheet->setCellType<int>("C5");
+        sheet->setCellContent("C5", "=B5+1");
+        sheet->setCellType<int>("C6");
+        sheet->setCellContent("C6", "=B6+1");
+        sheet->setCellType<int>("C7");
+        sheet->setCellContent("C7", "=C7");
+
+        /* the value of a formula matches only once evaluated, errors never */
+        assert(Search("^51$").findAll(*sheet).empty());
+        assert(sheet->getCell("C5")->getContentText() == "51");
+        try {
+            sheet->getCell("C7")->getContentText();
+            assert(false);
+        } catch (const DependencyLoopException &ex) {
+        }
+        assert(Search("^51$").findAll(*sheet) == vector<Address>({"C5"}));
+        assert(Search("#|loop").findAll(*sheet).empty());
+
+        /* results are ordered row by row */
+        assert(Search("B6\\+|ow 1999|19990").findAll(*sheet) ==
+               vector<Address>({"C6", "A1999", "B1999"}));
+
+        /* sources of formulas, anchored patterns */
+        assert(Search("B6\\+").findAll(*sheet) == vector<Address>({"C6"}));
+        assert(Search("^row 199.$").findAll(*sheet).size() == 10);
+        assert(Search("^2001$").findAll(*sheet).empty());
+        assert(Search("^20000$").findAll(*sheet) == vector<Address>({"B2000"}));
+
+        /* the index gives the same results, also after edits */
+        {
+            TrigramIndex index(sheet);
+            assert(index.size() > 0);
+
+            for (const string &pattern : {"51", "row 19", "20000", "B6+", "none"}) {
+                Search search(pattern);
+                assert(search.findAll(*sheet, &index) == search.findAll(*sheet));
+            }
+
+            sheet->setCellContent("A3", "moved 51");
+            sheet->setCellContent("A510", "");
+            assert(Search("row 51").findAll(*sheet, &index) ==
+                   vector<Address>({"A51", "A511", "A512", "A513", "A514", "A515", "A516",
+                                    "A517", "A518", "A519"}));
+            assert(Search("ved 5").findAll(*sheet, &index) == vector<Address>({"A3"}));
+
+            /* enough edits rebuild the index */
+            for (int row = 1; row <= 1000; ++row) {
+                sheet->setCellContent(Address(4, row), "new");
+            }
+            assert(Search("new").findAll(*sheet, &index).size() == 1000);
+        }
+
+        /* replacing keeps the types, invalid results are left alone */
+        Search search("0$");
+        assert(search.replace("100", "5") == "105");
+        assert(Search("(\\d)0").replace("10 20", "$1x") == "1x 2x");
+
+        size_t failed = 0;
+        vector<Address> cells = {"A10", "B10", "B20", "C5"};
+        assert(search.replaceAll(*sheet, cells, "$&1", &failed) == 3);
+        assert(failed == 0);
+        assert(sheet->getCell("A10")->getContentSource() == "row 101");
+        assert(sheet->getCell("B10")->getType() == "int");
+        assert(sheet->getCell("B10")->getContentText() == "1001");
+        assert(sheet->getCell("C5")->getContentSource() == "=B5+1");
+
+        assert(Search("^").replaceAll(*sheet, {"B30", "A30"}, "x", &failed) == 1);
+        assert(failed == 1);
+        assert(sheet->getCell("B30")->getContentText() == "300");
+        assert(sheet->getCell("A30")->getContentText() == "xrow 30");
     }
 };
 
@@ -321,13 +1609,53 @@ int main()
     __Test::test_utils();
     cout << "Passed" << endl;
 
+    cout << "Testing Value... ";
+    __Test::test_value();
+    cout << "Passed" << endl;
+
     cout << "Testing Formula... ";
     __Test::test_formula();
     cout << "Passed" << endl;
 
+    cout << "Testing Pool... ";
+    __Test::test_pool();
+    cout << "Passed" << endl;
+
+    cout << "Testing DependencyGraph... ";
+    __Test::test_dependency_graph();
+    cout << "Passed" << endl;
+
     cout << "Testing Sheet... ";
     __Test::test_sheet();
     cout << "Passed" << endl;
 
+    cout << "Testing Csv... ";
+    __Test::test_csv();
+    cout << "Passed" << endl;
+
+    cout << "Testing Headless... ";
+    __Test::test_headless();
+    cout << "Passed" << endl;
+
+    cout << "Testing Journal... ";
+    __Test::test_journal();
+    cout << "Passed" << endl;
+
+    cout << "Testing CellStore... ";
+    __Test::test_cell_store();
+    cout << "Passed" << endl;
+
+    cout << "Testing Server... ";
+    __Test::test_server();
+    cout << "Passed" << endl;
+
+    cout << "Testing Recalculator... ";
+    __Test::test_recalculator();
+    cout << "Passed" << endl;
+
+    cout << "Testing Search... ";
+    __Test::test_search();
+    cout << "Passed" << endl;
+
     return 0;
 }